@@ -2,18 +2,18 @@
 
 #include "actuator.h"
 #include "platform.h"
+#include "json.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 
 #define MAX_ACTUATORS 16
-#define MAX_LINE 256
 
 static actuator_config_t g_actuators[MAX_ACTUATORS];
 static int g_actuator_count = 0;
 
 // Parse actuator type from string
-static actuator_type_t parse_actuator_type(const char *type_str) {
+static inline actuator_type_t parse_actuator_type(const char *type_str) {
     if (strcmp(type_str, "led") == 0) return ACTUATOR_TYPE_LED;
     if (strcmp(type_str, "rgb_led") == 0) return ACTUATOR_TYPE_RGB_LED;
     if (strcmp(type_str, "servo") == 0) return ACTUATOR_TYPE_SERVO;
@@ -24,7 +24,7 @@ static actuator_type_t parse_actuator_type(const char *type_str) {
 }
 
 // Parse actuator driver from string
-static actuator_driver_t parse_actuator_driver(const char *driver_str) {
+static inline actuator_driver_t parse_actuator_driver(const char *driver_str) {
     if (strcmp(driver_str, "gpio") == 0) return ACTUATOR_DRIVER_GPIO;
     if (strcmp(driver_str, "pwm") == 0) return ACTUATOR_DRIVER_PWM;
     if (strcmp(driver_str, "i2c") == 0) return ACTUATOR_DRIVER_I2C;
@@ -32,41 +32,57 @@ static actuator_driver_t parse_actuator_driver(const char *driver_str) {
     return ACTUATOR_DRIVER_UNKNOWN;
 }
 
+// Actuator being parsed (values may arrive in fragments)
+typedef struct {
+    actuator_config_t actuator;
+    char type[32];
+    char driver[32];
+} actuator_parse_t;
+
+// Parse events of one actuator object (paths relative to the actuator)
+static int actuator_parse_event(const JsonEvent *event, void *user) {
+    actuator_parse_t *parse = user;
+    actuator_config_t *actuator = &parse->actuator;
+    if (!event->path) return 0;
+
+    if (event->type == JSON_OBJECT && event->depth == 0) {
+        memset(parse, 0, sizeof(*parse));
+    } else if (event->type == JSON_STRING || event->type == JSON_NUMBER) {
+        const char *key = event->path;
+        if (strcmp(key, "/id") == 0) {
+            json_append(actuator->id, sizeof(actuator->id), event);
+        } else if (strcmp(key, "/name") == 0) {
+            json_append(actuator->name, sizeof(actuator->name), event);
+        } else if (strcmp(key, "/type") == 0) {
+            json_append(parse->type, sizeof(parse->type), event);
+        } else if (strcmp(key, "/driver") == 0) {
+            json_append(parse->driver, sizeof(parse->driver), event);
+        } else if (strcmp(key, "/driver_params") == 0) {
+            json_append(actuator->driver_params, sizeof(actuator->driver_params), event);
+        }
+    } else if (event->type == JSON_OBJECT_END && event->depth == 0) {
+        if (g_actuator_count >= MAX_ACTUATORS) return 1;
+
+        actuator->type = parse_actuator_type(parse->type);
+        actuator->driver = parse_actuator_driver(parse->driver);
+        actuator->enabled = 1;
+        actuator->state = 0;
+        actuator->value = 0;
+        g_actuators[g_actuator_count++] = *actuator;
+    }
+    return 0;
+}
+
 // Initialize actuator system
 int actuator_system_init(const char *config_file) {
     memset(g_actuators, 0, sizeof(g_actuators));
     g_actuator_count = 0;
 
-    // Load configuration from file (JSON format)
-    FILE *fp = fopen(config_file, "r");
-    if (!fp) {
+    // Load configuration from file: {"actuators":[{...}, ...]}
+    actuator_parse_t parse;
+    if (json_load_records(config_file, "/actuators", actuator_parse_event, &parse) < 0) {
         return -1;
     }
-
-    char line[MAX_LINE];
-    while (fgets(line, sizeof(line), fp) && g_actuator_count < MAX_ACTUATORS) {
-        // Parse JSON line (simplified parsing)
-        // In production, use a proper JSON parser
-        if (strstr(line, "\"id\":")) {
-            char *id_start = strstr(line, "\"id\":\"");
-            if (id_start) {
-                id_start += 6;
-                char *id_end = strstr(id_start, "\"");
-                if (id_end) {
-                    size_t id_len = id_end - id_start;
-                    memcpy(g_actuators[g_actuator_count].id, id_start, id_len);
-                    g_actuators[g_actuator_count].id[id_len] = '\0';
-                }
-            }
-        }
-        // ... (parse other fields)
-        g_actuators[g_actuator_count].enabled = 1;
-        g_actuators[g_actuator_count].state = 0;
-        g_actuators[g_actuator_count].value = 0;
-        g_actuator_count++;
-    }
-
-    fclose(fp);
     return g_actuator_count;
 }
 
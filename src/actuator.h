@@ -4,6 +4,7 @@
 #ifndef ACTUATOR_H
 #define ACTUATOR_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 // Actuator types
@@ -0,0 +1,128 @@
+#include "admission.h"
+#include <string.h>
+
+static const char *class_names[ADMISSION_CLASSES] = { "interactive", "automation", "batch" };
+
+// 初始化队列
+void admission_init(AdmissionQueue *q, int capacity) {
+    static const int weights[ADMISSION_CLASSES] = ADMISSION_DEFAULT_WEIGHTS;
+
+    memset(q, 0, sizeof(*q));
+    for (int i = 0; i < ADMISSION_CLASSES; i++) {
+        AdmissionLane *lane = &q->lanes[i];
+        lane->head.prev = &lane->head;
+        lane->head.next = &lane->head;
+        lane->weight = weights[i];
+    }
+    q->capacity = (capacity > 0) ? capacity : 1;
+}
+
+// 设置类别权重
+void admission_set_weight(AdmissionQueue *q, int klass, int weight) {
+    if (klass < 0 || klass >= ADMISSION_CLASSES) return;
+    q->lanes[klass].weight = (weight > 0) ? weight : 1;
+}
+
+// 入队 (所属类别的队尾)
+int admission_push(AdmissionQueue *q, AdmissionNode *node, long long now_ms, long long deadline_ms) {
+    if (q->count >= q->capacity) return -1;
+    if (node->klass < 0 || node->klass >= ADMISSION_CLASSES) node->klass = ADMISSION_INTERACTIVE;
+
+    // 队列空闲后的第一个请求: 新一轮从交互类开始 (先补满它的赤字)，不沿用上次停下的位置
+    if (q->count == 0) {
+        for (int i = 0; i < ADMISSION_CLASSES; i++) q->lanes[i].deficit = 0;
+        q->current = ADMISSION_INTERACTIVE;
+        q->lanes[ADMISSION_INTERACTIVE].deficit = q->lanes[ADMISSION_INTERACTIVE].weight;
+    }
+
+    AdmissionLane *lane = &q->lanes[node->klass];
+    node->enqueued_ms = now_ms;
+    node->deadline_ms = deadline_ms;
+    node->queued = 1;
+    node->prev = lane->head.prev;
+    node->next = &lane->head;
+    lane->head.prev->next = node;
+    lane->head.prev = node;
+    lane->count++;
+    q->count++;
+    return 0;
+}
+
+// 从队列中移除
+void admission_remove(AdmissionQueue *q, AdmissionNode *node) {
+    if (!node->queued) return;
+
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = NULL;
+    node->queued = 0;
+    q->lanes[node->klass].count--;
+    q->count--;
+}
+
+// Deficit round-robin: 当前类别的赤字用完 (或无可调度请求) 时转到下一类并补充 weight。
+// 空的或已达并发上限的类别不积累赤字，一轮之内必能找到可调度的请求。
+AdmissionNode* admission_pop(AdmissionQueue *q, unsigned eligible) {
+    for (int step = 0; step <= ADMISSION_CLASSES; step++) {
+        AdmissionLane *lane = &q->lanes[q->current];
+        int ready = lane->count > 0 && (eligible & (1u << q->current));
+
+        if (ready && lane->deficit >= 1) {
+            AdmissionNode *node = lane->head.next;
+            lane->deficit--;
+            admission_remove(q, node);
+            return node;
+        }
+        if (!ready) lane->deficit = 0;
+
+        q->current = (q->current + 1) % ADMISSION_CLASSES;
+        q->lanes[q->current].deficit += q->lanes[q->current].weight;
+    }
+    return NULL;
+}
+
+// 已过截止时间的队首 (每个类别内按到达顺序，队首最早到期)
+AdmissionNode* admission_peek_expired(const AdmissionQueue *q, long long now_ms) {
+    for (int i = 0; i < ADMISSION_CLASSES; i++) {
+        const AdmissionLane *lane = &q->lanes[i];
+        if (lane->count > 0 && now_ms >= lane->head.next->deadline_ms) {
+            return lane->head.next;
+        }
+    }
+    return NULL;
+}
+
+// 估算完成时间: 本类排在前面的请求，加上其他类别按权重比例插在其间的请求，
+// 每 slots 个请求 (含自身) 需要一个平均处理时长
+long long admission_estimate_wait(const AdmissionQueue *q, int klass, int slots) {
+    if (slots < 1) slots = 1;
+    if (klass < 0 || klass >= ADMISSION_CLASSES) klass = ADMISSION_INTERACTIVE;
+
+    const AdmissionLane *own = &q->lanes[klass];
+    int ahead = own->count;
+    for (int i = 0; i < ADMISSION_CLASSES; i++) {
+        if (i == klass) continue;
+        int share = (own->count + 1) * q->lanes[i].weight / own->weight;
+        ahead += (q->lanes[i].count < share) ? q->lanes[i].count : share;
+    }
+
+    int rounds = (ahead + slots) / slots;
+    return (long long)(rounds * q->avg_service_ms);
+}
+
+// 记录处理耗时 (EWMA, alpha = 0.2)
+void admission_record_service(AdmissionQueue *q, long long service_ms) {
+    if (q->avg_service_ms <= 0) {
+        q->avg_service_ms = (double)service_ms;
+    } else {
+        q->avg_service_ms = q->avg_service_ms * 0.8 + (double)service_ms * 0.2;
+    }
+}
+
+// 解析类别名称
+int admission_parse_class(const char *name, int len) {
+    for (int i = 0; i < ADMISSION_CLASSES; i++) {
+        if ((int)strlen(class_names[i]) == len && memcmp(name, class_names[i], len) == 0) return i;
+    }
+    return -1;
+}
@@ -0,0 +1,72 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+// 准入控制: 后端并发已满时，请求排队等待，而不是立即 503
+// 节点嵌入在调用者的结构体中 (侵入式链表)，入队/出队/取消均为 O(1)。
+// 每个请求类别一个 FIFO 队列，类别之间按权重做 deficit round-robin 调度。
+
+// 请求类别: 交互式对话优先，自动化和批量任务使用剩余的并发
+typedef enum {
+    ADMISSION_INTERACTIVE,
+    ADMISSION_AUTOMATION,
+    ADMISSION_BATCH,
+    ADMISSION_CLASSES
+} AdmissionClass;
+
+// 默认权重 (每轮可出队的请求数) 和并发上限 (占 max_inflight 的百分比)
+#define ADMISSION_DEFAULT_WEIGHTS { 8, 3, 1 }
+#define ADMISSION_DEFAULT_CAPS    { 100, 75, 50 }
+
+typedef struct AdmissionNode {
+    struct AdmissionNode *prev;
+    struct AdmissionNode *next;
+    long long enqueued_ms;
+    long long deadline_ms;      // 超过此时间仍未开始处理则放弃
+    int klass;                  // AdmissionClass (入队前由调用者设置)
+    int queued;
+} AdmissionNode;
+
+// 单个类别的队列
+typedef struct {
+    AdmissionNode head;         // 哨兵
+    int count;
+    int weight;                 // DRR quantum
+    int deficit;
+} AdmissionLane;
+
+typedef struct {
+    AdmissionLane lanes[ADMISSION_CLASSES];
+    int current;                // DRR 当前类别
+    int count;                  // 所有类别合计
+    int capacity;               // 队列深度 (preset queue_depth，所有类别共享)
+    double avg_service_ms;      // 请求处理耗时的指数移动平均
+} AdmissionQueue;
+
+// 初始化队列 (默认权重)
+void admission_init(AdmissionQueue *q, int capacity);
+
+// 设置类别权重 (>= 1)
+void admission_set_weight(AdmissionQueue *q, int klass, int weight);
+
+// 入队 (node->klass 对应的队列)，队列已满返回 -1
+int admission_push(AdmissionQueue *q, AdmissionNode *node, long long now_ms, long long deadline_ms);
+
+// 按 DRR 取出下一个请求，eligible 为可调度类别的位掩码 (1 << klass)，没有可调度的返回 NULL
+AdmissionNode* admission_pop(AdmissionQueue *q, unsigned eligible);
+
+// 已过截止时间的队首请求 (任一类别)，没有返回 NULL
+AdmissionNode* admission_peek_expired(const AdmissionQueue *q, long long now_ms);
+
+// 从队列中移除 (例如客户端断开)
+void admission_remove(AdmissionQueue *q, AdmissionNode *node);
+
+// 估算 klass 类新请求排队 + 处理完成所需的时间 (slots = 可并行处理的请求数)
+long long admission_estimate_wait(const AdmissionQueue *q, int klass, int slots);
+
+// 记录一次请求处理耗时
+void admission_record_service(AdmissionQueue *q, long long service_ms);
+
+// 解析类别名称 ("interactive" / "automation" / "batch")，未知返回 -1
+int admission_parse_class(const char *name, int len);
+
+#endif
@@ -0,0 +1,109 @@
+#include "arena.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 初始化
+void arena_init(Arena *arena, size_t block_size) {
+    arena->head = NULL;
+    arena->block_size = (block_size > 0) ? block_size : ARENA_DEFAULT_BLOCK;
+    arena->used = 0;
+    arena->peak = 0;
+}
+
+// 申请新块并放到链表头 (大对象单独占一个块)
+static ArenaBlock* arena_grow(Arena *arena, size_t size) {
+    size_t block_size = (size > arena->block_size) ? size : arena->block_size;
+    ArenaBlock *block = malloc(sizeof(ArenaBlock) + block_size);
+    if (!block) return NULL;
+
+    block->size = block_size;
+    block->used = 0;
+    block->next = arena->head;
+    arena->head = block;
+    return block;
+}
+
+// 分配
+void* arena_alloc(Arena *arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (size == 0) size = ARENA_ALIGN;
+
+    ArenaBlock *block = arena->head;
+    if (!block || block->size - block->used < size) {
+        block = arena_grow(arena, size);
+        if (!block) return NULL;
+    }
+
+    void *ptr = block->data + block->used;
+    block->used += size;
+    arena->used += size;
+    if (arena->used > arena->peak) arena->peak = arena->used;
+    return ptr;
+}
+
+// 复制字符串
+char* arena_strndup(Arena *arena, const char *str, size_t len) {
+    char *copy = arena_alloc(arena, len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+char* arena_strdup(Arena *arena, const char *str) {
+    return arena_strndup(arena, str, strlen(str));
+}
+
+// 格式化: 先测量长度再一次写入
+char* arena_sprintf(Arena *arena, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+    if (len < 0) return NULL;
+
+    char *str = arena_alloc(arena, (size_t)len + 1);
+    if (!str) return NULL;
+
+    va_start(args, fmt);
+    vsnprintf(str, (size_t)len + 1, fmt, args);
+    va_end(args);
+    return str;
+}
+
+// 重置: 释放溢出块，保留最早申请的块
+void arena_reset(Arena *arena) {
+    ArenaBlock *block = arena->head;
+    if (!block) return;
+
+    while (block->next) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    // 第一个块若是为大对象单独申请的，不保留
+    if (block->size > arena->block_size) {
+        free(block);
+        block = NULL;
+    } else {
+        block->used = 0;
+    }
+
+    arena->head = block;
+    arena->used = 0;
+}
+
+// 释放全部
+void arena_destroy(Arena *arena) {
+    ArenaBlock *block = arena->head;
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+    arena->used = 0;
+}
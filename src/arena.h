@@ -0,0 +1,46 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// 请求级 bump 分配器: 请求期间的分配只移动指针，请求结束时一次 reset 全部释放。
+// 第一个块在 reset 后保留复用，超出部分链接溢出块 (reset 时释放)。
+
+#define ARENA_DEFAULT_BLOCK 4096
+#define ARENA_ALIGN 8
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;
+    size_t used;
+    char data[];
+} ArenaBlock;
+
+typedef struct {
+    ArenaBlock *head;       // 当前分配块 (链表头)
+    size_t block_size;      // 新块的默认大小
+    size_t used;            // 本轮已分配字节数
+    size_t peak;            // 历史峰值 (用于调整 block_size)
+} Arena;
+
+// 初始化 (不分配内存，首次分配时才申请第一个块)
+void arena_init(Arena *arena, size_t block_size);
+
+// 分配 size 字节 (8 字节对齐)，失败返回 NULL
+void* arena_alloc(Arena *arena, size_t size);
+
+// 复制字符串
+char* arena_strdup(Arena *arena, const char *str);
+char* arena_strndup(Arena *arena, const char *str, size_t len);
+
+// 格式化到 arena 中 (精确计算长度)
+char* arena_sprintf(Arena *arena, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// 释放本轮所有分配，保留第一个块
+void arena_reset(Arena *arena);
+
+// 释放全部内存
+void arena_destroy(Arena *arena);
+
+#endif
@@ -1,36 +1,45 @@
 #include "backend.h"
+#include "ollama.h"
+#include "health.h"
+#include "resolver.h"
+#include "upstream.h"
+#include "json.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-#include <unistd.h>
 
 // Ollama backend implementation (wrapper around ollama.c)
 Backend* backend_ollama_create(const char *host, int port) {
-    Backend *backend = malloc(sizeof(Backend));
+    Backend *backend = calloc(1, sizeof(Backend));
     if (!backend) return NULL;
 
     strncpy(backend->name, "ollama", sizeof(backend->name) - 1);
-    strncpy(backend->host, host, sizeof(backend->host) - 1);
+    snprintf(backend->host, sizeof(backend->host), "%s", host);
     backend->port = port;
     backend->api_type = BACKEND_OLLAMA;
-    backend->priv = NULL;
+    backend->priv = upstream_pool_get(host, port);
+    if (!backend->priv) {
+        free(backend);
+        return NULL;
+    }
 
     return backend;
 }
 
 // OpenAI-compatible backend implementation
 Backend* backend_openai_create(const char *host, int port) {
-    Backend *backend = malloc(sizeof(Backend));
+    Backend *backend = calloc(1, sizeof(Backend));
     if (!backend) return NULL;
 
     strncpy(backend->name, "openai", sizeof(backend->name) - 1);
-    strncpy(backend->host, host, sizeof(backend->host) - 1);
+    snprintf(backend->host, sizeof(backend->host), "%s", host);
     backend->port = port;
     backend->api_type = BACKEND_OPENAI_COMPAT;
-    backend->priv = NULL;
+    backend->priv = upstream_pool_get(host, port);
+    if (!backend->priv) {
+        free(backend);
+        return NULL;
+    }
 
     return backend;
 }
@@ -42,160 +51,383 @@ void backend_destroy(Backend *backend) {
     }
 }
 
-// OpenAI-compatible HTTP POST (reuse from ollama.c)
-extern int http_post(const char *host, int port,
-                     const char *path, const char *body,
-                     char *response, size_t response_size);
+// OpenAI-compatible servers take sampling parameters at the top level: forward the temperature
+static const char* openai_sampling(Arena *arena, const char *options) {
+    JsonValue temperature;
+    if (!options || json_find(options, strlen(options), "/temperature", &temperature) < 0 ||
+        temperature.type != JSON_NUMBER) {
+        return "";
+    }
+    return arena_sprintf(arena, ",\"temperature\":%.*s", (int)temperature.len, temperature.data);
+}
+
+// Build the upstream request
+char* backend_build_request(const Backend *backend, Arena *arena, int chat, const char *model,
+                            const char *input, const char *history, const char *options, int stream,
+                            const char **path) {
+    if (backend->api_type == BACKEND_OLLAMA) {
+        return ollama_build_request(arena, chat, model, input, history, options, stream, path);
+    }
 
-// OpenAI Generate API
-static char* openai_generate(Backend *backend, const char *model, const char *prompt) {
-    char body[4096];
-    snprintf(body, sizeof(body),
-        "{\"model\":\"%s\",\"prompt\":\"%s\",\"max_tokens\":512}",
-        model, prompt
+    const char *sampling = openai_sampling(arena, options);
+    if (!sampling) return NULL;
+    if (chat) {
+        *path = "/v1/chat/completions";
+        return arena_sprintf(arena,
+            "{\"model\":\"%s\",\"messages\":[%s{\"role\":\"user\",\"content\":\"%s\"}],\"max_tokens\":512%s}",
+            model, history ? history : "", input, sampling
+        );
+    }
+    *path = "/v1/completions";
+    return arena_sprintf(arena,
+        "{\"model\":\"%s\",\"prompt\":\"%s\",\"max_tokens\":512%s}",
+        model, input, sampling
     );
+}
 
-    char response[8192];
-    int result = http_post(backend->host, backend->port,
-                          "/v1/completions", body,
-                          response, sizeof(response));
+// Build one /v1/completions request for several prompts (OpenAI-compatible servers batch them)
+char* backend_build_batch_request(Arena *arena, const char *model, const char **inputs, int count,
+                                  const char *options, const char **path) {
+    size_t len = 0;
+    for (int i = 0; i < count; i++) len += strlen(inputs[i]) + 3;
 
-    if (result < 0) {
-        return strdup("{\"error\":\"Failed to connect to OpenAI-compatible backend\"}");
-    }
+    char *prompts = arena_alloc(arena, len + 1);
+    if (!prompts) return NULL;
 
-    // Extract text from OpenAI response: {"choices":[{"text":"..."}]}
-    char *text_start = strstr(response, "\"text\":\"");
-    if (!text_start) {
-        return strdup("{\"error\":\"Invalid OpenAI response\"}");
+    char *out = prompts;
+    for (int i = 0; i < count; i++) {
+        out += sprintf(out, "%s\"%s\"", i > 0 ? "," : "", inputs[i]);
     }
 
-    text_start += strlen("\"text\":\"");
-    char *text_end = strchr(text_start, '"');
-    if (!text_end) {
-        return strdup("{\"error\":\"Invalid OpenAI response\"}");
+    const char *sampling = openai_sampling(arena, options);
+    if (!sampling) return NULL;
+
+    *path = "/v1/completions";
+    return arena_sprintf(arena,
+        "{\"model\":\"%s\",\"prompt\":[%s],\"max_tokens\":512%s}",
+        model, prompts, sampling
+    );
+}
+
+// Batched completion parse state: one choice object at a time
+typedef struct {
+    char **replies;
+    int count;
+    Arena *arena;
+    long index;                 // "index" of the current choice (-1 = not seen)
+    JsonValue text;
+} ChoiceScan;
+
+static int choice_event(const JsonEvent *event, void *user) {
+    ChoiceScan *scan = user;
+    if (!event->path || strncmp(event->path, "/choices/", 9) != 0) return 0;
+
+    // Only the choice object itself ("/choices/N") and its own keys ("/choices/N/text")
+    const char *key = strchr(event->path + 9, '/');
+    if (key && strchr(key + 1, '/')) return 0;
+    if (event->type == JSON_OBJECT && !key) {
+        scan->index = -1;
+        scan->text.type = JSON_NONE;
+    } else if (event->type == JSON_NUMBER && key && strcmp(key, "/index") == 0) {
+        scan->index = atol(event->data);
+    } else if (event->type == JSON_STRING && key && strcmp(key, "/text") == 0) {
+        scan->text.type = JSON_STRING;
+        scan->text.data = event->data;
+        scan->text.len = event->len;
+    } else if (event->type == JSON_OBJECT_END && !key) {
+        if (scan->index >= 0 && scan->index < scan->count && !scan->replies[scan->index]) {
+            scan->replies[scan->index] = json_string(scan->arena, &scan->text);
+        }
     }
+    return 0;
+}
 
-    *text_end = '\0';
-    char *reply = strdup(text_start);
-    *text_end = '"';
+// Split a batched completion into per-prompt texts by "index" (missing entries stay NULL)
+char** backend_parse_choices(Arena *arena, const char *response, int count) {
+    char **replies = arena_alloc(arena, count * sizeof(char*));
+    if (!replies) return NULL;
+    memset(replies, 0, count * sizeof(char*));
+
+    // The choice fields can come in any order, so each choice is committed at its closing brace
+    ChoiceScan scan = { replies, count, arena, -1, { JSON_NONE, NULL, 0 } };
+    JsonParser parser;
+    json_parser_init(&parser);
+    json_feed(&parser, response, strlen(response), choice_event, &scan);
+    return replies;
+}
 
-    return reply;
+// Extract the reply from a complete response body
+char* backend_parse_reply(const Backend *backend, Arena *arena, int chat, const char *response) {
+    if (backend->api_type == BACKEND_OLLAMA) {
+        return ollama_parse_reply(arena, chat, response);
+    }
+
+    // OpenAI: {"choices":[{"text":"..."}]} or {"choices":[{"message":{"content":"..."}}]}
+    JsonValue field;
+    json_find(response, strlen(response), chat ? "/choices/0/message/content" : "/choices/0/text", &field);
+    char *value = json_string(arena, &field);
+    return value ? value : arena_strdup(arena, "{\"error\":\"Invalid OpenAI response\"}");
 }
 
-// OpenAI Chat API
-static char* openai_chat(Backend *backend, const char *model, const char *message) {
-    char body[4096];
-    snprintf(body, sizeof(body),
-        "{\"model\":\"%s\",\"messages\":[{\"role\":\"user\",\"content\":\"%s\"}],\"max_tokens\":512}",
-        model, message
-    );
+// Auto-detect backend (probe Ollama, vLLM and LM Studio in parallel)
+Backend* backend_autodetect(void) {
+    // Priority: Ollama > vLLM > LM Studio
+    HealthProbe probes[] = {
+        {"localhost", 11434, "/", 0},
+        {"localhost", 8000, "/v1/models", 0},
+        {"localhost", 1234, "/v1/models", 0}
+    };
+    int count = sizeof(probes) / sizeof(probes[0]);
 
-    char response[8192];
-    int result = http_post(backend->host, backend->port,
-                          "/v1/chat/completions", body,
-                          response, sizeof(response));
+    // Probes only read the resolver cache, so resolve the host here (startup, main thread)
+    resolver_prefetch("localhost");
+    health_probe_run(probes, count, HEALTH_PROBE_TIMEOUT_MS);
 
-    if (result < 0) {
-        return strdup("{\"error\":\"Failed to connect to OpenAI-compatible backend\"}");
+    for (int i = 0; i < count; i++) {
+        if (probes[i].ok) {
+            if (i == 0) {
+                return backend_ollama_create(probes[i].host, probes[i].port);
+            } else {
+                return backend_openai_create(probes[i].host, probes[i].port);
+            }
+        }
     }
 
-    // Extract content from OpenAI response: {"choices":[{"message":{"content":"..."}}]}
-    char *content_start = strstr(response, "\"content\":\"");
-    if (!content_start) {
-        return strdup("{\"error\":\"Invalid OpenAI response\"}");
+    // Fallback to Ollama (default); its breaker stays open until a probe succeeds
+    fprintf(stderr, "[Backend] No backend answered, falling back to Ollama on localhost:11434\n");
+    Backend *backend = backend_ollama_create("localhost", 11434);
+    if (backend) backend->breaker = BREAKER_OPEN;
+    return backend;
+}
+
+// Create an empty group
+BackendGroup* backend_group_create(BalancePolicy policy) {
+    BackendGroup *group = calloc(1, sizeof(BackendGroup));
+    if (!group) return NULL;
+    group->policy = policy;
+    return group;
+}
+
+// Add a replica (the group takes ownership)
+int backend_group_add(BackendGroup *group, Backend *backend) {
+    if (!backend) return -1;
+    if (group->count >= BACKEND_MAX_REPLICAS) {
+        fprintf(stderr, "[Backend] Too many replicas (max %d)\n", BACKEND_MAX_REPLICAS);
+        backend_destroy(backend);
+        return -1;
     }
+    group->replicas[group->count++] = backend;
+    return 0;
+}
+
+// Add replicas from a comma-separated host list
+int backend_group_add_hosts(BackendGroup *group, int api_type, const char *list, int default_port) {
+    int added = 0;
+    const char *item = list;
+
+    while (*item) {
+        const char *item_end = strchr(item, ',');
+        size_t len = item_end ? (size_t)(item_end - item) : strlen(item);
+
+        char host[256];
+        int port = default_port;
+        const char *colon = NULL;
+
+        if (*item == '[') {
+            // [IPv6]:port
+            const char *close_bracket = memchr(item, ']', len);
+            if (!close_bracket) return -1;
+            len = close_bracket - item - 1;
+            if (close_bracket[1] == ':') colon = close_bracket + 1;
+            item++;
+        } else {
+            // host:port (a bare IPv6 address has more than one colon and no port)
+            const char *first = memchr(item, ':', len);
+            if (first && !memchr(first + 1, ':', len - (first + 1 - item))) {
+                colon = first;
+                len = first - item;
+            }
+        }
+
+        if (len == 0 || len >= sizeof(host)) return -1;
+        memcpy(host, item, len);
+        host[len] = '\0';
+        if (colon) port = atoi(colon + 1);
+        if (port <= 0) return -1;
+
+        Backend *backend = (api_type == BACKEND_OLLAMA) ? backend_ollama_create(host, port)
+                                                        : backend_openai_create(host, port);
+        if (backend_group_add(group, backend) < 0) return -1;
+        added++;
 
-    content_start += strlen("\"content\":\"");
-    char *content_end = strchr(content_start, '"');
-    if (!content_end) {
-        return strdup("{\"error\":\"Invalid OpenAI response\"}");
+        if (!item_end) break;
+        item = item_end + 1;
     }
 
-    *content_end = '\0';
-    char *reply = strdup(content_start);
-    *content_end = '"';
+    return added;
+}
+
+// Next value of the group's sequence, mixed (splitmix32) for random picks
+static unsigned int group_random(BackendGroup *group) {
+    unsigned int x = __atomic_add_fetch(&group->cursor, 0x9E3779B9u, __ATOMIC_RELAXED);
+    x ^= x >> 16;
+    x *= 0x85EBCA6Bu;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35u;
+    x ^= x >> 16;
+    return x;
+}
 
-    return reply;
+static int load_of(const Backend *backend) {
+    return __atomic_load_n(&backend->outstanding, __ATOMIC_RELAXED);
 }
 
-// Generate text (dispatches to appropriate backend)
-char* backend_generate(Backend *backend, const char *model, const char *prompt) {
-    if (!backend) return strdup("{\"error\":\"Backend not initialized\"}");
+// Open replicas and half-open replicas with a trial in flight take no new requests
+static int available(const Backend *backend) {
+    int state = __atomic_load_n(&backend->breaker, __ATOMIC_RELAXED);
+    if (state == BREAKER_OPEN) return 0;
+    return state == BREAKER_CLOSED || __atomic_load_n(&backend->trial, __ATOMIC_RELAXED) == 0;
+}
 
-    if (backend->api_type == BACKEND_OLLAMA) {
-        // Use existing ollama_generate
-        extern char* ollama_generate(const char *model, const char *prompt);
-        return ollama_generate(model, prompt);
-    } else if (backend->api_type == BACKEND_OPENAI_COMPAT) {
-        return openai_generate(backend, model, prompt);
+// Replica index chosen by the group's policy among available replicas not in skip (bit per index),
+// or -1 when none is left
+static int select_replica(BackendGroup *group, unsigned int skip) {
+    int count = group->count;
+    int pick = -1;
+
+    if (group->policy == BALANCE_P2C && count > 1) {
+        unsigned int r = group_random(group);
+        int a = r % count;
+        int b = (a + 1 + (r >> 16) % (count - 1)) % count;     // distinct from a
+        if ((skip & (1u << a)) || !available(group->replicas[a])) a = -1;
+        if ((skip & (1u << b)) || !available(group->replicas[b])) b = -1;
+        if (a >= 0 && b >= 0) {
+            pick = (load_of(group->replicas[b]) < load_of(group->replicas[a])) ? b : a;
+        } else {
+            pick = (a >= 0) ? a : b;
+        }
     }
 
-    return strdup("{\"error\":\"Unknown backend type\"}");
+    if (pick < 0) {
+        // Round-robin takes the first available replica from a rotating offset;
+        // least outstanding scans all of them from that offset so ties spread evenly
+        unsigned int start = __atomic_fetch_add(&group->cursor, 1, __ATOMIC_RELAXED) % count;
+        for (int i = 0; i < count; i++) {
+            int index = (start + i) % count;
+            if ((skip & (1u << index)) || !available(group->replicas[index])) continue;
+            if (pick < 0 || load_of(group->replicas[index]) < load_of(group->replicas[pick])) pick = index;
+            if (group->policy == BALANCE_ROUND_ROBIN) break;
+        }
+    }
+
+    return pick;
 }
 
-// Chat (dispatches to appropriate backend)
-char* backend_chat(Backend *backend, const char *model, const char *message) {
-    if (!backend) return strdup("{\"error\":\"Backend not initialized\"}");
+// Pick a replica according to the group's policy
+Backend* backend_group_pick(BackendGroup *group, int *trial) {
+    *trial = 0;
+    if (!group || group->count == 0) return NULL;
+
+    unsigned int skip = 0;
+    for (int attempt = 0; attempt < group->count; attempt++) {
+        int index = select_replica(group, skip);
+        if (index < 0) return NULL;
+        Backend *pick = group->replicas[index];
+
+        // A half-open replica admits exactly one trial request; a worker that loses the
+        // race for it picks again among the other replicas instead of failing the request
+        if (__atomic_load_n(&pick->breaker, __ATOMIC_RELAXED) == BREAKER_HALF_OPEN) {
+            int idle = 0;
+            if (!__atomic_compare_exchange_n(&pick->trial, &idle, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                skip |= 1u << index;
+                continue;
+            }
+            *trial = 1;
+        }
 
-    if (backend->api_type == BACKEND_OLLAMA) {
-        // Use existing ollama_chat
-        extern char* ollama_chat(const char *model, const char *message);
-        return ollama_chat(model, message);
-    } else if (backend->api_type == BACKEND_OPENAI_COMPAT) {
-        return openai_chat(backend, model, message);
+        __atomic_add_fetch(&pick->outstanding, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&pick->requests, 1, __ATOMIC_RELAXED);
+        return pick;
     }
-
-    return strdup("{\"error\":\"Unknown backend type\"}");
+    return NULL;
 }
 
-// Simple port check (non-blocking)
-static int check_port_available(const char *host, int port) {
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) return 0;
+// Finish a request started by backend_group_pick()
+void backend_release(Backend *backend, int trial) {
+    if (backend) {
+        __atomic_sub_fetch(&backend->outstanding, 1, __ATOMIC_RELAXED);
+        if (trial) __atomic_store_n(&backend->trial, 0, __ATOMIC_RELEASE);
+    }
+}
 
-    struct sockaddr_in server;
-    server.sin_family = AF_INET;
-    server.sin_port = htons(port);
-    server.sin_addr.s_addr = inet_addr(host);
+static void breaker_set(Backend *backend, int state) {
+    int old = __atomic_exchange_n(&backend->breaker, state, __ATOMIC_ACQ_REL);
+    if (old != state) {
+        printf("[Backend] %s:%d circuit %s -> %s\n", backend->host, backend->port,
+               backend_breaker_name(old), backend_breaker_name(state));
+    }
+}
 
-    // Set timeout (1 second)
-    struct timeval timeout;
-    timeout.tv_sec = 1;
-    timeout.tv_usec = 0;
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+// Request outcome: a failed trial or too many consecutive failures open the breaker.
+// Requests dispatched before the breaker went half-open do not decide it.
+void backend_report(Backend *backend, int trial, int ok) {
+    if (!backend) return;
 
-    int result = connect(sock, (struct sockaddr*)&server, sizeof(server));
-    close(sock);
+    int state = __atomic_load_n(&backend->breaker, __ATOMIC_RELAXED);
+    if (ok) {
+        __atomic_store_n(&backend->failures, 0, __ATOMIC_RELAXED);
+        if (trial && state == BREAKER_HALF_OPEN) breaker_set(backend, BREAKER_CLOSED);
+        return;
+    }
 
-    return (result == 0) ? 1 : 0;
+    int failures = __atomic_add_fetch(&backend->failures, 1, __ATOMIC_RELAXED);
+    if ((trial && state == BREAKER_HALF_OPEN) ||
+        (state == BREAKER_CLOSED && failures >= BACKEND_FAILURE_THRESHOLD)) {
+        breaker_set(backend, BREAKER_OPEN);
+    }
 }
 
-// Auto-detect backend (try Ollama, vLLM, LM Studio)
-Backend* backend_autodetect(void) {
-    // Priority: Ollama > vLLM > LM Studio
-    const char *backends[][3] = {
-        {"ollama", "localhost", "11434"},
-        {"vllm", "localhost", "8000"},
-        {"lmstudio", "localhost", "1234"},
-        {NULL, NULL, NULL}
-    };
+// Health probe: a failed probe opens the breaker at once, a successful one
+// lets an open replica try a request again
+void backend_probe_result(Backend *backend, int ok) {
+    int state = __atomic_load_n(&backend->breaker, __ATOMIC_RELAXED);
+    if (!ok) {
+        if (state != BREAKER_OPEN) breaker_set(backend, BREAKER_OPEN);
+    } else if (state == BREAKER_OPEN) {
+        __atomic_store_n(&backend->failures, 0, __ATOMIC_RELAXED);
+        breaker_set(backend, BREAKER_HALF_OPEN);
+    }
+}
 
-    for (int i = 0; backends[i][0] != NULL; i++) {
-        const char *name = backends[i][0];
-        const char *host = backends[i][1];
-        int port = atoi(backends[i][2]);
+const char* backend_breaker_name(int state) {
+    switch (state) {
+        case BREAKER_OPEN:      return "open";
+        case BREAKER_HALF_OPEN: return "half-open";
+        default:                return "closed";
+    }
+}
 
-        if (check_port_available(host, port)) {
-            if (strcmp(name, "ollama") == 0) {
-                return backend_ollama_create(host, port);
-            } else {
-                return backend_openai_create(host, port);
-            }
-        }
+// Destroy the group and its replicas
+void backend_group_destroy(BackendGroup *group) {
+    if (!group) return;
+    for (int i = 0; i < group->count; i++) {
+        backend_destroy(group->replicas[i]);
     }
+    free(group);
+}
+
+// Policy names
+int backend_policy_parse(const char *name) {
+    if (strcmp(name, "rr") == 0 || strcmp(name, "round-robin") == 0) return BALANCE_ROUND_ROBIN;
+    if (strcmp(name, "least") == 0) return BALANCE_LEAST_OUTSTANDING;
+    if (strcmp(name, "p2c") == 0) return BALANCE_P2C;
+    return -1;
+}
 
-    // Fallback to Ollama (default)
-    return backend_ollama_create("localhost", 11434);
+const char* backend_policy_name(BalancePolicy policy) {
+    switch (policy) {
+        case BALANCE_ROUND_ROBIN: return "round-robin";
+        case BALANCE_P2C: return "p2c";
+        default: return "least-outstanding";
+    }
 }
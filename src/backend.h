@@ -3,53 +3,159 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include "arena.h"
 
 // Backend types
 #define BACKEND_OLLAMA 0
 #define BACKEND_OPENAI_COMPAT 1
 
-// Task 3: KV Cache for streaming (inspired by nanochat's engine.py)
-// Session context for caching KV pairs across tokens
-typedef struct {
-    char *session_id;
-    void *kv_cache;
-    uint32_t last_token_pos;
-    uint32_t cache_size;
+// Task 3: Sessions (inspired by nanochat's engine.py)
+// A session keeps the conversation history server-side, so clients only send the new turn
+#define SESSION_ID_MAX 64
+#define SESSION_BUCKETS 256
+#define SESSION_DEFAULT_IDLE_MS (30 * 60 * 1000)
+#define SESSION_MAX_HISTORY (64 * 1024)     // Oldest turns are dropped beyond this
+#define SESSION_MAX_CONTEXT (256 * 1024)    // Encoded context bytes kept per session
+
+typedef struct SessionContext {
+    char session_id[SESSION_ID_MAX];
+    char *history;              // Previous turns as JSON message objects, each followed by ','
+    size_t history_len;
+    size_t history_cap;
+    int turns;
+    unsigned char *context;     // Ollama generate context tokens as LEB128 varints
+    size_t context_len;
+    size_t context_cap;
+    int context_tokens;
+    char context_model[64];     // Context is only valid for the model that produced it
+    int refs;                   // Requests using the session (never evicted while > 0)
+    int deleted;                // Removed from the table; the last release frees it
+    long long last_used_ms;
+    struct SessionContext *hash_next;
+    struct SessionContext *lru_prev;    // LRU list: head = most recently used
+    struct SessionContext *lru_next;
 } SessionContext;
 
+typedef struct {
+    int sessions;
+    size_t bytes;
+    size_t budget;
+    int idle_ms;
+    unsigned long created;
+    unsigned long evicted;      // Dropped to stay within the budget
+    unsigned long expired;      // Dropped after idle_ms without use
+} SessionStats;
+
+// Circuit breaker per replica: open replicas receive no traffic, a half-open
+// replica gets a single trial request that decides whether it closes again
+typedef enum {
+    BREAKER_CLOSED,
+    BREAKER_OPEN,
+    BREAKER_HALF_OPEN
+} BreakerState;
+
+#define BACKEND_FAILURE_THRESHOLD 3     // Consecutive failed requests that open the breaker
+
 // Backend structure
 typedef struct {
     char name[32];
     char host[256];
     int port;
     int api_type;
-    void *priv;
+    void *priv;                     // UpstreamPool for host:port, resolved once at creation
+    volatile int outstanding;       // In-flight requests (updated atomically by all workers)
+    volatile unsigned long requests;
+    volatile int breaker;           // BreakerState (written by workers and the health checker)
+    volatile int failures;          // Consecutive failed requests
+    volatile int trial;             // Half-open: trial request in flight (owned by that request)
 } Backend;
 
-// Backend operations
+// Load balancing across replicas
+#define BACKEND_MAX_REPLICAS 16
+
+typedef enum {
+    BALANCE_ROUND_ROBIN,
+    BALANCE_LEAST_OUTSTANDING,      // Fewest in-flight requests (ties rotate)
+    BALANCE_P2C                     // Power of two choices: lower load of two random replicas
+} BalancePolicy;
+
 typedef struct {
-    char* (*generate)(Backend *backend, const char *model, const char *prompt);
-    char* (*generate_with_cache)(Backend *backend, const char *model, const char *prompt, SessionContext *ctx);
-    char* (*chat)(Backend *backend, const char *model, const char *message);
-    void (*destroy)(Backend *backend);
-    void (*session_free)(SessionContext *ctx);
-} BackendOps;
+    Backend *replicas[BACKEND_MAX_REPLICAS];
+    int count;
+    BalancePolicy policy;
+    volatile unsigned int cursor;   // Round-robin position / random sequence
+} BackendGroup;
 
 // Backend functions
 Backend* backend_ollama_create(const char *host, int port);
 Backend* backend_openai_create(const char *host, int port);
 void backend_destroy(Backend *backend);
 
-// API functions
-char* backend_generate(Backend *backend, const char *model, const char *prompt);
-char* backend_generate_cached(Backend *backend, const char *model, const char *prompt, SessionContext *ctx);
-char* backend_chat(Backend *backend, const char *model, const char *message);
+// Session management (Task 3): shared by all workers, LRU eviction under a byte budget
+void backend_session_configure(size_t budget, int idle_ms);
+
+// Find or create a session and take a reference; NULL if the id is invalid or memory is exhausted
+SessionContext* backend_session_acquire(const char *session_id);
+void backend_session_release(SessionContext *ctx);
+
+// Copy of the history into the arena (NULL when empty)
+char* backend_session_history(SessionContext *ctx, Arena *arena);
+
+// Record a completed turn (both strings already JSON-escaped)
+int backend_session_append(SessionContext *ctx, const char *user, const char *assistant);
 
-// Session management (Task 3)
-SessionContext* backend_session_create(const char *session_id);
-void backend_session_free(SessionContext *ctx);
+// Ollama generate context: replace the stored tokens / get them back as a JSON array
+// (NULL when empty or produced by a different model)
+int backend_session_set_context(SessionContext *ctx, const char *model, const uint32_t *tokens, size_t count);
+char* backend_session_context(SessionContext *ctx, Arena *arena, const char *model);
+
+// Drop a session (in-flight requests keep their reference), returns -1 if unknown
+int backend_session_delete(const char *session_id);
+
+void backend_session_stats(SessionStats *stats);
+void backend_session_cleanup(void);
+
+// Request building / reply parsing per API type (stream is only honoured by Ollama;
+// history holds earlier chat messages from backend_session_history, or for Ollama generate
+// the context array from backend_session_context, or NULL; options is the client's raw
+// "options" object or NULL: Ollama gets it as is, OpenAI-compatible servers its temperature)
+char* backend_build_request(const Backend *backend, Arena *arena, int chat, const char *model,
+                            const char *input, const char *history, const char *options, int stream,
+                            const char **path);
+char* backend_parse_reply(const Backend *backend, Arena *arena, int chat, const char *response);
+
+// Micro-batching (OpenAI-compatible /v1/completions): several prompts in one request,
+// the reply's choices[] are returned in prompt order (NULL where a choice is missing)
+char* backend_build_batch_request(Arena *arena, const char *model, const char **inputs, int count,
+                                  const char *options, const char **path);
+char** backend_parse_choices(Arena *arena, const char *response, int count);
 
 // Auto-detect backend
 Backend* backend_autodetect(void);
 
+// Backend groups
+BackendGroup* backend_group_create(BalancePolicy policy);
+int backend_group_add(BackendGroup *group, Backend *backend);
+
+// Add replicas from "host[:port],host[:port],..." ("[v6addr]:port" for IPv6), returns count added
+int backend_group_add_hosts(BackendGroup *group, int api_type, const char *list, int default_port);
+
+// Pick a replica and count it as in-flight until backend_release();
+// NULL if the group is empty or every breaker is open. *trial is set when the
+// request holds a half-open replica's trial slot and must be passed back below
+Backend* backend_group_pick(BackendGroup *group, int *trial);
+void backend_release(Backend *backend, int trial);
+
+// Circuit breaker inputs: request outcome and health probe result
+// (only the trial request's outcome moves a half-open breaker)
+void backend_report(Backend *backend, int trial, int ok);
+void backend_probe_result(Backend *backend, int ok);
+const char* backend_breaker_name(int state);
+
+void backend_group_destroy(BackendGroup *group);
+
+// Parse "rr", "least" or "p2c", returns -1 if unknown
+int backend_policy_parse(const char *name);
+const char* backend_policy_name(BalancePolicy policy);
+
 #endif
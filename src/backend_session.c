@@ -2,118 +2,353 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
+#include <pthread.h>
 
-// Task 3: KV Cache implementation (inspired by nanochat)
-// Simple malloc-based cache for desktop platforms
+// Task 3: Session store (inspired by nanochat)
+// Hash table from session_id to conversation history, shared by all workers.
+// Sessions are reference counted while a request uses them; idle sessions expire
+// and the least recently used ones are evicted when the byte budget is exceeded.
 
-// Cache entry for each token position
-typedef struct {
-    void *key;
-    void *value;
-} KVPair;
+#define USER_TURN_PREFIX "{\"role\":\"user\",\"content\":\""
 
-// Create a new session context
-SessionContext* backend_session_create(const char *session_id) {
-    SessionContext *ctx = (SessionContext*)malloc(sizeof(SessionContext));
-    if (!ctx) {
-        fprintf(stderr, "[Backend] Failed to allocate session context\n");
-        return NULL;
+static SessionContext *buckets[SESSION_BUCKETS];
+static SessionContext *lru_head = NULL;
+static SessionContext *lru_tail = NULL;
+static SessionStats stats = { .budget = 256 * 1024, .idle_ms = SESSION_DEFAULT_IDLE_MS };
+static pthread_mutex_t session_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static unsigned int bucket_of(const char *session_id) {
+    unsigned int hash = 2166136261u;
+    for (const char *p = session_id; *p; p++) {
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
     }
+    return hash % SESSION_BUCKETS;
+}
 
-    ctx->session_id = strdup(session_id);
-    ctx->kv_cache = NULL;
-    ctx->last_token_pos = 0;
-    ctx->cache_size = 0;
+static size_t session_size(const SessionContext *ctx) {
+    return sizeof(SessionContext) + ctx->history_cap + ctx->context_cap;
+}
+
+static void lru_unlink(SessionContext *ctx) {
+    if (ctx->lru_prev) ctx->lru_prev->lru_next = ctx->lru_next; else lru_head = ctx->lru_next;
+    if (ctx->lru_next) ctx->lru_next->lru_prev = ctx->lru_prev; else lru_tail = ctx->lru_prev;
+    ctx->lru_prev = ctx->lru_next = NULL;
+}
 
-    printf("[Backend] Created session: %s\n", session_id);
+static void lru_push_front(SessionContext *ctx) {
+    ctx->lru_prev = NULL;
+    ctx->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = ctx; else lru_tail = ctx;
+    lru_head = ctx;
+}
+
+// Remove from the table and free (caller holds the lock, refs == 0)
+static void session_destroy(SessionContext *ctx) {
+    SessionContext **link = &buckets[bucket_of(ctx->session_id)];
+    while (*link && *link != ctx) link = &(*link)->hash_next;
+    if (*link) *link = ctx->hash_next;
+
+    lru_unlink(ctx);
+    stats.bytes -= session_size(ctx);
+    stats.sessions--;
+    free(ctx->history);
+    free(ctx->context);
+    free(ctx);
+}
+
+// Expire idle sessions and evict from the LRU tail until within budget (pinned sessions are skipped)
+static void session_trim(void) {
+    long long now = now_ms();
+    SessionContext *ctx = lru_tail;
+
+    while (ctx) {
+        SessionContext *prev = ctx->lru_prev;
+        if (ctx->refs == 0) {
+            if (now - ctx->last_used_ms >= stats.idle_ms) {
+                session_destroy(ctx);
+                stats.expired++;
+            } else if (stats.bytes > stats.budget) {
+                session_destroy(ctx);
+                stats.evicted++;
+            } else {
+                break;      // Everything before this was used more recently
+            }
+        }
+        ctx = prev;
+    }
+}
+
+// Set the memory budget and idle expiry (call before serving requests)
+void backend_session_configure(size_t budget, int idle_ms) {
+    pthread_mutex_lock(&session_lock);
+    stats.budget = budget;
+    if (idle_ms > 0) stats.idle_ms = idle_ms;
+    pthread_mutex_unlock(&session_lock);
+}
+
+// Find or create a session
+SessionContext* backend_session_acquire(const char *session_id) {
+    size_t id_len = strlen(session_id);
+    if (id_len == 0 || id_len >= SESSION_ID_MAX) return NULL;
+
+    pthread_mutex_lock(&session_lock);
+    session_trim();
+
+    SessionContext *ctx = buckets[bucket_of(session_id)];
+    while (ctx && strcmp(ctx->session_id, session_id) != 0) {
+        ctx = ctx->hash_next;
+    }
+
+    if (!ctx && stats.budget >= sizeof(SessionContext)) {
+        ctx = calloc(1, sizeof(SessionContext));
+        if (ctx) {
+            memcpy(ctx->session_id, session_id, id_len + 1);
+            unsigned int bucket = bucket_of(session_id);
+            ctx->hash_next = buckets[bucket];
+            buckets[bucket] = ctx;
+            lru_push_front(ctx);
+            stats.bytes += session_size(ctx);
+            stats.sessions++;
+            stats.created++;
+        } else {
+            fprintf(stderr, "[Backend] Failed to allocate session context\n");
+        }
+    }
+
+    if (ctx) {
+        ctx->refs++;
+        ctx->last_used_ms = now_ms();
+        lru_unlink(ctx);
+        lru_push_front(ctx);
+    }
+    pthread_mutex_unlock(&session_lock);
 
     return ctx;
 }
 
-// Free session context
-void backend_session_free(SessionContext *ctx) {
+// Drop a reference taken by backend_session_acquire()
+void backend_session_release(SessionContext *ctx) {
     if (!ctx) return;
 
-    printf("[Backend] Freeing session: %s\n", ctx->session_id);
-
-    // Free cache entries
-    if (ctx->kv_cache) {
-        for (uint32_t i = 0; i < ctx->cache_size; i++) {
-            KVPair *kv = &((KVPair*)ctx->kv_cache)[i];
-            free(kv->key);
-            free(kv->value);
+    pthread_mutex_lock(&session_lock);
+    ctx->refs--;
+    if (ctx->deleted) {
+        // Deleted while in use: the last reference frees it
+        if (ctx->refs == 0) {
+            free(ctx->history);
+            free(ctx->context);
+            free(ctx);
         }
-        free(ctx->kv_cache);
+    } else {
+        ctx->last_used_ms = now_ms();
+        lru_unlink(ctx);
+        lru_push_front(ctx);
+        session_trim();
     }
+    pthread_mutex_unlock(&session_lock);
+}
 
-    // Free session ID
-    if (ctx->session_id) {
-        free(ctx->session_id);
+// Snapshot of the history (the session may change once the lock is released)
+char* backend_session_history(SessionContext *ctx, Arena *arena) {
+    char *copy = NULL;
+
+    pthread_mutex_lock(&session_lock);
+    if (ctx->history_len > 0) {
+        copy = arena_strndup(arena, ctx->history, ctx->history_len);
     }
+    pthread_mutex_unlock(&session_lock);
 
-    free(ctx);
+    return copy;
 }
 
-// Resize cache (internal function)
-static int session_cache_resize(SessionContext *ctx, uint32_t new_size) {
-    KVPair *new_cache = (KVPair*)realloc(ctx->kv_cache, sizeof(KVPair) * new_size);
-    if (!new_cache) {
-        fprintf(stderr, "[Backend] Failed to resize cache to %u entries\n", new_size);
-        return -1;
+// Drop the oldest turns until len more bytes fit under SESSION_MAX_HISTORY
+static void history_drop_oldest(SessionContext *ctx, size_t len) {
+    size_t prefix_len = strlen(USER_TURN_PREFIX);
+
+    while (ctx->history_len > 0 && ctx->history_len + len > SESSION_MAX_HISTORY) {
+        // The next turn starts at the next unescaped user message object
+        char *next = NULL;
+        char *p = ctx->history + 1;
+        char *end = ctx->history + ctx->history_len;
+        while (p + prefix_len <= end) {
+            p = memchr(p, '{', end - p);
+            if (!p || p + prefix_len > end) break;
+            if (p[-1] == ',' && memcmp(p, USER_TURN_PREFIX, prefix_len) == 0) {
+                next = p;
+                break;
+            }
+            p++;
+        }
+
+        if (!next) {
+            ctx->history_len = 0;
+            ctx->turns = 0;
+            break;
+        }
+        ctx->history_len = end - next;
+        memmove(ctx->history, next, ctx->history_len);
+        ctx->turns--;
     }
+}
+
+// Record a completed turn
+int backend_session_append(SessionContext *ctx, const char *user, const char *assistant) {
+    int needed = snprintf(NULL, 0,
+        USER_TURN_PREFIX "%s\"},{\"role\":\"assistant\",\"content\":\"%s\"},", user, assistant);
+    if (needed < 0 || (size_t)needed > SESSION_MAX_HISTORY) return -1;
 
-    ctx->kv_cache = new_cache;
-    ctx->cache_size = new_size;
+    pthread_mutex_lock(&session_lock);
+    history_drop_oldest(ctx, needed);
+
+    if (ctx->history_len + needed + 1 > ctx->history_cap) {
+        size_t cap = ctx->history_cap ? ctx->history_cap : 256;
+        while (cap < ctx->history_len + needed + 1) cap *= 2;
+
+        char *history = realloc(ctx->history, cap);
+        if (!history) {
+            pthread_mutex_unlock(&session_lock);
+            return -1;
+        }
+        // Deleted sessions are no longer accounted
+        if (!ctx->deleted) stats.bytes += cap - ctx->history_cap;
+        ctx->history = history;
+        ctx->history_cap = cap;
+    }
+
+    snprintf(ctx->history + ctx->history_len, needed + 1,
+        USER_TURN_PREFIX "%s\"},{\"role\":\"assistant\",\"content\":\"%s\"},", user, assistant);
+    ctx->history_len += needed;
+    ctx->turns++;
+    ctx->last_used_ms = now_ms();
+    pthread_mutex_unlock(&session_lock);
 
     return 0;
 }
 
-// Store KV pair in cache
-int backend_session_cache_kv(SessionContext *ctx, void *key, void *value) {
-    if (!ctx || !key || !value) {
-        return -1;
+// Store the context of the last generate call (tokens fit in 1-5 bytes each instead of ~6 as text)
+int backend_session_set_context(SessionContext *ctx, const char *model, const uint32_t *tokens, size_t count) {
+    if (strlen(model) >= sizeof(ctx->context_model)) return -1;
+
+    pthread_mutex_lock(&session_lock);
+    ctx->context_len = 0;
+    ctx->context_tokens = 0;
+    ctx->context_model[0] = '\0';
+
+    size_t needed = count * 5;
+    if (count == 0 || needed > SESSION_MAX_CONTEXT) {
+        pthread_mutex_unlock(&session_lock);
+        return (count == 0) ? 0 : -1;
     }
 
-    // Resize if needed (double size)
-    if (ctx->last_token_pos >= ctx->cache_size) {
-        uint32_t new_size = ctx->cache_size == 0 ? 64 : ctx->cache_size * 2;
-        if (session_cache_resize(ctx, new_size) < 0) {
+    if (needed > ctx->context_cap) {
+        unsigned char *context = realloc(ctx->context, needed);
+        if (!context) {
+            pthread_mutex_unlock(&session_lock);
             return -1;
         }
+        if (!ctx->deleted) stats.bytes += needed - ctx->context_cap;
+        ctx->context = context;
+        ctx->context_cap = needed;
     }
 
-    // Store KV pair
-    KVPair *kv = &((KVPair*)ctx->kv_cache)[ctx->last_token_pos];
-    kv->key = key;  // Caller owns memory
-    kv->value = value;
-
-    ctx->last_token_pos++;
+    unsigned char *out = ctx->context;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t value = tokens[i];
+        while (value >= 0x80) {
+            *out++ = (unsigned char)(value | 0x80);
+            value >>= 7;
+        }
+        *out++ = (unsigned char)value;
+    }
+    ctx->context_len = out - ctx->context;
+    ctx->context_tokens = (int)count;
+    strcpy(ctx->context_model, model);
+    ctx->last_used_ms = now_ms();
+    pthread_mutex_unlock(&session_lock);
 
     return 0;
 }
 
-// Get KV pair from cache
-void* backend_session_get_kv(SessionContext *ctx, uint32_t token_pos) {
-    if (!ctx || !ctx->kv_cache) {
-        return NULL;
-    }
+// Decode the stored context into a JSON array for the next generate request
+char* backend_session_context(SessionContext *ctx, Arena *arena, const char *model) {
+    char *json = NULL;
 
-    if (token_pos >= ctx->last_token_pos) {
-        return NULL;
+    pthread_mutex_lock(&session_lock);
+    if (ctx->context_tokens > 0 && strcmp(ctx->context_model, model) == 0) {
+        // At most 10 digits and a comma per token
+        json = arena_alloc(arena, (size_t)ctx->context_tokens * 11 + 3);
+    }
+    if (json) {
+        char *out = json;
+        *out++ = '[';
+        size_t pos = 0;
+        while (pos < ctx->context_len) {
+            uint32_t value = 0;
+            int shift = 0;
+            while (ctx->context[pos] & 0x80) {
+                value |= (uint32_t)(ctx->context[pos++] & 0x7F) << shift;
+                shift += 7;
+            }
+            value |= (uint32_t)ctx->context[pos++] << shift;
+            out += sprintf(out, "%s%u", out - json > 1 ? "," : "", value);
+        }
+        *out++ = ']';
+        *out = '\0';
     }
+    pthread_mutex_unlock(&session_lock);
 
-    KVPair *kv = &((KVPair*)ctx->kv_cache)[token_pos];
-    return kv->value;
+    return json;
 }
 
-// Get cache statistics
-void backend_session_stats(const SessionContext *ctx) {
+// Drop a session; requests still holding it keep a private copy until they release it
+int backend_session_delete(const char *session_id) {
+    pthread_mutex_lock(&session_lock);
+
+    SessionContext **link = &buckets[bucket_of(session_id)];
+    while (*link && strcmp((*link)->session_id, session_id) != 0) {
+        link = &(*link)->hash_next;
+    }
+    SessionContext *ctx = *link;
     if (!ctx) {
-        printf("[Backend] Session: NULL\n");
-        return;
+        pthread_mutex_unlock(&session_lock);
+        return -1;
     }
 
-    printf("[Backend] Session: %s\n", ctx->session_id);
-    printf("[Backend]   Cache entries: %u\n", ctx->last_token_pos);
-    printf("[Backend]   Cache capacity: %u\n", ctx->cache_size);
+    if (ctx->refs == 0) {
+        session_destroy(ctx);
+    } else {
+        // Unlink now, backend_session_release() frees it
+        *link = ctx->hash_next;
+        ctx->deleted = 1;
+        lru_unlink(ctx);
+        stats.bytes -= session_size(ctx);
+        stats.sessions--;
+    }
+    pthread_mutex_unlock(&session_lock);
+
+    return 0;
+}
+
+// Get store statistics
+void backend_session_stats(SessionStats *out) {
+    pthread_mutex_lock(&session_lock);
+    *out = stats;
+    pthread_mutex_unlock(&session_lock);
+}
+
+// Free all sessions (at shutdown, no requests in flight)
+void backend_session_cleanup(void) {
+    pthread_mutex_lock(&session_lock);
+    while (lru_head) {
+        lru_head->refs = 0;
+        session_destroy(lru_head);
+    }
+    pthread_mutex_unlock(&session_lock);
 }
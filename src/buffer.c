@@ -0,0 +1,217 @@
+#include "buffer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+// 全局缓冲池 (所有 worker 共享): 只接收线程本地池溢出的块
+static BufferChunk *pool_free = NULL;
+static int pool_idle = 0;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// 线程本地缓冲池: worker 读写上游/客户端时取还块不加锁
+static __thread BufferChunk *local_free = NULL;
+static __thread int local_idle = 0;
+
+// 归还到全局池 (超出空闲上限的部分释放)
+static void chunk_put_global(BufferChunk *chunk) {
+    BufferChunk *excess = NULL;
+
+    pthread_mutex_lock(&pool_lock);
+    while (chunk) {
+        BufferChunk *next = chunk->next;
+        if (pool_idle < BUFFER_POOL_MAX_IDLE) {
+            chunk->next = pool_free;
+            pool_free = chunk;
+            pool_idle++;
+        } else {
+            chunk->next = excess;
+            excess = chunk;
+        }
+        chunk = next;
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    while (excess) {
+        BufferChunk *next = excess->next;
+        free(excess);
+        excess = next;
+    }
+}
+
+// 从池中取块: 先取本线程的空闲块，用完后才访问全局池
+static BufferChunk* chunk_get(void) {
+    BufferChunk *chunk = local_free;
+    if (chunk) {
+        local_free = chunk->next;
+        local_idle--;
+    } else {
+        pthread_mutex_lock(&pool_lock);
+        chunk = pool_free;
+        if (chunk) {
+            pool_free = chunk->next;
+            pool_idle--;
+        }
+        pthread_mutex_unlock(&pool_lock);
+    }
+
+    if (!chunk) {
+        chunk = malloc(sizeof(BufferChunk));
+        if (!chunk) return NULL;
+    }
+    chunk->next = NULL;
+    chunk->len = 0;
+    return chunk;
+}
+
+// 归还一串块: 本线程池已满时剩余部分溢出到全局池
+static void chunk_put_list(BufferChunk *chunk) {
+    BufferChunk *overflow = NULL;
+
+    while (chunk) {
+        BufferChunk *next = chunk->next;
+        if (local_idle < BUFFER_LOCAL_MAX_IDLE) {
+            chunk->next = local_free;
+            local_free = chunk;
+            local_idle++;
+        } else {
+            chunk->next = overflow;
+            overflow = chunk;
+        }
+        chunk = next;
+    }
+
+    if (overflow) chunk_put_global(overflow);
+}
+
+// 初始化
+void buffer_chain_init(BufferChain *chain, size_t limit) {
+    chain->head = NULL;
+    chain->tail = NULL;
+    chain->len = 0;
+    chain->offset = 0;
+    chain->limit = limit;
+}
+
+// 尾部可写空间
+char* buffer_chain_reserve(BufferChain *chain, size_t *avail) {
+    if (chain->limit > 0 && chain->len >= chain->limit) return NULL;
+
+    BufferChunk *tail = chain->tail;
+    if (!tail || tail->len == BUFFER_CHUNK_SIZE) {
+        tail = chunk_get();
+        if (!tail) return NULL;
+        if (chain->tail) {
+            chain->tail->next = tail;
+        } else {
+            chain->head = tail;
+        }
+        chain->tail = tail;
+    }
+
+    size_t space = BUFFER_CHUNK_SIZE - tail->len;
+    if (chain->limit > 0 && space > chain->limit - chain->len) {
+        space = chain->limit - chain->len;
+    }
+    *avail = space;
+    return tail->data + tail->len;
+}
+
+// 确认写入
+void buffer_chain_commit(BufferChain *chain, size_t len) {
+    chain->tail->len += len;
+    chain->len += len;
+}
+
+// 追加
+int buffer_chain_append(BufferChain *chain, const void *data, size_t len) {
+    const char *src = data;
+    while (len > 0) {
+        size_t avail;
+        char *dst = buffer_chain_reserve(chain, &avail);
+        if (!dst) return -1;
+
+        size_t n = (len < avail) ? len : avail;
+        memcpy(dst, src, n);
+        buffer_chain_commit(chain, n);
+        src += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// 连续内容
+char* buffer_chain_str(BufferChain *chain, Arena *arena) {
+    BufferChunk *head = chain->head;
+    if (!head) return arena_strdup(arena, "");
+
+    // 单块且有空间放 \0: 原地返回
+    if (!head->next && head->len < BUFFER_CHUNK_SIZE) {
+        head->data[head->len] = '\0';
+        return head->data + chain->offset;
+    }
+
+    char *str = arena_alloc(arena, chain->len + 1);
+    if (!str) return NULL;
+
+    size_t off = 0;
+    size_t skip = chain->offset;
+    for (BufferChunk *chunk = head; chunk; chunk = chunk->next) {
+        memcpy(str + off, chunk->data + skip, chunk->len - skip);
+        off += chunk->len - skip;
+        skip = 0;
+    }
+    str[off] = '\0';
+    return str;
+}
+
+// 从头部消费
+void buffer_chain_consume(BufferChain *chain, size_t len) {
+    chain->len -= len;
+    len += chain->offset;
+
+    // 整块消费完的归还 (尾块也归还，下次写入时重新取块)
+    BufferChunk *done = NULL;
+    while (chain->head && len >= chain->head->len) {
+        BufferChunk *head = chain->head;
+        len -= head->len;
+        chain->head = head->next;
+        head->next = done;
+        done = head;
+    }
+    if (!chain->head) chain->tail = NULL;
+    chain->offset = chain->head ? len : 0;
+    if (done) chunk_put_list(done);
+}
+
+// 归还所有块
+void buffer_chain_release(BufferChain *chain) {
+    chunk_put_list(chain->head);
+    chain->head = NULL;
+    chain->tail = NULL;
+    chain->len = 0;
+    chain->offset = 0;
+}
+
+// 线程退出前把本地空闲块交给全局池
+void buffer_pool_thread_exit(void) {
+    chunk_put_global(local_free);
+    local_free = NULL;
+    local_idle = 0;
+}
+
+// 释放池中的空闲块 (含调用线程的本地池)
+void buffer_pool_cleanup(void) {
+    buffer_pool_thread_exit();
+
+    pthread_mutex_lock(&pool_lock);
+    BufferChunk *chunk = pool_free;
+    pool_free = NULL;
+    pool_idle = 0;
+    pthread_mutex_unlock(&pool_lock);
+
+    while (chunk) {
+        BufferChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stddef.h>
+#include "arena.h"
+
+// 链式缓冲区: 上游响应按需追加固定大小的块，内存随实际长度增长而不是按最坏情况预留。
+// 块来自线程本地缓冲池 (不加锁)，本地池满后溢出到全局池，超过空闲上限的块直接 free。
+
+#define BUFFER_CHUNK_SIZE 4096
+#define BUFFER_LOCAL_MAX_IDLE 32    // 每个线程最多保留的空闲块 (128KB)
+#define BUFFER_POOL_MAX_IDLE 64     // 全局池最多保留的空闲块 (256KB)
+
+typedef struct BufferChunk {
+    struct BufferChunk *next;
+    size_t len;
+    char data[BUFFER_CHUNK_SIZE];
+} BufferChunk;
+
+typedef struct {
+    BufferChunk *head;
+    BufferChunk *tail;
+    size_t len;             // 总字节数 (不含已消费的部分)
+    size_t offset;          // 头块中已消费的字节数
+    size_t limit;           // 总长度上限 (0 = 不限)
+} BufferChain;
+
+// 初始化 (不分配内存)
+void buffer_chain_init(BufferChain *chain, size_t limit);
+
+// 尾部可写空间 (必要时从池中取新块)，avail 返回可写字节数
+// 达到上限或内存不足时返回 NULL
+char* buffer_chain_reserve(BufferChain *chain, size_t *avail);
+
+// 确认写入了 len 字节 (不超过 reserve 返回的 avail)
+void buffer_chain_commit(BufferChain *chain, size_t len);
+
+// 追加数据，返回 -1 表示超过上限或内存不足
+int buffer_chain_append(BufferChain *chain, const void *data, size_t len);
+
+// 以 \0 结尾的连续内容: 只有一个块时原地返回 (不复制，随 chain 释放)，
+// 跨多个块时复制到 arena
+char* buffer_chain_str(BufferChain *chain, Arena *arena);
+
+// 从头部消费 len 字节 (如已发送)，用完的块归还到池中
+void buffer_chain_consume(BufferChain *chain, size_t len);
+
+// 归还所有块
+void buffer_chain_release(BufferChain *chain);
+
+// 线程退出前调用: 本地空闲块交给全局池
+void buffer_pool_thread_exit(void);
+
+// 释放池中的空闲块 (含调用线程的本地池)
+void buffer_pool_cleanup(void);
+
+#endif
@@ -0,0 +1,196 @@
+#include "cache.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+typedef struct CacheEntry {
+    unsigned long long hash;
+    size_t key_len;
+    size_t value_len;
+    long long expires_ms;
+    struct CacheEntry *prev;    // LRU: 头部最近使用
+    struct CacheEntry *next;
+    char data[];                // key + value + \0
+} CacheEntry;
+
+static CacheEntry **slots = NULL;   // 开放寻址索引 (容量为 2 的幂)
+static size_t slot_mask = 0;
+static int max_entries = 0;         // 负载因子上限 3/4
+static CacheEntry *lru_head = NULL;
+static CacheEntry *lru_tail = NULL;
+static CacheStats stats;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// 单调时钟 (毫秒)
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static size_t entry_size(const CacheEntry *entry) {
+    return sizeof(CacheEntry) + entry->key_len + entry->value_len + 1;
+}
+
+// 初始化: 索引按预算能容纳的条目数分配
+int cache_init(size_t budget, int ttl_ms) {
+    cache_cleanup();
+    memset(&stats, 0, sizeof(stats));
+    stats.ttl_ms = (ttl_ms > 0) ? ttl_ms : CACHE_DEFAULT_TTL_MS;
+    if (budget == 0) return 0;
+
+    size_t capacity = 16;
+    while (capacity * 3 / 4 < budget / CACHE_MIN_ENTRY_BYTES) capacity *= 2;
+
+    slots = calloc(capacity, sizeof(CacheEntry*));
+    if (!slots) return -1;
+    slot_mask = capacity - 1;
+    max_entries = (int)(capacity * 3 / 4);
+    stats.budget = budget;
+    return 0;
+}
+
+int cache_enabled(void) {
+    return slots != NULL;
+}
+
+static void lru_unlink(CacheEntry *entry) {
+    if (entry->prev) entry->prev->next = entry->next; else lru_head = entry->next;
+    if (entry->next) entry->next->prev = entry->prev; else lru_tail = entry->prev;
+    entry->prev = entry->next = NULL;
+}
+
+static void lru_push_front(CacheEntry *entry) {
+    entry->prev = NULL;
+    entry->next = lru_head;
+    if (lru_head) lru_head->prev = entry; else lru_tail = entry;
+    lru_head = entry;
+}
+
+// 查找槽位: 返回命中的槽位或 -1
+static long find_slot(const char *key, size_t key_len, unsigned long long hash) {
+    for (size_t i = hash & slot_mask; slots[i]; i = (i + 1) & slot_mask) {
+        CacheEntry *entry = slots[i];
+        if (entry->hash == hash && entry->key_len == key_len &&
+            memcmp(entry->data, key, key_len) == 0) {
+            return (long)i;
+        }
+    }
+    return -1;
+}
+
+// 删除槽位: 后续探测链上的条目前移，保持链连续 (不使用墓碑)
+static void remove_slot(size_t i) {
+    CacheEntry *entry = slots[i];
+    slots[i] = NULL;
+
+    size_t j = i;
+    while (1) {
+        j = (j + 1) & slot_mask;
+        if (!slots[j]) break;
+        size_t home = slots[j]->hash & slot_mask;
+        // home 不在 (i, j] 区间内时，条目可以移到空出的 i
+        if ((j > i && (home <= i || home > j)) || (j < i && home <= i && home > j)) {
+            slots[i] = slots[j];
+            slots[j] = NULL;
+            i = j;
+        }
+    }
+
+    lru_unlink(entry);
+    stats.bytes -= entry_size(entry);
+    stats.entries--;
+    free(entry);
+}
+
+static void remove_entry(CacheEntry *entry) {
+    long i = find_slot(entry->data, entry->key_len, entry->hash);
+    if (i >= 0) remove_slot((size_t)i);
+}
+
+char* cache_get(const char *key, size_t key_len, unsigned long long hash, Arena *arena) {
+    char *copy = NULL;
+
+    pthread_mutex_lock(&cache_lock);
+    if (!slots) {
+        pthread_mutex_unlock(&cache_lock);
+        return NULL;
+    }
+
+    long i = find_slot(key, key_len, hash);
+    if (i >= 0 && slots[i]->expires_ms <= now_ms()) {
+        remove_slot((size_t)i);
+        i = -1;
+    }
+
+    if (i >= 0) {
+        CacheEntry *entry = slots[i];
+        lru_unlink(entry);
+        lru_push_front(entry);
+        copy = arena_strndup(arena, entry->data + entry->key_len, entry->value_len);
+    }
+    if (copy) stats.hits++; else stats.misses++;
+    pthread_mutex_unlock(&cache_lock);
+
+    return copy;
+}
+
+void cache_put(const char *key, size_t key_len, unsigned long long hash, const char *value) {
+    size_t value_len = strlen(value);
+    size_t size = sizeof(CacheEntry) + key_len + value_len + 1;
+    if (!slots || size > stats.budget / CACHE_MAX_ENTRY_SHARE) return;
+
+    CacheEntry *entry = malloc(size);
+    if (!entry) return;
+    entry->hash = hash;
+    entry->key_len = key_len;
+    entry->value_len = value_len;
+    memcpy(entry->data, key, key_len);
+    memcpy(entry->data + key_len, value, value_len + 1);
+
+    pthread_mutex_lock(&cache_lock);
+    entry->expires_ms = now_ms() + stats.ttl_ms;
+
+    long i = find_slot(key, key_len, hash);
+    if (i >= 0) remove_slot((size_t)i);
+
+    // 超出预算或索引负载上限: 从 LRU 尾部淘汰
+    while (lru_tail && (stats.bytes + size > stats.budget || stats.entries >= max_entries)) {
+        remove_entry(lru_tail);
+        stats.evictions++;
+    }
+
+    size_t slot = hash & slot_mask;
+    while (slots[slot]) slot = (slot + 1) & slot_mask;
+    slots[slot] = entry;
+    lru_push_front(entry);
+    stats.bytes += size;
+    stats.entries++;
+    stats.inserts++;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void cache_stats(CacheStats *out) {
+    pthread_mutex_lock(&cache_lock);
+    *out = stats;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+// 释放所有条目和索引
+void cache_cleanup(void) {
+    pthread_mutex_lock(&cache_lock);
+    while (lru_head) {
+        CacheEntry *next = lru_head->next;
+        free(lru_head);
+        lru_head = next;
+    }
+    lru_tail = NULL;
+    free(slots);
+    slots = NULL;
+    slot_mask = 0;
+    max_entries = 0;
+    stats.bytes = 0;
+    stats.entries = 0;
+    pthread_mutex_unlock(&cache_lock);
+}
@@ -0,0 +1,41 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include "arena.h"
+
+// 响应缓存: 相同的确定性请求直接返回上次的回复，不再调用后端。
+// 开放寻址哈希索引 (线性探测，删除时后移，无墓碑) + LRU 链表，
+// 按字节预算淘汰最久未使用的条目，条目过期 (TTL) 后视为未命中。
+// 所有 worker 共享，一把互斥锁保护。
+
+#define CACHE_DEFAULT_TTL_MS (5 * 60 * 1000)
+#define CACHE_MIN_ENTRY_BYTES 256   // 估算索引容量用的平均条目大小
+#define CACHE_MAX_ENTRY_SHARE 4     // 单个条目不超过预算的 1/4
+
+typedef struct {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long inserts;
+    unsigned long evictions;
+    size_t bytes;           // 条目占用 (含条目头)
+    size_t budget;
+    int entries;
+    int ttl_ms;
+} CacheStats;
+
+// 初始化，budget = 0 时关闭缓存 (所有查找都未命中且不计数)
+int cache_init(size_t budget, int ttl_ms);
+void cache_cleanup(void);
+
+int cache_enabled(void);
+
+// 查找: 命中时回复复制到 arena 中返回，未命中 / 已过期返回 NULL
+char* cache_get(const char *key, size_t key_len, unsigned long long hash, Arena *arena);
+
+// 插入或替换 (超出单条上限的回复不缓存)
+void cache_put(const char *key, size_t key_len, unsigned long long hash, const char *value);
+
+void cache_stats(CacheStats *stats);
+
+#endif
@@ -0,0 +1,223 @@
+#include "health.h"
+#include "resolver.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+typedef enum {
+    PROBE_DONE,
+    PROBE_CONNECTING,
+    PROBE_READING
+} ProbeState;
+
+static int interval_ms = HEALTH_DEFAULT_INTERVAL_MS;
+
+// Checker thread
+static pthread_t health_thread;
+static int health_running = 0;
+static BackendGroup *health_group = NULL;
+static pthread_mutex_t health_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t health_cond = PTHREAD_COND_INITIALIZER;
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void health_set_interval(int interval) {
+    if (interval > 0) interval_ms = interval;
+}
+
+const char* health_probe_path(int api_type) {
+    return (api_type == BACKEND_OLLAMA) ? "/" : "/v1/models";
+}
+
+// Start a non-blocking connect, returns the socket or -1
+static int probe_connect(const HealthProbe *probe) {
+    ResolverAddr addr;
+    if (resolver_lookup(probe->host, probe->port, &addr, 1) < 1) return -1;
+
+    int fd = socket(addr.addr.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    if (connect(fd, (struct sockaddr*)&addr.addr, addr.len) < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Connected: send the GET (small enough for one send), returns 0 or -1
+static int probe_send(const HealthProbe *probe, int fd) {
+    char request[512];
+    int len = snprintf(request, sizeof(request),
+                       "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n",
+                       probe->path, probe->host);
+    if (len < 0 || len >= (int)sizeof(request)) return -1;
+    return (send(fd, request, len, MSG_NOSIGNAL) == len) ? 0 : -1;
+}
+
+int health_probe_run(HealthProbe *probes, int count, int timeout_ms) {
+    int fds[BACKEND_MAX_REPLICAS];
+    ProbeState states[BACKEND_MAX_REPLICAS];
+    char status[BACKEND_MAX_REPLICAS][16];
+    int status_len[BACKEND_MAX_REPLICAS];
+    int pending = 0;
+
+    if (count > BACKEND_MAX_REPLICAS) count = BACKEND_MAX_REPLICAS;
+
+    for (int i = 0; i < count; i++) {
+        probes[i].ok = 0;
+        status_len[i] = 0;
+        fds[i] = probe_connect(&probes[i]);
+        states[i] = (fds[i] >= 0) ? PROBE_CONNECTING : PROBE_DONE;
+        if (fds[i] >= 0) pending++;
+    }
+
+    long long deadline = now_ms() + timeout_ms;
+    while (pending > 0) {
+        struct pollfd pfds[BACKEND_MAX_REPLICAS];
+        int index[BACKEND_MAX_REPLICAS];
+        int n = 0;
+        for (int i = 0; i < count; i++) {
+            if (states[i] == PROBE_DONE) continue;
+            pfds[n].fd = fds[i];
+            pfds[n].events = (states[i] == PROBE_CONNECTING) ? POLLOUT : POLLIN;
+            pfds[n].revents = 0;
+            index[n++] = i;
+        }
+
+        int wait = (int)(deadline - now_ms());
+        if (wait <= 0 || poll(pfds, n, wait) <= 0) break;
+
+        for (int k = 0; k < n; k++) {
+            if (!pfds[k].revents) continue;
+            int i = index[k];
+            int done = 1;
+
+            if (states[i] == PROBE_CONNECTING) {
+                int err = 0;
+                socklen_t err_len = sizeof(err);
+                getsockopt(fds[i], SOL_SOCKET, SO_ERROR, &err, &err_len);
+                if (err != 0) {
+                    // Connection refused: done, not healthy
+                } else if (!probes[i].path) {
+                    probes[i].ok = 1;
+                } else if (probe_send(&probes[i], fds[i]) == 0) {
+                    states[i] = PROBE_READING;
+                    done = 0;
+                }
+            } else {
+                // Only the status line matters: "HTTP/1.x 2xx"
+                ssize_t r = recv(fds[i], status[i] + status_len[i],
+                                 sizeof(status[i]) - 1 - status_len[i], 0);
+                if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    done = 0;
+                } else if (r > 0) {
+                    status_len[i] += r;
+                    if (status_len[i] < 12) {
+                        done = 0;
+                    } else {
+                        probes[i].ok = strncmp(status[i], "HTTP/1.", 7) == 0 && status[i][9] == '2';
+                    }
+                }
+            }
+
+            if (done) {
+                close(fds[i]);
+                states[i] = PROBE_DONE;
+                pending--;
+            }
+        }
+    }
+
+    // Timed out
+    int healthy = 0;
+    for (int i = 0; i < count; i++) {
+        if (states[i] != PROBE_DONE) close(fds[i]);
+        healthy += probes[i].ok;
+    }
+    return healthy;
+}
+
+// Probe every replica of the group once
+static void check_group(BackendGroup *group) {
+    HealthProbe probes[BACKEND_MAX_REPLICAS];
+
+    for (int i = 0; i < group->count; i++) {
+        Backend *replica = group->replicas[i];
+        probes[i].host = replica->host;
+        probes[i].port = replica->port;
+        probes[i].path = health_probe_path(replica->api_type);
+    }
+
+    health_probe_run(probes, group->count, HEALTH_PROBE_TIMEOUT_MS);
+
+    for (int i = 0; i < group->count; i++) {
+        backend_probe_result(group->replicas[i], probes[i].ok);
+    }
+}
+
+static void* health_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&health_lock);
+    while (health_running) {
+        pthread_mutex_unlock(&health_lock);
+        check_group(health_group);
+        pthread_mutex_lock(&health_lock);
+        if (!health_running) break;
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += interval_ms / 1000;
+        deadline.tv_nsec += (interval_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&health_cond, &health_lock, &deadline);
+    }
+    pthread_mutex_unlock(&health_lock);
+    return NULL;
+}
+
+// Start the checker thread
+int health_start(BackendGroup *group) {
+    pthread_mutex_lock(&health_lock);
+    if (health_running) {
+        pthread_mutex_unlock(&health_lock);
+        return 0;
+    }
+    health_group = group;
+    health_running = 1;
+    pthread_mutex_unlock(&health_lock);
+
+    if (pthread_create(&health_thread, NULL, health_main, NULL) != 0) {
+        perror("pthread_create failed");
+        health_running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+// Stop the checker thread
+void health_stop(void) {
+    pthread_mutex_lock(&health_lock);
+    if (!health_running) {
+        pthread_mutex_unlock(&health_lock);
+        return;
+    }
+    health_running = 0;
+    pthread_cond_signal(&health_cond);
+    pthread_mutex_unlock(&health_lock);
+
+    pthread_join(health_thread, NULL);
+}
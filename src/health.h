@@ -0,0 +1,30 @@
+#ifndef HEALTH_H
+#define HEALTH_H
+
+#include "backend.h"
+
+// Background health checking: every interval all replicas are probed in parallel
+// with non-blocking sockets and the results drive each replica's circuit breaker
+#define HEALTH_DEFAULT_INTERVAL_MS 2000
+#define HEALTH_PROBE_TIMEOUT_MS 1000    // Upper bound for one probe round
+
+typedef struct {
+    const char *host;
+    int port;
+    const char *path;       // GET path, NULL = TCP connect only
+    int ok;                 // Result: 1 = connected (and answered 2xx)
+} HealthProbe;
+
+// Run all probes concurrently for at most timeout_ms, returns the number that succeeded
+int health_probe_run(HealthProbe *probes, int count, int timeout_ms);
+
+// Cheap endpoint answered by each API type
+const char* health_probe_path(int api_type);
+
+void health_set_interval(int interval_ms);
+
+// Start / stop the checker thread (the first round runs immediately)
+int health_start(BackendGroup *group);
+void health_stop(void);
+
+#endif
@@ -1,214 +1,2070 @@
 #include "http.h"
+#include "cache.h"
+#include "ratelimit.h"
+#include "json.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/epoll.h>
 #include <arpa/inet.h>
 #include "ollama.h"
+#include "sensor.h"
+#include "actuator.h"
+#include "rule.h"
 
-// Task 3: Request Queue (extern from main.c)
-extern volatile int active_requests;
-#define MAX_CONCURRENT_REQUESTS 10
+#define HTTP_QUEUE_POLL_MS 10   // 有请求排队时的 epoll 超时
 
-// External Ollama client
-extern char* ollama_generate(const char *model, const char *prompt);
-extern char* ollama_chat(const char *model, const char *message);
-extern int ollama_generate_stream(const char *model, const char *prompt, int client_fd);
+// 逐连接日志: 多 worker 下 stdout 的内部锁是共享锁，默认不编译进请求路径
+#ifdef HTTP_TRACE_CONNECTIONS
+#define HTTP_TRACE(...) printf(__VA_ARGS__)
+#else
+#define HTTP_TRACE(...) ((void)0)
+#endif
 
-// 创建 HTTP 响应
-static void create_response(HttpContext *ctx, int status_code, const char *content_type, const char *body) {
-    char header[512];
-    int header_len = snprintf(header, sizeof(header),
-        "HTTP/1.1 %d OK\r\n"
+// 连接定时器标记
+#define HTTP_TIMER_TAG_PHASE   0
+#define HTTP_TIMER_TAG_REQUEST 1
+
+// 单调时钟 (毫秒)
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 输出队列: 追加缓冲区
+int http_out_push(HttpContext *ctx, const void *data, size_t len, int owned) {
+    HttpOutQueue *q = &ctx->out;
+
+    if (q->count == HTTP_MAX_IOV && q->head > 0) {
+        // 压缩已发送的槽位
+        int pending = q->count - q->head;
+        memmove(q->iov, q->iov + q->head, pending * sizeof(struct iovec));
+        memmove(q->owned, q->owned + q->head, pending * sizeof(void*));
+        q->head = 0;
+        q->count = pending;
+    }
+
+    if (q->count == HTTP_MAX_IOV) {
+        if (owned) free((void*)data);
+        return -1;
+    }
+
+    q->iov[q->count].iov_base = (void*)data;
+    q->iov[q->count].iov_len = len;
+    q->owned[q->count] = owned ? (void*)data : NULL;
+    q->count++;
+    return 0;
+}
+
+// 输出队列: writev 发送，短写时推进 iovec 并在 EAGAIN 处停下
+int http_out_flush(HttpContext *ctx) {
+    HttpOutQueue *q = &ctx->out;
+
+    while (q->head < q->count) {
+        ssize_t sent = writev(ctx->client_fd, q->iov + q->head, q->count - q->head);
+
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+
+        // 跳过已完整发送的 iovec
+        while (q->head < q->count && (size_t)sent >= q->iov[q->head].iov_len) {
+            sent -= q->iov[q->head].iov_len;
+            free(q->owned[q->head]);
+            q->owned[q->head] = NULL;
+            q->head++;
+        }
+
+        // 部分发送的 iovec
+        if (sent > 0) {
+            q->iov[q->head].iov_base = (char*)q->iov[q->head].iov_base + sent;
+            q->iov[q->head].iov_len -= sent;
+        }
+    }
+
+    q->head = 0;
+    q->count = 0;
+
+    // 流式帧: 每次 writev 最多 HTTP_MAX_IOV 个块，已发送的块归还缓冲池
+    while (q->stream.len > 0) {
+        struct iovec iov[HTTP_MAX_IOV];
+        int count = 0;
+        size_t skip = q->stream.offset;
+        for (BufferChunk *chunk = q->stream.head; chunk && count < HTTP_MAX_IOV; chunk = chunk->next) {
+            iov[count].iov_base = chunk->data + skip;
+            iov[count++].iov_len = chunk->len - skip;
+            skip = 0;
+        }
+
+        ssize_t sent = writev(ctx->client_fd, iov, count);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+        buffer_chain_consume(&q->stream, sent);
+    }
+    return 1;
+}
+
+// 输出队列: 丢弃并释放
+void http_out_reset(HttpContext *ctx) {
+    HttpOutQueue *q = &ctx->out;
+    for (int i = q->head; i < q->count; i++) {
+        free(q->owned[i]);
+        q->owned[i] = NULL;
+    }
+    q->head = 0;
+    q->count = 0;
+    buffer_chain_release(&q->stream);
+}
+
+// 状态码对应的原因短语
+static const char* status_text(int code) {
+    switch (code) {
+        case 200: return "OK";
+        case 201: return "Created";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 408: return "Request Timeout";
+        case 413: return "Payload Too Large";
+        case 429: return "Too Many Requests";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
+        case 507: return "Insufficient Storage";
+        default:  return "Error";
+    }
+}
+
+// 创建 HTTP 响应: 头部写入 ctx->header，body 不复制直接入队
+// owned = 1 时 body 由输出队列在发送后释放
+// extra_headers: 附加的头部行 (每行以 \r\n 结尾)
+static void queue_response_headers(HttpContext *ctx, int status_code, const char *content_type,
+                                   const char *extra_headers, const char *body, int owned) {
+    size_t body_len = strlen(body);
+    int header_len = snprintf(ctx->header, sizeof(ctx->header),
+        "HTTP/1.1 %d %s\r\n"
         "Content-Type: %s\r\n"
         "Content-Length: %zu\r\n"
-        "Connection: close\r\n"
+        "Connection: %s\r\n"
+        "%s"
         "\r\n",
-        status_code, content_type, strlen(body)
+        status_code, status_text(status_code), content_type, body_len,
+        ctx->keep_alive ? "keep-alive" : "close", extra_headers
     );
 
-    memcpy(ctx->response, header, header_len);
-    memcpy(ctx->response + header_len, body, strlen(body));
-    ctx->response_len = header_len + strlen(body);
+    http_out_push(ctx, ctx->header, header_len, 0);
+    http_out_push(ctx, body, body_len, owned);
+}
+
+static void queue_response(HttpContext *ctx, int status_code, const char *content_type,
+                           const char *body, int owned) {
+    queue_response_headers(ctx, status_code, content_type, "", body, owned);
+}
+
+// 创建 HTTP 响应 (静态 body)
+static void create_response(HttpContext *ctx, int status_code, const char *content_type, const char *body) {
+    queue_response(ctx, status_code, content_type, body, 0);
+}
+
+// 请求缓冲区扩容: 超出内联缓冲区后转移到堆上 (大 prompt)
+static int grow_request_buffer(HttpContext *ctx) {
+    int limit = HTTP_MAX_HEADER_BYTES + HTTP_MAX_BODY + 1;
+    if (ctx->request_cap >= limit) return -1;
+
+    int new_cap = ctx->request_cap * 2;
+    if (new_cap > limit) new_cap = limit;
+
+    char *buf;
+    if (ctx->request == ctx->request_inline) {
+        buf = malloc(new_cap);
+        if (buf) memcpy(buf, ctx->request, ctx->request_len + 1);
+    } else {
+        buf = realloc(ctx->request, new_cap);
+    }
+    if (!buf) return -1;
+
+    ctx->request = buf;
+    ctx->request_cap = new_cap;
+    return 0;
+}
+
+// 释放溢出到堆上的请求缓冲区
+static void release_request_buffer(HttpContext *ctx) {
+    if (ctx->request != ctx->request_inline) {
+        free(ctx->request);
+    }
+    ctx->request = ctx->request_inline;
+    ctx->request_cap = HTTP_MAX_REQUEST;
+}
+
+// 解析错误对应的响应
+static void respond_parse_error(HttpContext *ctx) {
+    ctx->keep_alive = 0;
+    switch (ctx->parser.error) {
+        case HTTP_PARSE_HEADERS_TOO_LARGE:
+            create_response(ctx, 431, "application/json", "{\"error\":\"Request headers too large\"}");
+            break;
+        case HTTP_PARSE_BODY_TOO_LARGE:
+            create_response(ctx, 413, "application/json", "{\"error\":\"Request too large\"}");
+            break;
+        default:
+            create_response(ctx, 400, "application/json", "{\"error\":\"Bad request\"}");
+            break;
+    }
+}
+
+// 启动连接阶段定时器
+static void arm_phase_timer(HttpContext *ctx, HttpTimerPhase phase, int timeout_ms) {
+    ctx->timer_phase = phase;
+    timer_arm(&ctx->server->timers, &ctx->phase_timer, now_ms() + timeout_ms);
+}
+
+// 新请求开始到达: 启动请求头和整个请求的截止时间
+static void start_request_timers(HttpContext *ctx) {
+    HttpServer *server = ctx->server;
+    ctx->request_start_ms = now_ms();
+    arm_phase_timer(ctx, HTTP_TIMER_HEADER, server->header_timeout_ms);
+    timer_arm(&server->timers, &ctx->request_timer, ctx->request_start_ms + server->timeout_ms);
+}
+
+// FSM: 读取请求 (边缘触发: 一直读到 EAGAIN)
+void http_handle_reading(HttpContext *ctx) {
+    while (1) {
+        if (ctx->timer_phase == HTTP_TIMER_IDLE && ctx->request_len > 0) {
+            start_request_timers(ctx);
+        }
+
+        // 增量解析: 只扫描上次之后新到达的字节
+        int parsed = http_parser_execute(&ctx->parser, ctx->request, ctx->request_len);
+        if (parsed > 0) {
+            ctx->keep_alive = ctx->parser.keep_alive &&
+                              ctx->requests_served + 1 < HTTP_KEEPALIVE_MAX_REQUESTS;
+            timer_cancel(&ctx->server->timers, &ctx->phase_timer);
+            ctx->admitted = 0;
+            ctx->state = HTTP_STATE_PROCESSING;
+            return;
+        }
+        if (parsed < 0) {
+            timer_cancel(&ctx->server->timers, &ctx->phase_timer);
+            respond_parse_error(ctx);
+            ctx->state = HTTP_STATE_RESPONDING;
+            return;
+        }
+
+        // 请求头已读完: 切换到 body 截止时间
+        if (ctx->timer_phase == HTTP_TIMER_HEADER && ctx->parser.header_len > 0) {
+            arm_phase_timer(ctx, HTTP_TIMER_BODY, ctx->server->body_timeout_ms);
+        }
+
+        // 客户端在发送 body 前等待 100 Continue (经输出队列发送，短写时剩余部分随后续事件发出)
+        if (ctx->parser.expect_continue && ctx->parser.header_len > 0 && !ctx->continue_sent) {
+            static const char continue_line[] = "HTTP/1.1 100 Continue\r\n\r\n";
+            http_out_push(ctx, continue_line, sizeof(continue_line) - 1, 0);
+            ctx->continue_sent = 1;
+        }
+        if (ctx->out.head < ctx->out.count && http_out_flush(ctx) < 0) {
+            ctx->state = HTTP_STATE_CLOSING;
+            return;
+        }
+
+        if (ctx->request_len >= ctx->request_cap - 1 && grow_request_buffer(ctx) < 0) {
+            ctx->parser.error = HTTP_PARSE_BODY_TOO_LARGE;
+            respond_parse_error(ctx);
+            ctx->state = HTTP_STATE_RESPONDING;
+            return;
+        }
+
+        ssize_t bytes_read = read(ctx->client_fd, ctx->request + ctx->request_len,
+                                   ctx->request_cap - ctx->request_len - 1);
+
+        if (bytes_read < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                ctx->state = HTTP_STATE_CLOSING;
+            }
+            // 暂无数据，等待下一次 EPOLLIN
+            return;
+        }
+
+        if (bytes_read == 0) {
+            // 对端关闭
+            ctx->state = HTTP_STATE_CLOSING;
+            return;
+        }
+
+        ctx->request_len += bytes_read;
+        ctx->request[ctx->request_len] = '\0';
+    }
+}
+
+// 全局 LLM 活跃请求数 (计数器按 worker 分片，按需汇总)
+static int global_active_requests(const HttpServer *server) {
+    return server->workers ? http_workers_active_requests(server->workers)
+                           : server->active_requests;
+}
+
+// 某一类别的全局活跃请求数
+static int global_class_active(const HttpServer *server, int klass) {
+    if (!server->workers) return server->class_active[klass];
+
+    int total = 0;
+    for (int i = 0; i < server->workers->count; i++) {
+        total += __atomic_load_n(&server->workers->servers[i].class_active[klass], __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+// 类别未达到并发上限
+static int class_has_room(const HttpServer *server, int klass) {
+    return global_class_active(server, klass) < server->class_caps[klass];
+}
+
+// LLM 请求开始 / 结束占用并发 (计数仅由本 worker 线程修改)
+static void llm_begin(HttpContext *ctx) {
+    HttpServer *server = ctx->server;
+    int klass = ctx->admission.klass;
+    __atomic_store_n(&server->active_requests, server->active_requests + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&server->class_active[klass], server->class_active[klass] + 1, __ATOMIC_RELAXED);
+}
+
+static void llm_end(HttpContext *ctx) {
+    HttpServer *server = ctx->server;
+    int klass = ctx->admission.klass;
+    __atomic_store_n(&server->active_requests, server->active_requests - 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&server->class_active[klass], server->class_active[klass] - 1, __ATOMIC_RELAXED);
+}
+
+// 本 worker 可用的并发份额 (用于估算排队时间)
+static int worker_slots(const HttpServer *server) {
+    int count = server->workers ? server->workers->count : 1;
+    int slots = server->max_inflight / (count > 0 ? count : 1);
+    return (slots > 0) ? slots : 1;
+}
+
+// 准入控制: 返回 1 = 立即处理, 0 = 已排队或已回复 503
+static int llm_admit(HttpContext *ctx) {
+    HttpServer *server = ctx->server;
+    if (ctx->admitted) return 1;
+
+    // 有空闲并发、本类别未达上限且同类别没有人排在前面: 立即处理
+    // (其他类别的排队请求只可能是已达上限的，不会被跳过)
+    int klass = ctx->admission.klass;
+    if (server->admission.lanes[klass].count == 0 &&
+        global_active_requests(server) < server->max_inflight &&
+        class_has_room(server, klass)) {
+        ctx->admitted = 1;
+        return 1;
+    }
+
+    // 预计无法在截止时间前完成: 直接拒绝
+    long long now = now_ms();
+    long long deadline = ctx->request_start_ms + server->timeout_ms;
+    if (now + admission_estimate_wait(&server->admission, klass, worker_slots(server)) > deadline) {
+        const char *body = "{\"error\":503,\"message\":\"Service Unavailable (deadline cannot be met)\"}";
+        create_response(ctx, 503, "application/json", body);
+        return 0;
+    }
+
+    if (admission_push(&server->admission, &ctx->admission, now, deadline) < 0) {
+        const char *body = "{\"error\":503,\"message\":\"Service Unavailable (queue full)\"}";
+        create_response(ctx, 503, "application/json", body);
+        return 0;
+    }
+
+    // 排队: 保持 PROCESSING，出队后重新处理
+    return 0;
+}
+
+// 当前请求的 body (处理期间以 \0 结尾)，无 body 时返回 NULL
+static char* request_body(HttpContext *ctx) {
+    return (ctx->parser.body.len > 0) ? ctx->request + ctx->parser.body.off : NULL;
+}
+
+// 复制路径参数为 C 字符串
+static int copy_param(char *dst, size_t size, const char *param, int len) {
+    if (len <= 0 || (size_t)len >= size) return -1;
+    memcpy(dst, param, len);
+    dst[len] = '\0';
+    return 0;
+}
+
+// single-flight 键: 接口、是否流式、model 和输入 (FNV-1a)
+static unsigned long long flight_hash(int chat, int stream, const char *model, const char *input,
+                                      const char *options) {
+    unsigned long long hash = 14695981039346656037ULL;
+    hash = (hash ^ (unsigned)(chat * 2 + stream)) * 1099511628211ULL;
+    for (const char *p = model; *p; p++) hash = (hash ^ (unsigned char)*p) * 1099511628211ULL;
+    hash = (hash ^ 0xFF) * 1099511628211ULL;   // model 与输入的分隔
+    for (const char *p = input; *p; p++) hash = (hash ^ (unsigned char)*p) * 1099511628211ULL;
+    if (options) {
+        hash = (hash ^ 0xFF) * 1099511628211ULL;
+        for (const char *p = options; *p; p++) hash = (hash ^ (unsigned char)*p) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// options 相同 (都未提供也算相同): 转发给后端的采样参数不同的请求不能共享结果
+static int same_options(const char *a, const char *b) {
+    return a == b || (a && b && strcmp(a, b) == 0);
+}
+
+// 响应缓存键: 接口 + model + options + 输入 (以 \0 分隔)
+static char* cache_key(Arena *arena, int chat, const char *model, const char *options, const char *input,
+                       size_t *len) {
+    if (!options) options = "";
+    size_t model_len = strlen(model);
+    size_t options_len = strlen(options);
+    size_t input_len = strlen(input);
+    *len = 1 + 1 + model_len + 1 + options_len + 1 + input_len;
+
+    char *key = arena_alloc(arena, *len);
+    if (!key) return NULL;
+    char *p = key;
+    *p++ = chat ? 'c' : 'g';
+    *p++ = '\0';
+    memcpy(p, model, model_len + 1);
+    p += model_len + 1;
+    memcpy(p, options, options_len + 1);
+    p += options_len + 1;
+    memcpy(p, input, input_len);
+    return key;
+}
+
+// 采样是确定性的 ("options" 中 temperature 为 0) 或客户端用 "cache":true 接受复用的回复
+static int cache_deterministic(const JsonValue *temperature, const JsonValue *cache) {
+    if (cache->type == JSON_TRUE) return 1;
+    return temperature->type == JSON_NUMBER && strtod(temperature->data, NULL) == 0.0;
+}
+
+// 请求是否允许使用缓存: Cache-Control: no-cache / no-store 或 "cache":false 时跳过
+static int cache_allowed(HttpContext *ctx, const JsonValue *cache) {
+    if (!cache_enabled() || cache->type == JSON_FALSE) return 0;
+
+    int len;
+    const char *value = http_parser_header(&ctx->parser, ctx->request, "Cache-Control", &len);
+    if (value && (memmem(value, len, "no-cache", 8) || memmem(value, len, "no-store", 8))) {
+        return 0;
+    }
+    return 1;
+}
+
+// 跟随本 worker 上进行中的相同请求: 返回 1 = 已加入 (结果到达时一起响应)
+static int flight_join(HttpContext *ctx, int chat, int stream, const char *model, const char *input,
+                       const char *options) {
+    HttpServer *server = ctx->server;
+    unsigned long long hash = flight_hash(chat, stream, model, input, options);
+
+    HttpUpstream *leader = server->flights;
+    while (leader && !(leader->flight_hash == hash && leader->chat == chat &&
+                       leader->flight_stream == stream &&
+                       strcmp(leader->flight_model, model) == 0 &&
+                       strcmp(leader->flight_input, input) == 0 &&
+                       same_options(leader->flight_options, options))) {
+        leader = leader->flight_next;
+    }
+    if (!leader) return 0;
+
+    HttpUpstream *up = &ctx->upstream;
+    up->writer = NULL;
+    up->stream = NULL;
+    if (leader->writer) {
+        // 补发记录已超出上限，无法补齐之前的 token
+        if (!leader->writer->replay) return 0;
+
+        up->writer = arena_alloc(&ctx->arena, sizeof(HttpChunkWriter));
+        if (!up->writer) return 0;
+        http_chunk_writer_init(up->writer, ctx, ctx->keep_alive, leader->writer->content_type,
+                               server->stream_coalesce_bytes, server->stream_coalesce_ms);
+
+        // 先补发已经发出的 token，之后的 token 经写入器链与其他请求同时收到
+        for (BufferChunk *chunk = leader->replay.head; chunk; chunk = chunk->next) {
+            http_chunk_write(up->writer, chunk->data, chunk->len);
+        }
+        http_chunk_flush(up->writer);
+
+        up->writer->next = leader->writer->next;
+        leader->writer->next = up->writer;
+    }
+
+    up->chat = chat;
+    up->leader = leader->ctx;
+    up->next_follower = leader->followers;
+    leader->followers = ctx;
+    return 1;
+}
+
+// 跟随者离开 (客户端关闭或超时): 从调用的跟随者链表和写入器链中移除
+static void flight_leave(HttpContext *ctx) {
+    HttpUpstream *up = &ctx->upstream;
+    if (!up->leader) return;
+
+    HttpUpstream *leader = &up->leader->upstream;
+    HttpContext **link = &leader->followers;
+    while (*link && *link != ctx) link = &(*link)->upstream.next_follower;
+    if (*link) *link = up->next_follower;
+
+    if (up->writer) {
+        HttpChunkWriter *w = leader->writer;
+        while (w && w->next != up->writer) w = w->next;
+        if (w) w->next = up->writer->next;
+        up->writer->next = NULL;
+    }
+
+    up->leader = NULL;
+    up->next_follower = NULL;
+}
+
+static void upstream_respond(HttpContext *ctx, int ok, const char *reply);
+static int chunk_writer_blocked(const HttpChunkWriter *w);
+static void drive_context(HttpServer *server, HttpContext *ctx);
+static void stream_resume(HttpServer *server, HttpContext *owner);
+
+// 成功的回复 (上游返回 200 且不是错误对象) 才写入缓存和会话
+static int reply_succeeded(const HttpUpstream *up, const char *reply) {
+    return reply && up->call->resp.status == 200 && strncmp(reply, "{\"error\"", 8) != 0;
+}
+
+// 调用结束: 所有跟随者收到相同的结果 (reply 位于发起者的 arena 中，复制后入队)
+static void flight_complete(HttpContext *ctx, int ok, const char *reply) {
+    HttpUpstream *up = &ctx->upstream;
+    HttpContext *followers = up->followers;
+    if (!followers) return;
+
+    up->followers = NULL;
+    if (up->writer) up->writer->next = NULL;
+
+    // 先拆开写入器链，跟随者响应完成后 arena 即被重置
+    for (HttpContext *f = followers; f; f = f->upstream.next_follower) {
+        if (f->upstream.writer) f->upstream.writer->next = NULL;
+    }
+
+    while (followers) {
+        HttpContext *f = followers;
+        followers = f->upstream.next_follower;
+        f->upstream.leader = NULL;
+        f->upstream.next_follower = NULL;
+
+        // 批: 取自己位置上的回复 (相同请求的跟随者在第一个位置); 成员像发起者一样只缓存成功的回复
+        const char *own = reply;
+        if (up->batch_replies) {
+            own = up->batch_replies[f->upstream.batch_index];
+            if (ok && f->upstream.batch_index > 0 && f->upstream.cache_key && reply_succeeded(up, own)) {
+                cache_put(f->upstream.cache_key, f->upstream.cache_key_len, f->upstream.flight_hash, own);
+            }
+            if (!own) own = "{\"error\":\"Invalid OpenAI response\"}";
+        }
+
+        upstream_respond(f, ok, own ? arena_strdup(&f->arena, own) : NULL);
+        drive_context(ctx->server, f);
+    }
+}
+
+// 发送已构建的请求: 连接注册到本 worker 的 epoll，响应在 on_upstream_event 中生成
+static int upstream_send(HttpContext *ctx, Backend *backend, int chat, const char *path,
+                         const char *body, int stream) {
+    HttpServer *server = ctx->server;
+    HttpUpstream *up = &ctx->upstream;
+
+    UpstreamPool *pool = backend->priv;    // 创建副本时已绑定，请求路径不查注册表
+    up->call = arena_alloc(&ctx->arena, sizeof(UpstreamCall));
+    if (!body || !pool || !up->call) return -1;
+
+    up->stream = NULL;
+    up->writer = NULL;
+    up->paused = 0;
+    buffer_chain_init(&up->out, OLLAMA_MAX_BODY);
+    buffer_chain_init(&up->replay, OLLAMA_MAX_BODY);
+    buffer_chain_init(&up->context, OLLAMA_MAX_BODY);
+    if (stream) {
+        // 流式: 响应头随第一帧一起发出
+        up->stream = arena_alloc(&ctx->arena, sizeof(OllamaStream));
+        up->writer = arena_alloc(&ctx->arena, sizeof(HttpChunkWriter));
+        if (!up->stream || !up->writer) return -1;
+        ollama_stream_init(up->stream);
+        http_chunk_writer_init(up->writer, ctx, ctx->keep_alive, "text/plain; charset=utf-8",
+                               server->stream_coalesce_bytes, server->stream_coalesce_ms);
+    }
+
+    if (upstream_call_start(up->call, pool, path, body) < 0) return -1;
+
+    // 注册时若已可写 (复用连接)，epoll 会立即报告
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    ev.data.ptr = up;
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, up->call->fd, &ev) < 0) {
+        perror("epoll_ctl failed");
+        upstream_call_finish(up->call, 0);
+        return -1;
+    }
+
+    up->retried = up->call->retried;
+    up->backend = backend;
+    up->chat = chat;
+    up->started_ms = now_ms();
+    up->active = 1;
+    return 0;
+}
+
+// 开始异步上游调用
+static int upstream_start(HttpContext *ctx, Backend *backend, int chat, const char *model,
+                          const char *input, const char *history, const char *options, int stream) {
+    const char *path;
+    char *body = backend_build_request(backend, &ctx->arena, chat, model, input, history, options, stream,
+                                       &path);
+    return body ? upstream_send(ctx, backend, chat, path, body, stream) : -1;
+}
+
+// 登记为进行中的调用，相同的后续请求可以跟随 (requested_stream 为客户端请求的模式)
+static void flight_register(HttpContext *ctx, int requested_stream, const char *model, const char *input,
+                            const char *options) {
+    HttpServer *server = ctx->server;
+    HttpUpstream *up = &ctx->upstream;
+
+    up->flight_hash = flight_hash(up->chat, requested_stream, model, input, options);
+    up->flight_model = model;
+    up->flight_input = input;
+    up->flight_options = options;
+    up->flight_stream = requested_stream;
+    up->followers = NULL;
+    if (up->writer) up->writer->replay = &up->replay;
+
+    up->flight_next = server->flights;
+    server->flights = up;
+}
+
+// 从进行中的调用中移除 (之后的相同请求不再跟随)
+static void flight_unregister(HttpServer *server, HttpUpstream *up) {
+    HttpUpstream **link = &server->flights;
+    while (*link && *link != up) link = &(*link)->flight_next;
+    if (*link) *link = up->flight_next;
+    up->flight_next = NULL;
+}
+
+// 结束上游调用: 先从 epoll 移除再归还连接 (归还后可能被其他 worker 取走)
+static void upstream_detach(HttpContext *ctx, int reusable) {
+    HttpServer *server = ctx->server;
+    HttpUpstream *up = &ctx->upstream;
+    if (!up->active) return;
+
+    if (up->call->fd >= 0) {
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, up->call->fd, NULL);
+        upstream_call_finish(up->call, reusable);
+    }
+    up->active = 0;
+    buffer_chain_release(&up->out);
+    buffer_chain_release(&up->replay);
+    buffer_chain_release(&up->context);
+    backend_release(up->backend, up->trial);
+    up->trial = 0;
+    backend_session_release(up->session);
+    up->session = NULL;
+
+    flight_unregister(server, up);
+
+    // 减少请求计数
+    llm_end(ctx);
+    admission_record_service(&server->admission, now_ms() - up->started_ms);
+}
+
+// 发起者离开 (客户端关闭或超时) 时仍有跟随者: 调用连同写入器链交给一个跟随者继续，不牵连其他请求
+// 优先选择与发起者相同的请求 (非批成员)，它的回复位置与发起者相同。返回接手的请求，无法交接时返回 NULL
+static HttpContext* flight_handoff(HttpContext *ctx) {
+    HttpServer *server = ctx->server;
+    HttpUpstream *up = &ctx->upstream;
+    if (!up->followers || !(up->active || up->batch_open)) return NULL;
+
+    HttpContext *heir = up->followers;
+    for (HttpContext *f = up->followers; f; f = f->upstream.next_follower) {
+        if (f->upstream.batch_index == 0) {
+            heir = f;
+            break;
+        }
+    }
+    HttpUpstream *h = &heir->upstream;
+    int plain = (h->batch_index == 0);
+
+    // 先把仍要用到的数据复制到接手者的 arena (发起者的 arena 随后被重置)，失败时按原方式结束调用
+    UpstreamCall *call = NULL;
+    const char *body = NULL;
+    OllamaStream *stream = NULL;
+    if (up->active) {
+        call = arena_alloc(&heir->arena, sizeof(UpstreamCall));
+        if (!call) return NULL;
+        // 响应头到达之前 body 可能还要发送 (或在复用连接失败后重发)
+        if (up->call->state != UPSTREAM_CALL_BODY && !(body = arena_strdup(&heir->arena, up->call->body))) {
+            return NULL;
+        }
+        if (up->stream && !(stream = arena_alloc(&heir->arena, sizeof(OllamaStream)))) return NULL;
+    }
+
+    // 相同的请求接手发起者的键; 批成员保留自己的键
+    const char *model = h->flight_model;
+    const char *input = h->flight_input;
+    const char *options = h->flight_options;
+    const char *key = h->cache_key;
+    size_t key_len = h->cache_key_len;
+    if (plain) {
+        model = arena_strdup(&heir->arena, up->flight_model);
+        input = arena_strdup(&heir->arena, up->flight_input);
+        options = up->flight_options ? arena_strdup(&heir->arena, up->flight_options) : NULL;
+        key = up->cache_key ? arena_strndup(&heir->arena, up->cache_key, up->cache_key_len) : NULL;
+        key_len = up->cache_key_len;
+        if (!model || !input || (up->flight_options && !options) || (up->cache_key && !key)) return NULL;
+    }
+
+    if (call && up->call->fd >= 0) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        ev.data.ptr = h;
+        if (epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, up->call->fd, &ev) < 0) {
+            perror("epoll_ctl failed");
+            return NULL;
+        }
+    }
+
+    // 接手者离开跟随者链表，其余跟随者改为跟随它
+    HttpContext **link = &up->followers;
+    while (*link != heir) link = &(*link)->upstream.next_follower;
+    *link = h->next_follower;
+    h->followers = up->followers;
+    for (HttpContext *f = h->followers; f; f = f->upstream.next_follower) {
+        f->upstream.leader = heir;
+    }
+    up->followers = NULL;
+    h->leader = NULL;
+    h->next_follower = NULL;
+
+    if (plain) h->flight_hash = up->flight_hash;
+    h->flight_model = model;
+    h->flight_input = input;
+    h->flight_options = options;
+    h->flight_stream = up->flight_stream;
+    h->cache_key = key;
+    h->cache_key_len = key_len;
+    h->chat = up->chat;
+    h->backend = up->backend;
+    h->trial = up->trial;
+    up->trial = 0;
+    h->session = NULL;      // 会话请求不合并，不会有跟随者
+    h->started_ms = up->started_ms;
+    h->retried = up->retried;
+    h->paused = up->paused;
+    h->batch_count = up->batch_count;
+    h->batch_replies = NULL;
+    if (!plain && up->batch_open) h->batch_index = 0;   // 收集中的批: 接手者的提示占第一个位置
+    heir->admission.klass = ctx->admission.klass;       // 并发计在调用的类别上，由接手者结束时释放
+
+    h->out = up->out;
+    h->replay = up->replay;
+    h->context = up->context;
+    buffer_chain_init(&up->out, 0);
+    buffer_chain_init(&up->replay, 0);
+    buffer_chain_init(&up->context, 0);
+
+    // 写入器链: 接手者的写入器成为链头 (负责记录补发内容)，去掉离开的发起者
+    if (up->writer) {
+        HttpChunkWriter *rest = up->writer->next;
+        HttpChunkWriter **w = &rest;
+        while (*w && *w != h->writer) w = &(*w)->next;
+        if (*w) *w = h->writer->next;
+        h->writer->next = rest;
+        h->writer->replay = up->writer->replay ? &h->replay : NULL;
+        up->writer->next = NULL;
+        up->writer->replay = NULL;
+    }
+
+    if (call) {
+        upstream_call_move(call, up->call, body);
+        h->call = call;
+        if (stream) {
+            *stream = *up->stream;
+            stream->sink_user = h->writer;
+        }
+        h->stream = stream;
+        h->active = 1;
+        up->active = 0;
+    }
+
+    flight_unregister(server, up);
+    if (plain || up->batch_open) {
+        h->flight_next = server->flights;
+        server->flights = h;
+    }
+
+    if (up->batch_open) {
+        // 接手收集中的批，窗口按原发起者的时间结束
+        HttpUpstream **b = &server->batches;
+        while (*b && *b != up) b = &(*b)->batch_next;
+        if (*b) {
+            *b = h;
+            h->batch_next = up->batch_next;
+        }
+        up->batch_next = NULL;
+        up->batch_open = 0;
+        h->batch_open = 1;
+
+        long long remaining = ctx->phase_timer.armed ? ctx->phase_timer.expires_ms - now_ms() : 0;
+        arm_phase_timer(heir, HTTP_TIMER_BATCH, remaining > 0 ? (int)remaining : 0);
+    } else if (h->writer) {
+        int flush_timeout = http_chunk_writer_timeout(h->writer);
+        if (flush_timeout >= 0) arm_phase_timer(heir, HTTP_TIMER_STREAM_FLUSH, flush_timeout);
+    }
+    return heir;
+}
+
+// 开始收集批: 本请求的提示排在第一位，窗口结束或凑满 batch_max 个时一起发送
+static void batch_open(HttpContext *ctx, Backend *backend, const char *model, const char *input,
+                       const char *options) {
+    HttpServer *server = ctx->server;
+    HttpUpstream *up = &ctx->upstream;
+
+    up->stream = NULL;
+    up->writer = NULL;
+    up->chat = 0;
+    up->backend = backend;
+    up->batch_open = 1;
+    up->batch_count = 1;
+    flight_register(ctx, 0, model, input, options);
+
+    up->batch_next = server->batches;
+    server->batches = up;
+    arm_phase_timer(ctx, HTTP_TIMER_BATCH, server->batch_window_ms);
+}
+
+// 不再接受新成员 (调用发送前 batch_open 保持为 1)
+static void batch_unlink(HttpServer *server, HttpUpstream *up) {
+    HttpUpstream **link = &server->batches;
+    while (*link && *link != up) link = &(*link)->batch_next;
+    if (*link) *link = up->batch_next;
+    up->batch_next = NULL;
+}
+
+// 加入本 worker 正在收集的同 model、同 options 的批: 返回 1 = 已加入 (与跟随者一样不占用并发)
+static int batch_join(HttpContext *ctx, const char *model, const char *input, const char *options,
+                      const char *key, size_t key_len) {
+    HttpServer *server = ctx->server;
+    HttpUpstream *batch = server->batches;
+    while (batch && !(strcmp(batch->flight_model, model) == 0 && same_options(batch->flight_options, options))) {
+        batch = batch->batch_next;
+    }
+    if (!batch) return 0;
+
+    HttpUpstream *up = &ctx->upstream;
+    up->writer = NULL;
+    up->stream = NULL;
+    up->chat = 0;
+    up->flight_hash = flight_hash(0, 0, model, input, options);
+    up->flight_model = model;
+    up->flight_input = input;
+    up->flight_options = options;
+    up->cache_key = key;
+    up->cache_key_len = key_len;
+    up->batch_index = batch->batch_count++;
+    up->leader = batch->ctx;
+    up->next_follower = batch->followers;
+    batch->followers = ctx;
+
+    // 已凑满: 在本轮事件处理结束时由定时器发送
+    if (batch->batch_count >= server->batch_max) {
+        batch_unlink(server, batch);
+        arm_phase_timer(batch->ctx, HTTP_TIMER_BATCH, 0);
+    }
+    return 1;
+}
+
+// 发送收集到的批 (只有一个提示时按普通请求发送)
+static void batch_flush(HttpContext *ctx) {
+    HttpServer *server = ctx->server;
+    HttpUpstream *up = &ctx->upstream;
+    Backend *backend = up->backend;
+    batch_unlink(server, up);
+    up->batch_open = 0;
+
+    // 离开的成员不占位置: 按剩余成员重新编号
+    int count = 1;
+    for (HttpContext *f = up->followers; f; f = f->upstream.next_follower) {
+        if (f->upstream.batch_index > 0) f->upstream.batch_index = count++;
+    }
+    up->batch_count = count;
+
+    int result;
+    if (count == 1) {
+        result = upstream_start(ctx, backend, 0, up->flight_model, up->flight_input, NULL, up->flight_options, 0);
+    } else {
+        const char *path;
+        const char **inputs = arena_alloc(&ctx->arena, count * sizeof(char*));
+        char *body = NULL;
+        if (inputs) {
+            inputs[0] = up->flight_input;
+            for (HttpContext *f = up->followers; f; f = f->upstream.next_follower) {
+                if (f->upstream.batch_index > 0) inputs[f->upstream.batch_index] = f->upstream.flight_input;
+            }
+            body = backend_build_batch_request(&ctx->arena, up->flight_model, inputs, count, up->flight_options,
+                                               &path);
+        }
+        result = body ? upstream_send(ctx, backend, 0, path, body, 0) : -1;
+    }
+
+    if (result < 0) {
+        flight_unregister(server, up);
+        backend_report(backend, up->trial, 0);
+        backend_release(backend, up->trial);
+        up->trial = 0;
+        llm_end(ctx);
+        upstream_respond(ctx, 0, NULL);
+        flight_complete(ctx, 0, NULL);
+    }
+}
+
+// 收集中的批被放弃 (发起者关闭或超时)，成员随后由 flight_complete 响应
+static void batch_cancel(HttpContext *ctx) {
+    HttpServer *server = ctx->server;
+    HttpUpstream *up = &ctx->upstream;
+    if (!up->batch_open) return;
+
+    batch_unlink(server, up);
+    up->batch_open = 0;
+    flight_unregister(server, up);
+    backend_release(up->backend, up->trial);
+    up->trial = 0;
+    llm_end(ctx);
+}
+
+// 请求类别 (interactive / automation / batch)，未知返回 -1
+static int request_class(HttpContext *ctx, const JsonValue *priority) {
+    int len;
+    const char *value = http_parser_header(&ctx->parser, ctx->request, "X-Priority", &len);
+    if (value) return admission_parse_class(value, len);
+
+    if (priority->type == JSON_NONE) return ADMISSION_INTERACTIVE;
+    return (priority->type == JSON_STRING) ? admission_parse_class(priority->data, (int)priority->len) : -1;
+}
+
+// 限流键: API key (Authorization: Bearer 或 X-API-Key)，否则为对端地址
+static unsigned long long rate_client_key(HttpContext *ctx) {
+    int len;
+    const char *value = http_parser_header(&ctx->parser, ctx->request, "X-API-Key", &len);
+    if (!value) {
+        value = http_parser_header(&ctx->parser, ctx->request, "Authorization", &len);
+        if (value && len > 7 && strncasecmp(value, "Bearer ", 7) == 0) {
+            value += 7;
+            len -= 7;
+        } else {
+            value = NULL;
+        }
+    }
+    if (value && len > 0) return ratelimit_key(value, len);
+
+    char addr[5] = { 'i' };
+    memcpy(addr + 1, &ctx->client_addr, 4);
+    return ratelimit_key(addr, sizeof(addr));
+}
+
+// 调用 LLM (chat = 1 调用 /api/chat)，上游响应到达后再生成 HTTP 响应
+static void handle_llm(HttpContext *ctx, int chat) {
+    char *json = request_body(ctx);
+
+    // 按客户端限流 (出队后重新处理时已检查过)
+    if (!ctx->admitted) {
+        ctx->rate_client = 0;
+        if (ratelimit_enabled()) {
+            unsigned long long client = rate_client_key(ctx);
+            long retry_ms = ratelimit_acquire(client);
+            if (retry_ms > 0) {
+                char retry[48];
+                snprintf(retry, sizeof(retry), "Retry-After: %ld\r\n", (retry_ms + 999) / 1000);
+                queue_response_headers(ctx, 429, "application/json", retry,
+                                       "{\"error\":\"Rate limit exceeded\"}", 0);
+                return;
+            }
+            ctx->rate_client = client;
+        }
+    }
+    if (!json) {
+        create_response(ctx, 400, "application/json", "{\"error\":\"No JSON body\"}");
+        return;
+    }
+
+    // 解析请求: 一次遍历提取所有字段 (只看顶层的键)
+    enum { FIELD_MODEL, FIELD_INPUT, FIELD_SESSION, FIELD_STREAM, FIELD_CACHE, FIELD_PRIORITY,
+           FIELD_OPTIONS, FIELD_TEMPERATURE, FIELD_COUNT };
+    JsonField fields[FIELD_COUNT] = {
+        { .pointer = "/model" },
+        { .pointer = chat ? "/message" : "/prompt" },
+        { .pointer = "/session_id" },
+        { .pointer = "/stream" },
+        { .pointer = "/cache" },
+        { .pointer = "/priority" },
+        { .pointer = "/options" },
+        { .pointer = "/options/temperature" }
+    };
+    if (json_scan(json, ctx->parser.body.len, fields, FIELD_COUNT) < 0) {
+        create_response(ctx, 400, "application/json", "{\"error\":\"Invalid JSON body\"}");
+        return;
+    }
+    char *model = json_string(&ctx->arena, &fields[FIELD_MODEL].value);
+    char *input = json_string(&ctx->arena, &fields[FIELD_INPUT].value);
+
+    if (!model || !input) {
+        const char *body = chat ? "{\"error\":\"Missing model or message field\"}"
+                                : "{\"error\":\"Missing model or prompt field\"}";
+        create_response(ctx, 400, "application/json", body);
+        return;
+    }
+
+    // 采样参数 (原样转发给后端)
+    const JsonValue *options_value = &fields[FIELD_OPTIONS].value;
+    char *options = NULL;
+    if (options_value->type != JSON_NONE) {
+        if (options_value->type != JSON_OBJECT) {
+            create_response(ctx, 400, "application/json", "{\"error\":\"Invalid options\"}");
+            return;
+        }
+        options = arena_strndup(&ctx->arena, options_value->data, options_value->len);
+        if (!options) {
+            create_response(ctx, 500, "application/json", "{\"error\":\"Out of memory\"}");
+            return;
+        }
+    }
+
+    // 会话: chat 的历史 / generate 的 context 保存在服务端，客户端每轮只发送新消息
+    char *session_id = json_string(&ctx->arena, &fields[FIELD_SESSION].value);
+    if (session_id && (session_id[0] == '\0' || strlen(session_id) >= SESSION_ID_MAX)) {
+        create_response(ctx, 400, "application/json", "{\"error\":\"Invalid session_id\"}");
+        return;
+    }
+
+    HttpUpstream *up = &ctx->upstream;
+    up->batch_open = 0;
+    up->batch_count = 0;
+    up->batch_index = 0;
+    up->batch_replies = NULL;
+
+    // 非流式的确定性请求先查响应缓存 (会话的回复取决于历史，不缓存; 采样的回复每次不同，不缓存)
+    int want_stream = !chat && fields[FIELD_STREAM].value.type == JSON_TRUE;
+    char *key = NULL;
+    size_t key_len = 0;
+    if (!want_stream && !session_id && cache_allowed(ctx, &fields[FIELD_CACHE].value) &&
+        cache_deterministic(&fields[FIELD_TEMPERATURE].value, &fields[FIELD_CACHE].value)) {
+        key = cache_key(&ctx->arena, chat, model, options, input, &key_len);
+        char *cached = key ? cache_get(key, key_len, flight_hash(chat, 0, model, input, options), &ctx->arena)
+                           : NULL;
+        if (cached) {
+            queue_response(ctx, 200, "application/json", cached, 0);
+            return;
+        }
+    }
+
+    // 相同请求已在进行中: 跟随它，不占用并发也不再调用后端
+    if (!session_id && flight_join(ctx, chat, want_stream, model, input, options)) return;
+
+    // 同 model 的批正在收集: 加入它
+    int batchable = !chat && !want_stream && !session_id && ctx->server->batch_max > 1;
+    if (batchable && batch_join(ctx, model, input, options, key, key_len)) return;
+
+    // 调度类别: X-Priority 头或 "priority" 字段 (默认 interactive)
+    int klass = request_class(ctx, &fields[FIELD_PRIORITY].value);
+    if (klass < 0) {
+        create_response(ctx, 400, "application/json", "{\"error\":\"Invalid priority\"}");
+        return;
+    }
+    ctx->admission.klass = klass;
+
+    if (!llm_admit(ctx)) return;
+
+    // 增加请求计数 (上游调用结束时减少)
+    HttpServer *server = ctx->server;
+    llm_begin(ctx);
+
+    // 会话引用在上游调用结束时释放
+    SessionContext *session = NULL;
+    if (session_id && !(session = backend_session_acquire(session_id))) {
+        llm_end(ctx);
+        create_response(ctx, 503, "application/json", "{\"error\":\"Session store full\"}");
+        return;
+    }
+
+    // 选择副本 (OpenAI 兼容后端不支持流式，回退为普通响应)
+    int trial;
+    Backend *backend = backend_group_pick(server->backends, &trial);
+    if (!backend) {
+        // 所有副本的熔断器都已打开
+        backend_session_release(session);
+        llm_end(ctx);
+        create_response(ctx, 503, "application/json", "{\"error\":\"No healthy backend\"}");
+        return;
+    }
+    up->trial = trial;
+
+    // 微批处理: 该副本已有调用在进行 (本请求也已计入) 时先等待同 model 的并发请求
+    if (batchable && backend->api_type == BACKEND_OPENAI_COMPAT &&
+        __atomic_load_n(&backend->outstanding, __ATOMIC_RELAXED) > 1) {
+        batch_open(ctx, backend, model, input, options);
+        up->cache_key = key;
+        up->cache_key_len = key_len;
+        return;
+    }
+
+    // generate 会话带上上一轮的 context，Ollama 跳过已处理过的前缀
+    const char *history = NULL;
+    if (session && chat) {
+        history = backend_session_history(session, &ctx->arena);
+    } else if (session && backend->api_type == BACKEND_OLLAMA) {
+        history = backend_session_context(session, &ctx->arena, model);
+    }
+    int stream = want_stream && backend->api_type == BACKEND_OLLAMA;
+    if (upstream_start(ctx, backend, chat, model, input, history, options, stream) < 0) {
+        backend_session_release(session);
+        backend_report(backend, trial, 0);
+        backend_release(backend, trial);
+        up->trial = 0;
+        llm_end(ctx);
+        create_response(ctx, 502, "application/json", "{\"error\":\"Failed to connect to Ollama\"}");
+        return;
+    }
+    ctx->upstream.session = session;
+    ctx->upstream.session_input = input;
+    ctx->upstream.session_model = model;
+    if (session && !chat && ctx->upstream.stream) ctx->upstream.stream->context = &ctx->upstream.context;
+    if (!session) flight_register(ctx, want_stream, model, input, options);
+    ctx->upstream.cache_key = key;
+    ctx->upstream.cache_key_len = key_len;
+}
+
+// GET /
+static void handle_status(HttpContext *ctx, const char *param, int param_len) {
+    (void)param; (void)param_len;
+    const char *body = "{\"status\":\"ok\",\"message\":\"Q-Lite v0.1.0-alpha\",\"endpoints\":["
+        "\"GET /\",\"POST /api/generate\",\"POST /api/chat\",\"GET /cache\","
+        "\"GET /sessions\",\"DELETE /sessions/{id}\","
+        "\"GET /sensors\",\"GET /sensors/{id}\","
+        "\"GET /actuators\",\"POST /actuators/{id}\","
+        "\"GET /rules\",\"POST /rules\",\"DELETE /rules/{id}\"]}";
+    create_response(ctx, 200, "application/json", body);
+}
+
+// GET /cache: 响应缓存统计
+static void handle_cache_stats(HttpContext *ctx, const char *param, int param_len) {
+    (void)param; (void)param_len;
+    CacheStats stats;
+    cache_stats(&stats);
+
+    char *body = arena_sprintf(&ctx->arena,
+        "{\"enabled\":%s,\"entries\":%d,\"bytes\":%zu,\"budget\":%zu,\"ttl_ms\":%d,"
+        "\"hits\":%lu,\"misses\":%lu,\"inserts\":%lu,\"evictions\":%lu}",
+        cache_enabled() ? "true" : "false", stats.entries, stats.bytes, stats.budget, stats.ttl_ms,
+        stats.hits, stats.misses, stats.inserts, stats.evictions);
+    if (body) {
+        queue_response(ctx, 200, "application/json", body, 0);
+    } else {
+        create_response(ctx, 500, "application/json", "{\"error\":\"Out of memory\"}");
+    }
+}
+
+// GET /sessions: 会话存储统计
+static void handle_sessions_stats(HttpContext *ctx, const char *param, int param_len) {
+    (void)param; (void)param_len;
+    SessionStats stats;
+    backend_session_stats(&stats);
+
+    char *body = arena_sprintf(&ctx->arena,
+        "{\"sessions\":%d,\"bytes\":%zu,\"budget\":%zu,\"idle_ms\":%d,"
+        "\"created\":%lu,\"evicted\":%lu,\"expired\":%lu}",
+        stats.sessions, stats.bytes, stats.budget, stats.idle_ms,
+        stats.created, stats.evicted, stats.expired);
+    if (body) {
+        queue_response(ctx, 200, "application/json", body, 0);
+    } else {
+        create_response(ctx, 500, "application/json", "{\"error\":\"Out of memory\"}");
+    }
+}
+
+// DELETE /sessions/{id}: 结束会话 (丢弃历史)
+static void handle_session_delete(HttpContext *ctx, const char *param, int param_len) {
+    char session_id[SESSION_ID_MAX];
+    if (copy_param(session_id, sizeof(session_id), param, param_len) < 0) {
+        create_response(ctx, 400, "application/json", "{\"error\":\"Invalid session_id\"}");
+        return;
+    }
+
+    if (backend_session_delete(session_id) < 0) {
+        create_response(ctx, 404, "application/json", "{\"error\":\"Session not found\"}");
+        return;
+    }
+    create_response(ctx, 200, "application/json", "{\"status\":\"deleted\"}");
+}
+
+// POST /api/generate
+static void handle_generate(HttpContext *ctx, const char *param, int param_len) {
+    (void)param; (void)param_len;
+    handle_llm(ctx, 0);
+}
+
+// POST /api/chat
+static void handle_chat(HttpContext *ctx, const char *param, int param_len) {
+    (void)param; (void)param_len;
+    handle_llm(ctx, 1);
+}
+
+// 设备 API 的全局表由所有 worker 共享
+static pthread_mutex_t device_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define DEVICE_LIST_SIZE 8192
+#define DEVICE_ITEM_SIZE 1024
+
+// 执行列表函数，body 分配在请求 arena 中
+static void respond_device_list(HttpContext *ctx, int (*list)(char*, size_t)) {
+    char *body = arena_alloc(&ctx->arena, DEVICE_LIST_SIZE);
+    if (!body) {
+        create_response(ctx, 500, "application/json", "{\"error\":\"Out of memory\"}");
+        return;
+    }
+
+    pthread_mutex_lock(&device_lock);
+    list(body, DEVICE_LIST_SIZE);
+    pthread_mutex_unlock(&device_lock);
+
+    queue_response(ctx, 200, "application/json", body, 0);
+}
+
+// GET /sensors
+static void handle_sensors_list(HttpContext *ctx, const char *param, int param_len) {
+    (void)param; (void)param_len;
+    respond_device_list(ctx, sensor_list);
+}
+
+// GET /sensors/{id}
+static void handle_sensor_read(HttpContext *ctx, const char *param, int param_len) {
+    char id[32];
+    char *body = arena_alloc(&ctx->arena, DEVICE_ITEM_SIZE);
+    if (!body || copy_param(id, sizeof(id), param, param_len) < 0) {
+        create_response(ctx, 400, "application/json", "{\"error\":\"Invalid sensor id\"}");
+        return;
+    }
+
+    pthread_mutex_lock(&device_lock);
+    int result = sensor_read(id, body, DEVICE_ITEM_SIZE);
+    pthread_mutex_unlock(&device_lock);
+
+    if (result < 0) {
+        create_response(ctx, 404, "application/json", "{\"error\":\"Sensor not found\"}");
+        return;
+    }
+    queue_response(ctx, 200, "application/json", body, 0);
+}
+
+// GET /actuators
+static void handle_actuators_list(HttpContext *ctx, const char *param, int param_len) {
+    (void)param; (void)param_len;
+    respond_device_list(ctx, actuator_list);
+}
+
+// POST /actuators/{id}  {"command":"on|off|set","value":N}
+static void handle_actuator_command(HttpContext *ctx, const char *param, int param_len) {
+    char id[32];
+    char *json = request_body(ctx);
+    if (copy_param(id, sizeof(id), param, param_len) < 0 || !json) {
+        create_response(ctx, 400, "application/json", "{\"error\":\"Invalid actuator request\"}");
+        return;
+    }
+
+    JsonField fields[2] = { { .pointer = "/command" }, { .pointer = "/value" } };
+    if (json_scan(json, ctx->parser.body.len, fields, 2) < 0) {
+        create_response(ctx, 400, "application/json", "{\"error\":\"Invalid actuator request\"}");
+        return;
+    }
+    char *command = json_string(&ctx->arena, &fields[0].value);
+    uint32_t value = (fields[1].value.type == JSON_NUMBER) ? (uint32_t)strtoul(fields[1].value.data, NULL, 10) : 0;
+
+    int result = -1;
+    pthread_mutex_lock(&device_lock);
+    if (!command) {
+        result = -2;
+    } else if (strcmp(command, "on") == 0) {
+        result = actuator_on(id);
+    } else if (strcmp(command, "off") == 0) {
+        result = actuator_off(id);
+    } else if (strcmp(command, "set") == 0) {
+        result = actuator_set(id, value);
+    } else {
+        result = -2;
+    }
+    pthread_mutex_unlock(&device_lock);
+
+    if (result == -2) {
+        create_response(ctx, 400, "application/json", "{\"error\":\"Unknown command\"}");
+    } else if (result < 0) {
+        create_response(ctx, 404, "application/json", "{\"error\":\"Actuator not found or disabled\"}");
+    } else {
+        create_response(ctx, 200, "application/json", "{\"status\":\"ok\"}");
+    }
+}
+
+// GET /rules
+static void handle_rules_list(HttpContext *ctx, const char *param, int param_len) {
+    (void)param; (void)param_len;
+    respond_device_list(ctx, rule_list);
+}
+
+// POST /rules
+static void handle_rules_add(HttpContext *ctx, const char *param, int param_len) {
+    (void)param; (void)param_len;
+    char *json = request_body(ctx);
+    if (!json) {
+        create_response(ctx, 400, "application/json", "{\"error\":\"No JSON body\"}");
+        return;
+    }
+
+    pthread_mutex_lock(&device_lock);
+    int result = rule_add(json);
+    pthread_mutex_unlock(&device_lock);
+
+    if (result == -2) {
+        create_response(ctx, 400, "application/json", "{\"error\":\"Invalid rule\"}");
+    } else if (result < 0) {
+        create_response(ctx, 507, "application/json", "{\"error\":\"Rule table full\"}");
+    } else {
+        create_response(ctx, 201, "application/json", "{\"status\":\"created\"}");
+    }
+}
+
+// DELETE /rules/{id}
+static void handle_rule_delete(HttpContext *ctx, const char *param, int param_len) {
+    char id[32];
+    if (copy_param(id, sizeof(id), param, param_len) < 0) {
+        create_response(ctx, 400, "application/json", "{\"error\":\"Invalid rule id\"}");
+        return;
+    }
+
+    pthread_mutex_lock(&device_lock);
+    int result = rule_remove(id);
+    pthread_mutex_unlock(&device_lock);
+
+    if (result < 0) {
+        create_response(ctx, 404, "application/json", "{\"error\":\"Rule not found\"}");
+    } else {
+        create_response(ctx, 200, "application/json", "{\"status\":\"deleted\"}");
+    }
+}
+
+// 路由表 (按方法 + 路径完美哈希，不扫描 body)
+static const HttpRoute routes[] = {
+    { "GET",    "/",              handle_status },
+    { "GET",    "/cache",         handle_cache_stats },
+    { "GET",    "/sessions",      handle_sessions_stats },
+    { "DELETE", "/sessions/*",    handle_session_delete },
+    { "POST",   "/api/generate",  handle_generate },
+    { "POST",   "/api/chat",      handle_chat },
+    { "GET",    "/sensors",       handle_sensors_list },
+    { "GET",    "/sensors/*",     handle_sensor_read },
+    { "GET",    "/actuators",     handle_actuators_list },
+    { "POST",   "/actuators/*",   handle_actuator_command },
+    { "GET",    "/rules",         handle_rules_list },
+    { "POST",   "/rules",         handle_rules_add },
+    { "DELETE", "/rules/*",       handle_rule_delete },
+};
+
+// FSM: 处理请求
+void http_handle_processing(HttpContext *ctx) {
+    // 流式响应进行中: socket 可写后继续发送排队的帧
+    if (ctx->out.stream.len > 0 && http_out_flush(ctx) < 0 && ctx->upstream.writer) {
+        ctx->upstream.writer->failed = 1;
+    }
+
+    // 等待准入或上游响应期间的客户端事件不重新处理请求
+    if (ctx->admission.queued || ctx->upstream.active || ctx->upstream.leader ||
+        ctx->upstream.batch_open) return;
+
+    // 只处理当前请求: body 之后的数据 (chunk 分帧或流水线请求) 暂时截断
+    const HttpRequestParser *req = &ctx->parser;
+    int body_end = req->body.off + req->body.len;
+    char saved = ctx->request[body_end];
+    ctx->request[body_end] = '\0';
+
+    // 按方法和路径查找路由
+    const HttpRoute *route;
+    const char *param;
+    int param_len;
+    HttpRouteResult result = http_router_lookup(&ctx->server->router,
+        ctx->request + req->method.off, req->method.len,
+        ctx->request + req->path.off, req->path.len,
+        &route, &param, &param_len);
+
+    if (result == HTTP_ROUTE_FOUND) {
+        route->handler(ctx, param, param_len);
+    } else if (result == HTTP_ROUTE_METHOD_NOT_ALLOWED) {
+        create_response(ctx, 405, "application/json", "{\"error\":\"Method not allowed\"}");
+    } else {
+        create_response(ctx, 404, "application/json", "{\"error\":\"Not found\"}");
+    }
+
+    ctx->request[body_end] = saved;
+
+    // 在准入队列中或等待上游时保持 PROCESSING
+    if (!ctx->admission.queued && !ctx->upstream.active && !ctx->upstream.leader &&
+        !ctx->upstream.batch_open) {
+        ctx->state = HTTP_STATE_RESPONDING;
+    }
+}
+
+// FSM: 发送响应 (非阻塞: writev 到 EAGAIN 为止，剩余部分等待 EPOLLOUT)
+void http_handle_responding(HttpContext *ctx) {
+    int result = http_out_flush(ctx);
+
+    if (result == 0) {
+        // socket 缓冲区已满，保持 RESPONDING
+        return;
+    }
+
+    if (result < 0) {
+        // 发送错误
+        ctx->state = HTTP_STATE_CLOSING;
+        return;
+    }
+
+    // 发送完成: 请求期间的分配一次性释放
+    arena_reset(&ctx->arena);
+    timer_cancel(&ctx->server->timers, &ctx->request_timer);
+
+    if (!ctx->keep_alive || ctx->parser.state != HTTP_PARSE_DONE) {
+        ctx->state = HTTP_STATE_CLOSING;
+        return;
+    }
+
+    // Keep-alive: 丢弃已处理的请求，保留流水线中的后续数据
+    int frame_len = ctx->parser.frame_len;
+    ctx->request_len -= frame_len;
+    memmove(ctx->request, ctx->request + frame_len, ctx->request_len + 1);
+    if (ctx->request != ctx->request_inline && ctx->request_len < HTTP_MAX_REQUEST) {
+        // 大请求处理完毕，回到内联缓冲区
+        memcpy(ctx->request_inline, ctx->request, ctx->request_len + 1);
+        release_request_buffer(ctx);
+    }
+    http_parser_init(&ctx->parser, HTTP_MAX_BODY);
+    ctx->continue_sent = 0;
+    ctx->requests_served++;
+    ctx->state = HTTP_STATE_READING;
+
+    // 流水线中已有下一个请求的数据时直接进入请求头阶段
+    if (ctx->request_len > 0) {
+        start_request_timers(ctx);
+    } else {
+        arm_phase_timer(ctx, HTTP_TIMER_IDLE, ctx->server->keepalive_timeout_ms);
+    }
+}
+
+// FSM: 关闭连接
+void http_handle_closing(HttpContext *ctx) {
+    admission_remove(&ctx->server->admission, &ctx->admission);
+    flight_leave(ctx);
+    // 有跟随者时调用交给其中一个继续，否则中断
+    HttpContext *heir = flight_handoff(ctx);
+    if (!heir) {
+        batch_cancel(ctx);
+        upstream_detach(ctx, 0);
+        flight_complete(ctx, 0, NULL);
+    }
+    timer_cancel(&ctx->server->timers, &ctx->phase_timer);
+    timer_cancel(&ctx->server->timers, &ctx->request_timer);
+    http_out_reset(ctx);
+    arena_reset(&ctx->arena);
+    release_request_buffer(ctx);
+    close(ctx->client_fd);
+    ctx->client_fd = -1;
+    ctx->state = HTTP_STATE_IDLE;
+    HTTP_TRACE("[HTTP] Connection closed\n");
+
+    // 离开的发起者可能正是阻塞上游读取的客户端
+    if (heir) stream_resume(heir->server, heir);
 }
 
-// 简化 JSON 解析（手动提取字段）
-static char* extract_json_field(const char *json, const char *field) {
-    char search[128];
-    snprintf(search, sizeof(search), "\"%s\":\"", field);
+// 设置非阻塞
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0) return -1;
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
 
-    char *start = strstr(json, search);
-    if (!start) return NULL;
+// 归还连接上下文到空闲链表
+static void release_context(HttpServer *server, HttpContext *ctx) {
+    ctx->state = HTTP_STATE_IDLE;
+    ctx->next_free = server->free_list;
+    server->free_list = ctx;
+    server->active_connections--;
+}
 
-    start += strlen(search);
-    char *end = strchr(start, '"');
-    if (!end) return NULL;
+// 驱动单个连接的 FSM，直到需要等待 I/O 就绪
+static void drive_context(HttpServer *server, HttpContext *ctx) {
+    while (1) {
+        HttpState prev = ctx->state;
 
-    *end = '\0';
-    char *result = strdup(start);
-    *end = '"';
+        switch (ctx->state) {
+            case HTTP_STATE_READING:
+                http_handle_reading(ctx);
+                break;
+            case HTTP_STATE_PROCESSING:
+                http_handle_processing(ctx);
+                break;
+            case HTTP_STATE_RESPONDING:
+                http_handle_responding(ctx);
+                break;
+            case HTTP_STATE_CLOSING:
+                // close() 会自动从 epoll 中移除 fd
+                http_handle_closing(ctx);
+                release_context(server, ctx);
+                return;
+            case HTTP_STATE_IDLE:
+                return;
+        }
 
-    return result;
+        if (ctx->state == prev) {
+            // 状态未变化: 等待下一次 epoll 事件
+            return;
+        }
+    }
 }
 
-// FSM: 等待连接
-void http_handle_idle(HttpContext *ctx) {
-    struct sockaddr_in client_addr;
-    socklen_t client_len = sizeof(client_addr);
+// 接受所有挂起的连接 (边缘触发: 一直 accept 到 EAGAIN)
+static void accept_connections(HttpServer *server) {
+    while (1) {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+
+        int client_fd = accept4(server->server_fd, (struct sockaddr*)&client_addr,
+                                &client_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept failed");
+            }
+            return;
+        }
+
+        HttpContext *ctx = server->free_list;
+        if (!ctx) {
+            // 连接池已满
+            http_send_error(client_fd, 503, "Service Unavailable (too many connections)");
+            close(client_fd);
+            continue;
+        }
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = ctx;
+        if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) < 0) {
+            perror("epoll_ctl failed");
+            close(client_fd);
+            continue;
+        }
 
-    // 非阻塞 accept
-    ctx->client_fd = accept(ctx->server_fd, (struct sockaddr*)&client_addr, &client_len);
+        server->free_list = ctx->next_free;
+        server->active_connections++;
 
-    if (ctx->client_fd >= 0) {
-        // 新连接
+        ctx->client_fd = client_fd;
+        ctx->client_addr = client_addr.sin_addr.s_addr;
         ctx->state = HTTP_STATE_READING;
+        ctx->request = ctx->request_inline;
+        ctx->request_cap = HTTP_MAX_REQUEST;
         ctx->request_len = 0;
-        printf("[HTTP] New connection from %s\n", inet_ntoa(client_addr.sin_addr));
-    } else {
-        // 无连接，保持 IDLE
-        ctx->state = HTTP_STATE_IDLE;
+        http_parser_init(&ctx->parser, HTTP_MAX_BODY);
+        ctx->continue_sent = 0;
+        ctx->keep_alive = 0;
+        ctx->requests_served = 0;
+        ctx->next_free = NULL;
+        start_request_timers(ctx);  // 连接后迟迟不发请求头同样受限
+#ifdef HTTP_TRACE_CONNECTIONS
+        char addr[INET_ADDRSTRLEN];
+        HTTP_TRACE("[HTTP] New connection from %s\n",
+                   inet_ntop(AF_INET, &client_addr.sin_addr, addr, sizeof(addr)));
+#endif
     }
 }
 
-// FSM: 读取请求
-void http_handle_reading(HttpContext *ctx) {
-    ssize_t bytes_read = read(ctx->client_fd, ctx->request + ctx->request_len,
-                               HTTP_MAX_REQUEST - ctx->request_len - 1);
+// 初始化事件循环
+int http_server_init(HttpServer *server, int server_fd, int max_connections,
+                     const HttpServerConfig *config) {
+    memset(server, 0, sizeof(*server));
+    server->server_fd = server_fd;
+    server->max_connections = (max_connections > 0) ? max_connections : 1;
+    server->keepalive_timeout_ms = HTTP_KEEPALIVE_TIMEOUT_MS;
+    server->max_inflight = (config->max_inflight > 0) ? config->max_inflight : HTTP_DEFAULT_MAX_INFLIGHT;
+    server->timeout_ms = (config->timeout_ms > 0) ? config->timeout_ms : 30000;
+    // 阶段截止时间不超过整个请求的截止时间
+    server->header_timeout_ms = (HTTP_HEADER_TIMEOUT_MS < server->timeout_ms) ? HTTP_HEADER_TIMEOUT_MS
+                                                                            : server->timeout_ms;
+    server->body_timeout_ms = (HTTP_BODY_TIMEOUT_MS < server->timeout_ms) ? HTTP_BODY_TIMEOUT_MS
+                                                                        : server->timeout_ms;
+    timer_wheel_init(&server->timers, TIMER_WHEEL_TICK_MS, now_ms());
+    server->stream_coalesce_bytes = config->stream_coalesce_bytes;
+    server->stream_coalesce_ms = (config->stream_coalesce_ms > 0) ? config->stream_coalesce_ms
+                                                                  : HTTP_STREAM_COALESCE_MS;
+    server->batch_max = config->batch_max;
+    server->batch_window_ms = (config->batch_window_ms > 0) ? config->batch_window_ms : HTTP_BATCH_WINDOW_MS;
+    server->batches = NULL;
+    server->backends = config->backends;
 
-    if (bytes_read <= 0) {
-        // 连接关闭或错误
-        ctx->state = HTTP_STATE_CLOSING;
-        return;
+    // 本 worker 的等待队列份额
+    int workers = (config->workers > 0) ? config->workers : 1;
+    admission_init(&server->admission, (config->queue_depth + workers - 1) / workers);
+
+    // 类别权重和并发上限 (上限按 max_inflight 的百分比，至少 1)
+    static const int default_caps[ADMISSION_CLASSES] = ADMISSION_DEFAULT_CAPS;
+    for (int i = 0; i < ADMISSION_CLASSES; i++) {
+        if (config->class_weights[i] > 0) admission_set_weight(&server->admission, i, config->class_weights[i]);
+        int percent = (config->class_caps[i] > 0) ? config->class_caps[i] : default_caps[i];
+        int cap = server->max_inflight * percent / 100;
+        server->class_caps[i] = (cap > 0) ? cap : 1;
+        server->class_active[i] = 0;
+    }
+
+    if (http_router_init(&server->router, routes, sizeof(routes) / sizeof(routes[0])) < 0) {
+        fprintf(stderr, "[HTTP] Failed to build route table\n");
+        return -1;
+    }
+
+    server->contexts = calloc(server->max_connections, sizeof(HttpContext));
+    if (!server->contexts) {
+        fprintf(stderr, "[HTTP] Failed to allocate %d connection contexts\n",
+                server->max_connections);
+        return -1;
+    }
+
+    // 构建空闲链表
+    for (int i = server->max_connections - 1; i >= 0; i--) {
+        server->contexts[i].kind = HTTP_EVENT_CLIENT;
+        server->contexts[i].client_fd = -1;
+        server->contexts[i].upstream.kind = HTTP_EVENT_UPSTREAM;
+        server->contexts[i].upstream.ctx = &server->contexts[i];
+        server->contexts[i].state = HTTP_STATE_IDLE;
+        server->contexts[i].server = server;
+        server->contexts[i].request = server->contexts[i].request_inline;
+        server->contexts[i].request_cap = HTTP_MAX_REQUEST;
+        buffer_chain_init(&server->contexts[i].out.stream, HTTP_STREAM_OUT_MAX);
+        server->contexts[i].phase_timer.tag = HTTP_TIMER_TAG_PHASE;
+        server->contexts[i].request_timer.tag = HTTP_TIMER_TAG_REQUEST;
+        arena_init(&server->contexts[i].arena, ARENA_DEFAULT_BLOCK);
+        server->contexts[i].next_free = server->free_list;
+        server->free_list = &server->contexts[i];
     }
 
-    ctx->request_len += bytes_read;
-    ctx->request[ctx->request_len] = '\0';
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (server->epoll_fd < 0) {
+        perror("epoll_create1 failed");
+        free(server->contexts);
+        server->contexts = NULL;
+        return -1;
+    }
 
-    // 检查是否读取完整请求（查找 \r\n\r\n）
-    if (strstr(ctx->request, "\r\n\r\n") != NULL) {
-        ctx->state = HTTP_STATE_PROCESSING;
+    // 监听 socket: data.ptr == NULL 表示新连接事件
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server_fd, &ev) < 0) {
+        perror("epoll_ctl failed");
+        close(server->epoll_fd);
+        free(server->contexts);
+        server->contexts = NULL;
+        return -1;
     }
+
+    return 0;
 }
 
-// FSM: 处理请求
-void http_handle_processing(HttpContext *ctx) {
-    // Task 3: 检查并发队列
-    if (active_requests >= MAX_CONCURRENT_REQUESTS) {
-        http_send_error(ctx->client_fd, 503, "Service Unavailable (too many requests)");
-        ctx->state = HTTP_STATE_CLOSING;
-        return;
+// 从准入队列中调度请求: 先淘汰已过截止时间的，再在有空闲并发时按类别权重 (DRR) 出队
+static void drain_admission(HttpServer *server) {
+    AdmissionNode *node;
+    long long now = now_ms();
+
+    while ((node = admission_peek_expired(&server->admission, now)) != NULL) {
+        HttpContext *ctx = (HttpContext*)((char*)node - offsetof(HttpContext, admission));
+        admission_remove(&server->admission, node);
+        const char *body = "{\"error\":504,\"message\":\"Request timed out in queue\"}";
+        create_response(ctx, 504, "application/json", body);
+        ctx->state = HTTP_STATE_RESPONDING;
+        drive_context(server, ctx);
     }
 
-    // 增加请求计数
-    __sync_fetch_and_add(&active_requests, 1);
-
-    // 解析 HTTP 方法
-    if (strncmp(ctx->request, "GET ", 4) == 0) {
-        // 简单的 GET 响应
-        const char *body = "{\"status\":\"ok\",\"message\":\"Q-Lite v0.1.0-alpha\",\"endpoints\":{\"GET /\",\"POST /api/generate\",\"POST /api/chat\"}";
-        create_response(ctx, 200, "application/json", body);
-    } else if (strncmp(ctx->request, "POST ", 5) == 0) {
-        // 查找 JSON body（在 \r\n\r\n 之后）
-        char *json_start = strstr(ctx->request, "\r\n\r\n");
-        if (json_start != NULL) {
-            json_start += 4;  // 跳过 \r\n\r\n
-
-            // 解析请求: 提取 model 和 prompt/message
-            char *model = extract_json_field(json_start, "model");
-            char *prompt_or_message = extract_json_field(json_start,
-                (strstr(json_start, "\"prompt\":") != NULL) ? "prompt" : "message");
-
-            if (model && prompt_or_message) {
-                // 调用 Ollama
-                char *ollama_response;
-                if (strstr(json_start, "\"prompt\":") != NULL) {
-                    // /api/generate
-                    ollama_response = ollama_generate(model, prompt_or_message);
-                } else {
-                    // /api/chat
-                    ollama_response = ollama_chat(model, prompt_or_message);
-                }
-
-                // 创建 HTTP 响应
-                create_response(ctx, 200, "application/json", ollama_response);
-
-                // 清理
-                free(model);
-                free(prompt_or_message);
-                free(ollama_response);
-            } else {
-                const char *body = "{\"error\":\"Missing model or prompt/message field\"}";
-                create_response(ctx, 400, "application/json", body);
-            }
-        } else {
-            const char *body = "{\"error\":\"No JSON body\"}";
-            create_response(ctx, 400, "application/json", body);
+    while (server->admission.count > 0 && global_active_requests(server) < server->max_inflight) {
+        // 已达并发上限的类别本轮不参与调度
+        unsigned eligible = 0;
+        for (int i = 0; i < ADMISSION_CLASSES; i++) {
+            if (class_has_room(server, i)) eligible |= 1u << i;
         }
-    } else {
-        const char *body = "{\"error\":\"Method not allowed\"}";
-        create_response(ctx, 405, "application/json", body);
+
+        node = admission_pop(&server->admission, eligible);
+        if (!node) return;
+
+        HttpContext *ctx = (HttpContext*)((char*)node - offsetof(HttpContext, admission));
+        ctx->admitted = 1;
+        drive_context(server, ctx);
     }
+}
 
-    // 减少请求计数
-    __sync_fetch_and_sub(&active_requests, 1);
+// 非流式: 读取当前可用的 body (1 = 读完, 0 = 等待数据, -1 = 错误)
+static int upstream_read_buffered(HttpUpstream *up) {
+    while (1) {
+        // 直接读入链式缓冲区的尾块
+        size_t avail;
+        char *dst = buffer_chain_reserve(&up->out, &avail);
+        if (!dst) return -1;  // 超过 OLLAMA_MAX_BODY
+
+        ssize_t n = upstream_read_body(&up->call->resp, dst, avail);
+        if (n == -2) return 0;
+        if (n < 0) return -1;
+        if (n == 0) return 1;
+        buffer_chain_commit(&up->out, n);
+    }
+}
+
+// 解码出的 token 写入客户端的流式响应
+static int stream_sink(void *writer, const char *data, size_t len) {
+    return http_chunk_write(writer, data, len);
+}
+
+// 流式: 转发当前可用的 token (1 = 收到 done, 0 = 等待数据, -1 = 错误)
+static int upstream_read_stream(HttpContext *ctx) {
+    HttpUpstream *up = &ctx->upstream;
+    if (up->call->resp.status != 200) return -1;
+
+    // 任一客户端的输出队列超过高水位时暂停读取 (数据留在上游 socket 中)，可写后由 stream_resume 继续
+    int result;
+    while (!(up->paused = chunk_writer_blocked(up->writer)) &&
+           (result = ollama_stream_read(up->stream, &up->call->resp, stream_sink, up->writer)) == 0) {
+    }
+    if (up->paused) return 0;
+    if (result == -2) {
+        // 有合并中的 token: 到期后由定时器发出
+        int flush_timeout = http_chunk_writer_timeout(up->writer);
+        if (flush_timeout >= 0) {
+            arm_phase_timer(ctx, HTTP_TIMER_STREAM_FLUSH, flush_timeout);
+        }
+        return 0;
+    }
+    if (result < 0) return -1;
+
+    // 立即结束客户端的流; 终止 chunk 已到达时连接可归还连接池
+    timer_cancel(&ctx->server->timers, &ctx->phase_timer);
+    if (http_chunk_end(up->writer) < 0) return -1;
+    upstream_drain_body(&up->call->resp);
+    return 1;
+}
+
+// 按调用结果生成响应并进入 RESPONDING (发起者和跟随者共用)
+static void upstream_respond(HttpContext *ctx, int ok, const char *reply) {
+    HttpUpstream *up = &ctx->upstream;
 
+    // 按本客户端收到的回复长度计入生成的 token
+    if (ctx->rate_client && ok) {
+        size_t bytes = up->writer ? up->writer->bytes : (reply ? strlen(reply) : 0);
+        ratelimit_charge(ctx->rate_client, (long)(bytes / RATELIMIT_BYTES_PER_TOKEN));
+    }
+
+    if (up->writer) {
+        if (!up->writer->header_sent) {
+            create_response(ctx, 502, "application/json", "{\"error\":\"Failed to connect to Ollama\"}");
+        } else if (!ok || !up->writer->finished) {
+            // 流已中断，无法再发送错误响应
+            http_chunk_flush(up->writer);
+            ctx->keep_alive = 0;
+        }
+    } else if (!ok) {
+        create_response(ctx, 502, "application/json", "{\"error\":\"Failed to connect to Ollama\"}");
+    } else if (reply) {
+        // 回复位于 arena 中，按引用入队，发送完毕后随 arena 释放
+        queue_response(ctx, 200, "application/json", reply, 0);
+    } else {
+        create_response(ctx, 500, "application/json", "{\"error\":\"Out of memory\"}");
+    }
+
+    timer_cancel(&ctx->server->timers, &ctx->phase_timer);
     ctx->state = HTTP_STATE_RESPONDING;
 }
 
-// FSM: 发送响应
-void http_handle_responding(HttpContext *ctx) {
-    ssize_t bytes_sent = write(ctx->client_fd, ctx->response, ctx->response_len);
+// 上游调用结束: 响应发起者和所有跟随者
+static void upstream_complete(HttpContext *ctx, int ok) {
+    HttpUpstream *up = &ctx->upstream;
+    char *reply = NULL;
+    char *text = NULL;
 
-    if (bytes_sent < 0) {
-        // 发送错误
-        ctx->state = HTTP_STATE_CLOSING;
-    } else if (bytes_sent == ctx->response_len) {
-        // 发送完成
-        ctx->state = HTTP_STATE_CLOSING;
+    if (ok && !up->writer) {
+        text = buffer_chain_str(&up->out, &ctx->arena);
+        if (text && up->batch_count > 1 && up->call->resp.status == 200) {
+            // 批: choices[] 按提示位置拆分，发起者取自己的位置 (第一个，或接手调用的批成员自己的位置)
+            up->batch_replies = backend_parse_choices(&ctx->arena, text, up->batch_count);
+            reply = up->batch_replies ? up->batch_replies[up->batch_index] : NULL;
+            if (!reply) reply = arena_strdup(&ctx->arena, "{\"error\":\"Invalid OpenAI response\"}");
+        } else if (text) {
+            reply = backend_parse_reply(up->backend, &ctx->arena, up->chat, text);
+        }
+    }
+
+    if (reply_succeeded(up, reply)) {
+        if (up->cache_key) cache_put(up->cache_key, up->cache_key_len, up->flight_hash, reply);
+        if (up->session && up->chat) backend_session_append(up->session, up->session_input, reply);
+    }
+
+    // generate 会话: 保存返回的 context 供下一轮使用
+    if (ok && up->session && !up->chat && up->backend->api_type == BACKEND_OLLAMA &&
+        up->call->resp.status == 200) {
+        size_t count = 0;
+        uint32_t *tokens = NULL;
+        if (text) {
+            tokens = ollama_reply_context(&ctx->arena, text, &count);
+        } else if (up->stream && up->stream->done && up->stream->context) {
+            char *list = buffer_chain_str(&up->context, &ctx->arena);
+            tokens = list ? ollama_parse_context(&ctx->arena, list, &count) : NULL;
+        }
+        if (tokens) backend_session_set_context(up->session, up->session_model, tokens, count);
+    }
+
+    backend_report(up->backend, up->trial, ok);
+    upstream_detach(ctx, ok);
+    upstream_respond(ctx, ok, reply);
+    flight_complete(ctx, ok, reply);
+}
+
+// 上游 socket 就绪: 推进调用并读取已到达的数据 (边缘触发: 读到 EAGAIN)
+static void on_upstream_event(HttpServer *server, HttpUpstream *up) {
+    HttpContext *ctx = up->ctx;
+    UpstreamCall *call = up->call;
+
+    int result = upstream_call_resume(call);
+
+    // 复用连接失败后换了新连接 (旧 fd 关闭时已自动移出 epoll)
+    if (call->fd >= 0 && call->retried != up->retried) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        ev.data.ptr = up;
+        up->retried = call->retried;
+        if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, call->fd, &ev) < 0) {
+            perror("epoll_ctl failed");
+            result = -1;
+        }
+    }
+    if (result == 0) return;
+
+    if (result > 0) {
+        result = up->stream ? upstream_read_stream(ctx) : upstream_read_buffered(up);
+        if (result == 0) return;
+    }
+
+    upstream_complete(ctx, result > 0);
+    drive_context(server, ctx);
+}
+
+// 流式: 暂停的上游读取在所有输出队列回落到高水位以下后继续 (owner 为发起调用的请求)
+static void stream_resume(HttpServer *server, HttpContext *owner) {
+    HttpUpstream *up = &owner->upstream;
+    if (!up->active || !up->paused || chunk_writer_blocked(up->writer)) return;
+
+    int result = upstream_read_stream(owner);
+    if (result == 0) return;
+
+    upstream_complete(owner, result > 0);
+    drive_context(server, owner);
+}
+
+// 连接定时器到期
+static void on_connection_timer(TimerNode *node, void *arg) {
+    HttpServer *server = arg;
+    HttpContext *ctx;
+
+    if (node->tag == HTTP_TIMER_TAG_PHASE) {
+        ctx = (HttpContext*)((char*)node - offsetof(HttpContext, phase_timer));
+
+        if (ctx->timer_phase == HTTP_TIMER_STREAM_FLUSH) {
+            // 上游暂时没有新 token: 发出已合并的部分
+            if (!ctx->upstream.active || http_chunk_flush(ctx->upstream.writer) >= 0) return;
+            upstream_complete(ctx, 0);
+            drive_context(server, ctx);
+            return;
+        }
+        if (ctx->timer_phase == HTTP_TIMER_BATCH) {
+            // 批窗口结束或已凑满
+            if (!ctx->upstream.batch_open) return;
+            batch_flush(ctx);
+            drive_context(server, ctx);
+            return;
+        }
+        if (ctx->state != HTTP_STATE_READING) return;
+
+        if (ctx->timer_phase == HTTP_TIMER_IDLE) {
+            HTTP_TRACE("[HTTP] Idle timeout\n");
+            ctx->state = HTTP_STATE_CLOSING;
+        } else {
+            HTTP_TRACE("[HTTP] %s read timeout\n", ctx->timer_phase == HTTP_TIMER_HEADER ? "Header" : "Body");
+            timer_cancel(&server->timers, &ctx->request_timer);
+            ctx->keep_alive = 0;
+            create_response(ctx, 408, "application/json", "{\"error\":\"Request timeout\"}");
+            ctx->state = HTTP_STATE_RESPONDING;
+        }
     } else {
-        // 部分发送，继续
-        // TODO: 处理部分发送
-        ctx->state = HTTP_STATE_CLOSING;
+        ctx = (HttpContext*)((char*)node - offsetof(HttpContext, request_timer));
+        HTTP_TRACE("[HTTP] Request deadline exceeded\n");
+
+        if (ctx->state == HTTP_STATE_READING) {
+            timer_cancel(&server->timers, &ctx->phase_timer);
+            ctx->keep_alive = 0;
+            create_response(ctx, 408, "application/json", "{\"error\":\"Request timeout\"}");
+            ctx->state = HTTP_STATE_RESPONDING;
+        } else if (ctx->state == HTTP_STATE_PROCESSING && ctx->admission.queued) {
+            admission_remove(&server->admission, &ctx->admission);
+            const char *body = "{\"error\":504,\"message\":\"Request timed out in queue\"}";
+            create_response(ctx, 504, "application/json", body);
+            ctx->state = HTTP_STATE_RESPONDING;
+        } else if (ctx->state == HTTP_STATE_PROCESSING && ctx->upstream.active) {
+            // 上游未能在本请求的截止时间前完成: 跟随者的截止时间可能更晚，调用交给它们继续
+            HttpContext *heir = flight_handoff(ctx);
+            if (!heir) {
+                backend_report(ctx->upstream.backend, ctx->upstream.trial, 0);
+                upstream_detach(ctx, 0);
+                flight_complete(ctx, 0, NULL);
+            }
+            timer_cancel(&server->timers, &ctx->phase_timer);
+            if (ctx->upstream.writer && ctx->upstream.writer->header_sent) {
+                ctx->state = HTTP_STATE_CLOSING;
+            } else {
+                ctx->keep_alive = 0;
+                create_response(ctx, 504, "application/json", "{\"error\":\"Upstream timeout\"}");
+                ctx->state = HTTP_STATE_RESPONDING;
+            }
+            drive_context(server, ctx);
+            if (heir) stream_resume(server, heir);
+            return;
+        } else if (ctx->state == HTTP_STATE_PROCESSING && ctx->upstream.batch_open) {
+            // 批窗口尚未结束 (窗口远小于截止时间，通常不会发生)
+            if (!flight_handoff(ctx)) {
+                batch_cancel(ctx);
+                flight_complete(ctx, 0, NULL);
+            }
+            timer_cancel(&server->timers, &ctx->phase_timer);
+            ctx->keep_alive = 0;
+            create_response(ctx, 504, "application/json", "{\"error\":\"Upstream timeout\"}");
+            ctx->state = HTTP_STATE_RESPONDING;
+        } else if (ctx->state == HTTP_STATE_PROCESSING && ctx->upstream.leader) {
+            // 跟随的调用未能在本请求的截止时间前完成
+            HttpContext *leader = ctx->upstream.leader;
+            flight_leave(ctx);
+            timer_cancel(&server->timers, &ctx->phase_timer);
+            if (ctx->upstream.writer && ctx->upstream.writer->header_sent) {
+                ctx->state = HTTP_STATE_CLOSING;
+            } else {
+                ctx->keep_alive = 0;
+                create_response(ctx, 504, "application/json", "{\"error\":\"Upstream timeout\"}");
+                ctx->state = HTTP_STATE_RESPONDING;
+            }
+            drive_context(server, ctx);
+            // 离开的可能正是阻塞上游读取的客户端
+            stream_resume(server, leader);
+            return;
+        } else if (ctx->state == HTTP_STATE_RESPONDING) {
+            // 客户端不读取响应
+            ctx->state = HTTP_STATE_CLOSING;
+        } else {
+            return;
+        }
     }
+
+    drive_context(server, ctx);
 }
 
-// FSM: 关闭连接
-void http_handle_closing(HttpContext *ctx) {
-    close(ctx->client_fd);
-    ctx->client_fd = -1;
-    ctx->state = HTTP_STATE_IDLE;
-    printf("[HTTP] Connection closed\n");
+// 主事件循环: 处理一轮就绪事件
+void http_server_run(HttpServer *server, int timeout_ms) {
+    struct epoll_event events[HTTP_MAX_EVENTS];
+
+    // 有请求排队时缩短等待，以便及时获得其他 worker 释放的并发
+    if (server->admission.count > 0 && timeout_ms > HTTP_QUEUE_POLL_MS) {
+        timeout_ms = HTTP_QUEUE_POLL_MS;
+    }
+
+    // 不晚于下一个定时器槽位醒来
+    int timer_timeout = timer_wheel_timeout(&server->timers, now_ms());
+    if (timer_timeout >= 0 && timer_timeout < timeout_ms) {
+        timeout_ms = timer_timeout;
+    }
+
+    int n = epoll_wait(server->epoll_fd, events, HTTP_MAX_EVENTS, timeout_ms);
+    if (n < 0) {
+        if (errno != EINTR) {
+            perror("epoll_wait failed");
+        }
+        return;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (events[i].data.ptr == NULL) {
+            accept_connections(server);
+            continue;
+        }
+
+        if (*(HttpEventKind*)events[i].data.ptr == HTTP_EVENT_UPSTREAM) {
+            // 上游调用可能已在本轮中结束 (客户端关闭或超时)
+            HttpUpstream *up = events[i].data.ptr;
+            if (up->active) {
+                on_upstream_event(server, up);
+            }
+            continue;
+        }
+
+        HttpContext *ctx = events[i].data.ptr;
+        if (ctx->state == HTTP_STATE_IDLE) {
+            // 本轮中已被关闭
+            continue;
+        }
+
+        if ((events[i].events & (EPOLLERR | EPOLLHUP)) &&
+            ctx->state != HTTP_STATE_READING) {
+            ctx->state = HTTP_STATE_CLOSING;
+        }
+
+        // 流式: 可写 (或关闭) 后输出队列可能已回落，恢复调用发起者的上游读取
+        HttpContext *owner = ctx->upstream.leader ? ctx->upstream.leader : ctx;
+        drive_context(server, ctx);
+        stream_resume(server, owner);
+    }
+
+    timer_wheel_advance(&server->timers, now_ms(), on_connection_timer, server);
+    drain_admission(server);
 }
 
-// 主事件循环
-void http_server_run(HttpContext *ctx) {
-    while (1) {
-        switch (ctx->state) {
-            case HTTP_STATE_IDLE:
-                http_handle_idle(ctx);
-                break;
-            case HTTP_STATE_READING:
-                http_handle_reading(ctx);
-                break;
-            case HTTP_STATE_PROCESSING:
-                http_handle_processing(ctx);
-                break;
-            case HTTP_STATE_RESPONDING:
-                http_handle_responding(ctx);
-                break;
-            case HTTP_STATE_CLOSING:
-                http_handle_closing(ctx);
-                break;
+// 关闭所有连接并释放连接池
+void http_server_cleanup(HttpServer *server) {
+    if (server->contexts) {
+        for (int i = 0; i < server->max_connections; i++) {
+            if (server->contexts[i].client_fd >= 0) {
+                upstream_detach(&server->contexts[i], 0);
+                http_out_reset(&server->contexts[i]);
+                release_request_buffer(&server->contexts[i]);
+                close(server->contexts[i].client_fd);
+            }
+            arena_destroy(&server->contexts[i].arena);
         }
+        free(server->contexts);
+        server->contexts = NULL;
+    }
 
-        // 避免忙等待
-        usleep(1000);  // 1ms
+    if (server->epoll_fd >= 0) {
+        close(server->epoll_fd);
+        server->epoll_fd = -1;
     }
 }
 
 // 启动 HTTP 服务器
-int http_server_start(int port) {
+int http_server_start(int port, int backlog) {
     int server_fd;
     struct sockaddr_in address;
 
@@ -222,6 +2078,12 @@ int http_server_start(int port) {
     // 设置 socket 选项
     int opt = 1;
     setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+#ifdef SO_REUSEPORT
+    // 内核在绑定同一端口的多个 socket 之间分发新连接
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        perror("setsockopt SO_REUSEPORT failed");
+    }
+#endif
 
     // 绑定地址
     address.sin_family = AF_INET;
@@ -234,61 +2096,274 @@ int http_server_start(int port) {
         return -1;
     }
 
+    // 事件循环要求非阻塞监听 socket
+    if (set_nonblocking(server_fd) < 0) {
+        perror("fcntl failed");
+        close(server_fd);
+        return -1;
+    }
+
     // 监听
-    if (listen(server_fd, 3) < 0) {
+    if (listen(server_fd, backlog > 0 ? backlog : SOMAXCONN) < 0) {
         perror("listen failed");
         close(server_fd);
         return -1;
     }
 
-    printf("[HTTP] Server started on port %d\n", port);
     return server_fd;
 }
 
-// 发送 chunked 响应头
-int http_send_chunked_header(int client_fd, const char *content_type) {
-    char header[256];
-    int len = snprintf(header, sizeof(header),
-        "HTTP/1.1 200 OK\r\n"
-        "Content-Type: %s\r\n"
-        "Transfer-Encoding: chunked\r\n"
-        "Connection: close\r\n"
-        "\r\n",
-        content_type
-    );
+// Worker 线程: 运行独立的事件循环，请求路径上没有共享锁
+static void* worker_main(void *arg) {
+    HttpServer *server = arg;
 
-    return send(client_fd, header, len, 0);
+    while (server->workers->running) {
+        http_server_run(server, 100);
+    }
+
+    buffer_pool_thread_exit();
+    return NULL;
 }
 
-// 发送一个数据块
-int http_send_chunk(int client_fd, const char *data, size_t len) {
-    char chunk_header[32];
+// 启动 worker 池
+int http_workers_start(HttpWorkers *workers, const HttpServerConfig *config) {
+    int count = config->workers;
+    int port = config->port;
+    int max_connections = config->max_connections;
 
-    // 格式: {size_hex}\r\n
-    snprintf(chunk_header, sizeof(chunk_header), "%zx\r\n", len);
+    memset(workers, 0, sizeof(*workers));
 
-    // 发送 chunk header
-    if (send(client_fd, chunk_header, strlen(chunk_header), 0) < 0) {
+#ifndef SO_REUSEPORT
+    // 不支持监听分片时退化为单 worker
+    count = 1;
+#endif
+    if (count < 1) count = 1;
+    if (count > HTTP_MAX_WORKERS) count = HTTP_MAX_WORKERS;
+
+    workers->servers = calloc(count, sizeof(HttpServer));
+    workers->threads = calloc(count, sizeof(pthread_t));
+    if (!workers->servers || !workers->threads) {
+        free(workers->servers);
+        free(workers->threads);
         return -1;
     }
 
-    // 发送 chunk data
-    if (len > 0 && send(client_fd, data, len, 0) < 0) {
-        return -1;
+    int per_worker = (max_connections + count - 1) / count;
+    HttpServerConfig worker_config = *config;
+    worker_config.workers = count;
+    workers->running = 1;
+
+    for (int i = 0; i < count; i++) {
+        int server_fd = http_server_start(port, max_connections);
+        if (server_fd < 0) {
+            http_workers_stop(workers);
+            return -1;
+        }
+
+        HttpServer *server = &workers->servers[i];
+        if (http_server_init(server, server_fd, per_worker, &worker_config) < 0) {
+            close(server_fd);
+            http_workers_stop(workers);
+            return -1;
+        }
+        server->worker_id = i;
+        server->workers = workers;
+
+        if (pthread_create(&workers->threads[i], NULL, worker_main, server) != 0) {
+            perror("pthread_create failed");
+            http_server_cleanup(server);
+            close(server_fd);
+            http_workers_stop(workers);
+            return -1;
+        }
+        workers->count++;
+    }
+
+    printf("[HTTP] Server started on port %d (%d worker%s, %d connections each)\n",
+           port, count, count > 1 ? "s" : "", per_worker);
+    return 0;
+}
+
+// 停止并回收所有 worker
+void http_workers_stop(HttpWorkers *workers) {
+    workers->running = 0;
+
+    for (int i = 0; i < workers->count; i++) {
+        pthread_join(workers->threads[i], NULL);
+        int server_fd = workers->servers[i].server_fd;
+        http_server_cleanup(&workers->servers[i]);
+        close(server_fd);
+    }
+
+    free(workers->servers);
+    free(workers->threads);
+    workers->servers = NULL;
+    workers->threads = NULL;
+    workers->count = 0;
+}
+
+// 汇总所有 worker 的活跃请求数
+int http_workers_active_requests(const HttpWorkers *workers) {
+    int total = 0;
+    for (int i = 0; i < workers->count; i++) {
+        total += __atomic_load_n(&workers->servers[i].active_requests, __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+// 流式写入器
+void http_chunk_writer_init(HttpChunkWriter *w, HttpContext *ctx, int keep_alive, const char *content_type,
+                            int coalesce_bytes, int coalesce_ms) {
+    memset(w, 0, sizeof(*w));
+    w->ctx = ctx;
+    w->keep_alive = keep_alive;
+    w->content_type = content_type;
+    w->coalesce_bytes = (coalesce_bytes > HTTP_STREAM_COALESCE_MAX) ? HTTP_STREAM_COALESCE_MAX
+                                                                   : coalesce_bytes;
+    w->coalesce_ms = coalesce_ms;
+}
+
+// 发出一帧: [响应头 (首帧)] + 长度行 + 数据 + \r\n [+ 终止 chunk]
+// 追加到连接的输出队列后尝试发送一次，socket 已满时剩余部分等待 EPOLLOUT (不阻塞事件循环)
+static int chunk_writer_emit(HttpChunkWriter *w, const char *data, size_t len, int last) {
+    BufferChain *out = &w->ctx->out.stream;
+    char header[256];
+    int result = 0;
+
+    if (w->failed) return -1;
+
+    if (!w->header_sent) {
+        int header_len = snprintf(header, sizeof(header),
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: %s\r\n"
+            "Transfer-Encoding: chunked\r\n"
+            "Connection: %s\r\n"
+            "\r\n",
+            w->content_type, w->keep_alive ? "keep-alive" : "close"
+        );
+        result |= buffer_chain_append(out, header, header_len);
+        w->header_sent = 1;
+    }
+
+    if (len > 0) {
+        char chunk_header[32];
+        int chunk_header_len = snprintf(chunk_header, sizeof(chunk_header), "%zx\r\n", len);
+        result |= buffer_chain_append(out, chunk_header, chunk_header_len);
+        result |= buffer_chain_append(out, data, len);
+        result |= buffer_chain_append(out, "\r\n", 2);
+    }
+
+    if (last) {
+        result |= buffer_chain_append(out, "0\r\n\r\n", 5);
     }
 
-    // 发送 \r\n
-    if (send(client_fd, "\r\n", 2, 0) < 0) {
+    // 超过队列上限 (客户端长期不读) 或发送出错
+    if (result < 0 || http_out_flush(w->ctx) < 0) {
+        w->failed = 1;
         return -1;
     }
+    w->frames++;
+    return 0;
+}
+
+// 输出队列超过高水位 (失败的写入器不再发送，不计入)
+static int chunk_writer_blocked(const HttpChunkWriter *w) {
+    for (const HttpChunkWriter *cur = w; cur; cur = cur->next) {
+        if (!cur->failed && cur->ctx->out.stream.len > HTTP_STREAM_HIGH_WATER) return 1;
+    }
+    return 0;
+}
+
+// 发送已合并的数据
+static int chunk_flush_one(HttpChunkWriter *w) {
+    if (w->pending_len == 0) return w->failed ? -1 : 0;
+
+    int result = chunk_writer_emit(w, w->pending, w->pending_len, 0);
+    w->pending_len = 0;
+    return result;
+}
+
+// 写入一个 token: 合并模式下缓存到 N 字节或延迟上限，否则立即作为一帧发送
+static int chunk_write_one(HttpChunkWriter *w, const char *data, size_t len) {
+    if (w->failed) return -1;
+    w->bytes += len;
+
+    if (w->coalesce_bytes <= 0) {
+        return chunk_writer_emit(w, data, len, 0);
+    }
+
+    if (w->pending_len + len > (size_t)w->coalesce_bytes) {
+        if (chunk_flush_one(w) < 0) return -1;
+        if (len >= (size_t)w->coalesce_bytes) {
+            return chunk_writer_emit(w, data, len, 0);
+        }
+    }
+
+    if (w->pending_len == 0) {
+        w->pending_since_ms = now_ms();
+    }
+    memcpy(w->pending + w->pending_len, data, len);
+    w->pending_len += len;
 
+    if (w->pending_len >= (size_t)w->coalesce_bytes ||
+        now_ms() - w->pending_since_ms >= w->coalesce_ms) {
+        return chunk_flush_one(w);
+    }
     return 0;
 }
 
-// 结束 chunked 响应
-int http_send_chunk_end(int client_fd) {
-    // 发送终止 chunk: 0\r\n\r\n
-    return send(client_fd, "0\r\n\r\n", 5, 0);
+// 距离必须 flush 的剩余毫秒数，无缓存数据时返回 -1
+static int chunk_timeout_one(const HttpChunkWriter *w) {
+    if (w->pending_len == 0) return -1;
+    long long remaining = w->pending_since_ms + w->coalesce_ms - now_ms();
+    return (remaining > 0) ? (int)remaining : 0;
+}
+
+// 结束流: 剩余数据与终止 chunk 合并为一帧
+static int chunk_end_one(HttpChunkWriter *w) {
+    int result = chunk_writer_emit(w, w->pending, w->pending_len, 1);
+    w->pending_len = 0;
+    if (result == 0) w->finished = 1;
+    return result;
+}
+
+int http_chunk_flush(HttpChunkWriter *w) {
+    int alive = 0;
+    for (HttpChunkWriter *cur = w; cur; cur = cur->next) {
+        if (chunk_flush_one(cur) == 0) alive = 1;
+    }
+    return alive ? 0 : -1;
+}
+
+int http_chunk_write(HttpChunkWriter *w, const char *data, size_t len) {
+    if (len == 0) return 0;
+
+    if (w->replay && buffer_chain_append(w->replay, data, len) < 0) {
+        w->replay = NULL;   // 超出上限: 不再接受新的跟随者
+    }
+
+    int alive = 0;
+    for (HttpChunkWriter *cur = w; cur; cur = cur->next) {
+        if (chunk_write_one(cur, data, len) == 0) alive = 1;
+    }
+    return alive ? 0 : -1;
+}
+
+int http_chunk_writer_timeout(const HttpChunkWriter *w) {
+    int timeout = -1;
+    for (const HttpChunkWriter *cur = w; cur; cur = cur->next) {
+        int t = chunk_timeout_one(cur);
+        if (t >= 0 && (timeout < 0 || t < timeout)) timeout = t;
+    }
+    return timeout;
+}
+
+int http_chunk_end(HttpChunkWriter *w) {
+    int alive = 0;
+    for (HttpChunkWriter *cur = w; cur; cur = cur->next) {
+        if (chunk_end_one(cur) == 0) alive = 1;
+    }
+    return alive ? 0 : -1;
 }
 
 // 发送错误响应
@@ -304,11 +2379,12 @@ int http_send_error(int client_fd, int code, const char *message) {
         "Content-Length: %zu\r\n"
         "Connection: close\r\n"
         "\r\n",
-        code, (code == 503) ? "Service Unavailable" : "Error", strlen(body)
+        code, status_text(code), strlen(body)
     );
 
-    send(client_fd, header, header_len, 0);
-    send(client_fd, body, strlen(body), 0);
-
-    return 0;
+    struct iovec iov[2] = {
+        { .iov_base = header, .iov_len = header_len },
+        { .iov_base = body, .iov_len = strlen(body) }
+    };
+    return (writev(client_fd, iov, 2) < 0) ? -1 : 0;
 }
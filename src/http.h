@@ -6,45 +6,259 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include "http_parser.h"
+#include "http_route.h"
+#include "admission.h"
+#include "arena.h"
+#include "timer_wheel.h"
+#include "upstream.h"
+#include "ollama.h"
+#include "backend.h"
 
-#define HTTP_MAX_REQUEST 4096
-#define HTTP_MAX_RESPONSE 8192
+#define HTTP_MAX_REQUEST 4096              // 内联请求缓冲区
+#define HTTP_MAX_BODY (1024 * 1024)         // 大 body 溢出到堆上，最大 1MB
+#define HTTP_MAX_HEADER 512
+#define HTTP_MAX_IOV 16
+#define HTTP_MAX_EVENTS 64
+#define HTTP_KEEPALIVE_TIMEOUT_MS 5000
+#define HTTP_HEADER_TIMEOUT_MS 10000      // 请求头必须在此时间内读完 (防 slowloris)
+#define HTTP_BODY_TIMEOUT_MS 30000        // 请求头之后 body 必须在此时间内读完
+#define HTTP_KEEPALIVE_MAX_REQUESTS 100
+#define HTTP_MAX_WORKERS 64
+#define HTTP_DEFAULT_MAX_INFLIGHT 10      // 未配置 max_inflight 时的后端并发上限
+#define HTTP_STREAM_COALESCE_MAX 4096     // 流式合并缓冲区上限
+#define HTTP_STREAM_COALESCE_MS 20        // 默认合并延迟上限
+#define HTTP_STREAM_HIGH_WATER (64 * 1024)     // 流式: 输出队列超过此值时暂停读取上游
+#define HTTP_STREAM_OUT_MAX (2 * 1024 * 1024)   // 流式: 输出队列上限 (含补发给跟随者的 token)
+#define HTTP_BATCH_MAX 8                  // 默认每批最多的提示数
+#define HTTP_BATCH_WINDOW_MS 5            // 默认批收集窗口
 
 typedef enum {
-    HTTP_STATE_IDLE,        // 等待连接
+    HTTP_STATE_IDLE,        // 空闲 (未分配)
     HTTP_STATE_READING,     // 读取请求
-    HTTP_STATE_PROCESSING,  // 处理请求
+    HTTP_STATE_PROCESSING,  // 处理请求 (含等待准入和上游响应)
     HTTP_STATE_RESPONDING,  // 发送响应
     HTTP_STATE_CLOSING      // 关闭连接
 } HttpState;
 
+// 连接阶段定时器 (同一时刻只有一个阶段生效)
+typedef enum {
+    HTTP_TIMER_IDLE,        // keep-alive 等待下一个请求
+    HTTP_TIMER_HEADER,      // 读取请求头
+    HTTP_TIMER_BODY,        // 读取 body
+    HTTP_TIMER_STREAM_FLUSH,// 流式响应: 合并的 token 到期发出
+    HTTP_TIMER_BATCH        // 微批处理: 收集窗口结束
+} HttpTimerPhase;
+
+// epoll 事件来源 (data.ptr 指向的结构体第一个成员)
+typedef enum {
+    HTTP_EVENT_CLIENT,
+    HTTP_EVENT_UPSTREAM
+} HttpEventKind;
+
+struct HttpServer;
+struct HttpWorkers;
+
+// 输出队列: 待发送的 iovec，EAGAIN 后可从断点继续 writev
 typedef struct {
-    int server_fd;          // 服务器 socket
+    struct iovec iov[HTTP_MAX_IOV];
+    void *owned[HTTP_MAX_IOV];  // 发送完成后需 free 的缓冲区 (NULL = 不释放)
+    int head;                   // 第一个未发送完的 iovec
+    int count;
+    BufferChain stream;         // 流式响应的帧 (排在 iovec 之后，socket 可写时继续发送)
+} HttpOutQueue;
+
+// 进行中的上游调用: 上游 socket 注册在 worker 的 epoll 中，不阻塞事件循环
+typedef struct HttpUpstream {
+    HttpEventKind kind;     // HTTP_EVENT_UPSTREAM (必须为第一个成员)
+    struct HttpContext *ctx;
+    UpstreamCall *call;     // 分配在请求 arena 中
+    Backend *backend;       // 选中的副本 (结束时 backend_release)
+    int trial;              // 本请求持有半开副本的试探名额 (只有它的结果决定熔断器)
+    int active;
+    int retried;            // 已注册的连接对应的 call->retried
+    int chat;
+    BufferChain out;        // 非流式: 响应 body (块来自缓冲池)
+    OllamaStream *stream;   // 流式: NDJSON 解析状态 (非流式为 NULL)
+    struct HttpChunkWriter *writer;
+    int paused;             // 流式: 客户端输出队列超过高水位，暂停读取上游
+    long long started_ms;
+    // single-flight: 相同的并发请求共享一次上游调用
+    unsigned long long flight_hash;
+    const char *flight_model;       // 键 (分配在请求 arena 中)
+    const char *flight_input;
+    const char *flight_options;     // "options" 对象 (NULL = 未提供)
+    int flight_stream;
+    struct HttpUpstream *flight_next;   // 本 worker 进行中的调用
+    struct HttpContext *followers;      // 等待同一结果的请求
+    struct HttpContext *leader;         // 跟随者: 发起调用的请求 (NULL = 不是跟随者)
+    struct HttpContext *next_follower;
+    BufferChain replay;     // 流式: 已发出的 token，补发给后加入的跟随者
+    const char *cache_key;  // 成功的回复写入响应缓存 (NULL = 不缓存)
+    size_t cache_key_len;
+    SessionContext *session;    // 会话请求: 成功后追加本轮对话 (结束时释放引用)
+    const char *session_input;
+    const char *session_model;
+    BufferChain context;    // 流式 generate 会话: 最后一行返回的 context 数组内容
+    // 微批处理: 成员是发起者的跟随者 (batch_index > 0)，各自取 choices[] 中的一项
+    int batch_open;         // 发起者: 正在收集，上游调用尚未发送
+    int batch_count;        // 发起者: 提示数 (含自身)
+    int batch_index;        // 成员: 在提示数组中的位置
+    char **batch_replies;   // 发起者: 按位置拆分的回复 (分配在发起者 arena 中)
+    struct HttpUpstream *batch_next;    // 本 worker 正在收集的批
+} HttpUpstream;
+
+// 单个连接的上下文
+typedef struct HttpContext {
+    HttpEventKind kind;     // HTTP_EVENT_CLIENT (必须为第一个成员)
     int client_fd;          // 客户端 socket
-    HttpState state;        // 当前状态
-    char request[HTTP_MAX_REQUEST];
-    char response[HTTP_MAX_RESPONSE];
+    unsigned int client_addr;   // 对端 IPv4 地址 (网络字节序，未提供 API key 时的限流键)
+    unsigned long long rate_client; // 本请求的限流键 (0 = 未限流)
+    HttpState state;        // 当前状态 (排队或等待上游时为 PROCESSING)
+    char *request;          // 指向 request_inline 或堆上的溢出缓冲区
+    char request_inline[HTTP_MAX_REQUEST];
+    int request_cap;
     int request_len;
-    int response_len;
+    HttpRequestParser parser;   // 增量解析状态 (字段为 request 中的偏移量)
+    int continue_sent;      // 已回复 100 Continue
+    char header[HTTP_MAX_HEADER];  // 响应头 (body 直接挂入输出队列)
+    HttpOutQueue out;       // 响应输出队列
+    Arena arena;            // 请求级分配 (响应发送完毕后统一释放)
+    int keep_alive;         // 响应后保持连接
+    AdmissionNode admission;    // 准入队列节点
+    int admitted;           // 已通过准入 (出队后重新处理时跳过检查)
+    long long request_start_ms; // 请求第一个字节到达的时间 (截止时间起点)
+    int requests_served;    // 本连接已处理的请求数
+    TimerNode phase_timer;  // 空闲 / 请求头 / body 截止时间
+    HttpTimerPhase timer_phase;
+    TimerNode request_timer;    // 整个请求 (到响应发送完毕) 的截止时间
+    HttpUpstream upstream;  // LLM 请求的上游调用
+    struct HttpServer *server; // 所属 worker
+    struct HttpContext *next_free;
 } HttpContext;
 
+// 服务器 (每个 worker 一个): 监听 socket + epoll + 连接池
+typedef struct HttpServer {
+    int server_fd;          // 服务器 socket
+    int epoll_fd;           // epoll 实例
+    HttpContext *contexts;  // 连接上下文池 (max_connections 个)
+    HttpContext *free_list;
+    int max_connections;
+    int active_connections;
+    int keepalive_timeout_ms;
+    int header_timeout_ms;
+    int body_timeout_ms;
+    TimerWheel timers;      // 连接截止时间
+    HttpRouter router;      // 路由表 (每个 worker 一份，只读)
+    AdmissionQueue admission;   // LLM 请求等待队列 (本 worker)
+    int max_inflight;       // 全局 LLM 并发上限
+    int timeout_ms;         // 请求截止时间
+    int stream_coalesce_bytes;  // 流式 token 合并阈值 (0 = 每个 token 一帧)
+    int stream_coalesce_ms;     // 流式 token 合并延迟上限
+    BackendGroup *backends;     // 后端副本组 (所有 worker 共享)
+    HttpUpstream *flights;      // 进行中的上游调用 (single-flight 查找)
+    HttpUpstream *batches;      // 正在收集的批 (每个 model 最多一个)
+    int batch_max;              // 每批最多的提示数 (<= 1 = 关闭)
+    int batch_window_ms;        // 收集窗口
+    int worker_id;
+    volatile int active_requests;   // 仅由本 worker 线程修改
+    volatile int class_active[ADMISSION_CLASSES];   // 按类别的活跃请求数 (同上)
+    int class_caps[ADMISSION_CLASSES];  // 按类别的全局并发上限
+    struct HttpWorkers *workers;    // 所属 worker 池 (可为 NULL)
+} HttpServer;
+
+// 服务器配置 (来自平台预设和命令行)
+typedef struct {
+    int port;
+    int workers;            // worker 线程数
+    int max_connections;    // 连接总数，在 worker 之间平均分配
+    int max_inflight;       // 同时进行的 LLM 请求上限 (所有 worker 合计)
+    int queue_depth;        // 等待队列深度 (所有 worker 合计)
+    int timeout_ms;         // 请求截止时间 (从请求到达开始计算)
+    int stream_coalesce_bytes;  // 流式 token 合并阈值 (0 = 关闭)
+    int stream_coalesce_ms;     // 合并延迟上限 (默认 HTTP_STREAM_COALESCE_MS)
+    int batch_max;              // OpenAI 兼容 /v1/completions 每批最多的提示数 (<= 1 = 关闭)
+    int batch_window_ms;        // 收集窗口 (默认 HTTP_BATCH_WINDOW_MS)
+    int class_weights[ADMISSION_CLASSES];   // 类别调度权重 (0 = 默认)
+    int class_caps[ADMISSION_CLASSES];      // 类别并发上限，max_inflight 的百分比 (0 = 默认)
+    BackendGroup *backends;     // LLM 请求按负载均衡策略分发到这些副本
+} HttpServerConfig;
+
+// 流式 chunked 写入器: 每帧追加到连接的输出队列后立即尝试发送 (不等待可写)，可选按字节数/延迟合并 token
+typedef struct HttpChunkWriter {
+    struct HttpContext *ctx;    // 所属连接
+    int keep_alive;
+    const char *content_type;
+    int header_sent;        // 响应头随第一帧发出
+    int finished;           // 已发送终止 chunk
+    int failed;
+    int coalesce_bytes;
+    int coalesce_ms;
+    char pending[HTTP_STREAM_COALESCE_MAX];
+    size_t pending_len;
+    long long pending_since_ms;
+    int frames;             // 已发送帧数 (统计)
+    size_t bytes;           // 已写入的 token 字节数 (限流估算)
+    struct HttpChunkWriter *next;   // single-flight: 跟随者的写入器 (收到相同的 token)
+    BufferChain *replay;    // 记录写入的 token (NULL = 不记录或已超出上限)
+} HttpChunkWriter;
+
+// Worker 池: 每个线程拥有独立的 SO_REUSEPORT 监听 socket 和事件循环
+typedef struct HttpWorkers {
+    HttpServer *servers;
+    pthread_t *threads;
+    int count;
+    volatile int running;
+} HttpWorkers;
+
+// 输出队列: 追加缓冲区 (owned = 发送后 free)，返回 -1 表示队列已满
+int http_out_push(HttpContext *ctx, const void *data, size_t len, int owned);
+
+// 输出队列: writev 发送 (先 iovec 再流式帧)，返回 1 = 全部发送, 0 = EAGAIN, -1 = 错误
+int http_out_flush(HttpContext *ctx);
+
+// 输出队列: 丢弃未发送数据并释放持有的缓冲区
+void http_out_reset(HttpContext *ctx);
+
 // FSM 状态处理函数
-void http_handle_idle(HttpContext *ctx);
 void http_handle_reading(HttpContext *ctx);
 void http_handle_processing(HttpContext *ctx);
 void http_handle_responding(HttpContext *ctx);
 void http_handle_closing(HttpContext *ctx);
 
-// 主事件循环
-void http_server_run(HttpContext *ctx);
+// 初始化事件循环 (连接池、等待队列大小取自 config 中本 worker 的份额)
+int http_server_init(HttpServer *server, int server_fd, int max_connections,
+                     const HttpServerConfig *config);
+
+// 事件循环: 处理一轮 epoll 事件，最多等待 timeout_ms
+void http_server_run(HttpServer *server, int timeout_ms);
+
+// 关闭所有连接并释放连接池
+void http_server_cleanup(HttpServer *server);
+
+// 启动 HTTP 服务器 (设置 SO_REUSEPORT，允许多个 worker 绑定同一端口)
+int http_server_start(int port, int backlog);
+
+// 启动 worker 线程，连接数和队列深度在 worker 之间平均分配
+int http_workers_start(HttpWorkers *workers, const HttpServerConfig *config);
+
+// 停止并回收所有 worker
+void http_workers_stop(HttpWorkers *workers);
+
+// 汇总所有 worker 的活跃请求数 (无锁读取)
+int http_workers_active_requests(const HttpWorkers *workers);
 
-// 启动 HTTP 服务器
-int http_server_start(int port);
+// 流式写入器 (写入、flush 和结束作用于整条 next 链，全部失败时才返回 -1)
+void http_chunk_writer_init(HttpChunkWriter *w, HttpContext *ctx, int keep_alive, const char *content_type,
+                            int coalesce_bytes, int coalesce_ms);
+int http_chunk_write(HttpChunkWriter *w, const char *data, size_t len);
+int http_chunk_flush(HttpChunkWriter *w);
+int http_chunk_end(HttpChunkWriter *w);
 
-// Chunked streaming support
-int http_send_chunk(int client_fd, const char *data, size_t len);
-int http_send_chunk_end(int client_fd);
-int http_send_chunked_header(int client_fd, const char *content_type);
+// 距离必须 flush 合并数据的毫秒数 (-1 = 无缓存数据)，用作 flush 定时器的时长
+int http_chunk_writer_timeout(const HttpChunkWriter *w);
 
 // Error responses
 int http_send_error(int client_fd, int code, const char *message);
@@ -0,0 +1,251 @@
+#include "http_parser.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// 初始化解析器
+void http_parser_init(HttpRequestParser *p, long max_body) {
+    memset(p, 0, sizeof(*p));
+    p->state = HTTP_PARSE_REQUEST_LINE;
+    p->content_length = -1;
+    p->max_body = max_body;
+}
+
+// 比较 slice 与字符串
+int http_slice_eq(const char *buf, HttpSlice slice, const char *str) {
+    size_t n = strlen(str);
+    return (size_t)slice.len == n && memcmp(buf + slice.off, str, n) == 0;
+}
+
+static int fail(HttpRequestParser *p, HttpParseError error) {
+    p->state = HTTP_PARSE_ERROR;
+    p->error = error;
+    return -1;
+}
+
+// 值中是否包含 token (不区分大小写)
+static int value_has_token(const char *value, int len, const char *token) {
+    size_t n = strlen(token);
+    for (int i = 0; i + (int)n <= len; i++) {
+        if (strncasecmp(value + i, token, n) == 0) return 1;
+    }
+    return 0;
+}
+
+// 解析请求行: METHOD SP PATH SP VERSION
+static int parse_request_line(HttpRequestParser *p, const char *buf, int start, int end) {
+    const char *line = buf + start;
+    int len = end - start;
+
+    const char *sp1 = memchr(line, ' ', len);
+    if (!sp1) return -1;
+    const char *sp2 = memchr(sp1 + 1, ' ', len - (sp1 + 1 - line));
+    if (!sp2) return -1;
+
+    p->method.off = start;
+    p->method.len = (int)(sp1 - line);
+    p->path.off = start + (int)(sp1 + 1 - line);
+    p->path.len = (int)(sp2 - sp1 - 1);
+    p->version.off = start + (int)(sp2 + 1 - line);
+    p->version.len = end - p->version.off;
+
+    if (p->method.len == 0 || p->path.len == 0 || p->version.len != 8 ||
+        strncmp(buf + p->version.off, "HTTP/1.", 7) != 0) {
+        return -1;
+    }
+
+    // HTTP/1.1 默认保持连接, HTTP/1.0 需显式 keep-alive
+    p->keep_alive = buf[p->version.off + 7] != '0';
+    return 0;
+}
+
+// 解析一个请求头，并记录影响分帧的字段
+static int parse_header_line(HttpRequestParser *p, const char *buf, int start, int end) {
+    const char *line = buf + start;
+    const char *colon = memchr(line, ':', end - start);
+    if (!colon || colon == line) return HTTP_PARSE_BAD_REQUEST;
+
+    if (p->header_count >= HTTP_MAX_HEADERS) return HTTP_PARSE_HEADERS_TOO_LARGE;
+
+    int value_off = start + (int)(colon + 1 - line);
+    while (value_off < end && (buf[value_off] == ' ' || buf[value_off] == '\t')) value_off++;
+    int value_end = end;
+    while (value_end > value_off && (buf[value_end - 1] == ' ' || buf[value_end - 1] == '\t')) value_end--;
+
+    HttpHeader *h = &p->headers[p->header_count++];
+    h->name.off = start;
+    h->name.len = (int)(colon - line);
+    h->value.off = value_off;
+    h->value.len = value_end - value_off;
+
+    const char *value = buf + value_off;
+    int value_len = h->value.len;
+
+    if (h->name.len == 14 && strncasecmp(line, "Content-Length", 14) == 0) {
+        char *num_end;
+        long n = strtol(value, &num_end, 10);
+        if (num_end == value || num_end != buf + value_end || n < 0) {
+            return HTTP_PARSE_BAD_REQUEST;
+        }
+        if (n > p->max_body) return HTTP_PARSE_BODY_TOO_LARGE;
+        p->content_length = n;
+    } else if (h->name.len == 17 && strncasecmp(line, "Transfer-Encoding", 17) == 0) {
+        p->transfer_encoding = 1;
+        p->chunked = value_has_token(value, value_len, "chunked");
+    } else if (h->name.len == 10 && strncasecmp(line, "Connection", 10) == 0) {
+        if (value_has_token(value, value_len, "close")) {
+            p->keep_alive = 0;
+        } else if (value_has_token(value, value_len, "keep-alive")) {
+            p->keep_alive = 1;
+        }
+    } else if (h->name.len == 6 && strncasecmp(line, "Expect", 6) == 0) {
+        p->expect_continue = value_has_token(value, value_len, "100-continue");
+    }
+
+    return HTTP_PARSE_OK;
+}
+
+// 请求头结束: 决定 body 的分帧方式
+static int finish_headers(HttpRequestParser *p) {
+    // 同时带 Transfer-Encoding 和 Content-Length 时分帧有歧义 (请求走私)，
+    // 作为中间层直接拒绝 (RFC 9112 §6.1)
+    if (p->transfer_encoding && p->content_length >= 0) {
+        return fail(p, HTTP_PARSE_BAD_REQUEST);
+    }
+
+    p->header_len = p->pos;
+    p->body.off = p->pos;
+    p->body.len = 0;
+
+    if (p->chunked) {
+        p->state = HTTP_PARSE_CHUNK_SIZE;
+    } else if (p->content_length > 0) {
+        p->state = HTTP_PARSE_BODY;
+    } else {
+        p->frame_len = p->pos;
+        p->state = HTTP_PARSE_DONE;
+    }
+    return 0;
+}
+
+// 处理一个完整的行 [start, end) (已去掉 \r\n)
+static int handle_line(HttpRequestParser *p, const char *buf, int start, int end) {
+    switch (p->state) {
+        case HTTP_PARSE_REQUEST_LINE:
+            if (start == end) return 0;  // 容忍请求前的空行
+            if (parse_request_line(p, buf, start, end) < 0) {
+                return fail(p, HTTP_PARSE_BAD_REQUEST);
+            }
+            p->state = HTTP_PARSE_HEADERS;
+            return 0;
+
+        case HTTP_PARSE_HEADERS: {
+            if (start == end) return finish_headers(p);
+            int err = parse_header_line(p, buf, start, end);
+            if (err != HTTP_PARSE_OK) return fail(p, err);
+            return 0;
+        }
+
+        case HTTP_PARSE_CHUNK_SIZE: {
+            char *size_end;
+            long size = strtol(buf + start, &size_end, 16);
+            if (size_end == buf + start || size < 0) {
+                return fail(p, HTTP_PARSE_BAD_REQUEST);
+            }
+            if (size == 0) {
+                p->state = HTTP_PARSE_TRAILERS;
+            } else if (p->body.len + size > p->max_body) {
+                return fail(p, HTTP_PARSE_BODY_TOO_LARGE);
+            } else {
+                p->chunk_remaining = size;
+                p->state = HTTP_PARSE_CHUNK_DATA;
+            }
+            return 0;
+        }
+
+        case HTTP_PARSE_CHUNK_CRLF:
+            if (start != end) return fail(p, HTTP_PARSE_BAD_REQUEST);
+            p->state = HTTP_PARSE_CHUNK_SIZE;
+            return 0;
+
+        case HTTP_PARSE_TRAILERS:
+            if (start == end) {
+                p->frame_len = p->pos;
+                p->state = HTTP_PARSE_DONE;
+            }
+            return 0;
+
+        default:
+            return fail(p, HTTP_PARSE_BAD_REQUEST);
+    }
+}
+
+// 增量解析: 每个字节只扫描一次
+int http_parser_execute(HttpRequestParser *p, char *buf, int len) {
+    while (p->state != HTTP_PARSE_DONE && p->state != HTTP_PARSE_ERROR) {
+        if (p->state == HTTP_PARSE_BODY) {
+            long end = p->body.off + p->content_length;
+            if (len < end) {
+                p->pos = len;
+                return 0;
+            }
+            p->body.len = (int)p->content_length;
+            p->pos = p->frame_len = (int)end;
+            p->state = HTTP_PARSE_DONE;
+            break;
+        }
+
+        if (p->state == HTTP_PARSE_CHUNK_DATA) {
+            int avail = len - p->pos;
+            int n = (avail < p->chunk_remaining) ? avail : (int)p->chunk_remaining;
+
+            // 原位拼接 chunk 数据 (目标总在源之前)
+            memmove(buf + p->body.off + p->body.len, buf + p->pos, n);
+            p->body.len += n;
+            p->pos += n;
+            p->chunk_remaining -= n;
+
+            if (p->chunk_remaining > 0) return 0;
+            p->line_start = p->pos;
+            p->state = HTTP_PARSE_CHUNK_CRLF;
+            continue;
+        }
+
+        // 基于行的状态: 只在新字节中查找 \n
+        const char *nl = memchr(buf + p->pos, '\n', len - p->pos);
+        if (!nl) {
+            p->pos = len;
+            if (p->header_len == 0 && len > HTTP_MAX_HEADER_BYTES) {
+                return fail(p, HTTP_PARSE_HEADERS_TOO_LARGE);
+            }
+            return 0;
+        }
+
+        int start = p->line_start;
+        int end = (int)(nl - buf);
+        p->pos = p->line_start = end + 1;
+        if (end > start && buf[end - 1] == '\r') end--;
+
+        if (p->header_len == 0 && p->pos > HTTP_MAX_HEADER_BYTES) {
+            return fail(p, HTTP_PARSE_HEADERS_TOO_LARGE);
+        }
+
+        if (handle_line(p, buf, start, end) < 0) return -1;
+    }
+
+    return (p->state == HTTP_PARSE_DONE) ? 1 : -1;
+}
+
+// 查找请求头 (不区分大小写)
+const char* http_parser_header(const HttpRequestParser *p, const char *buf,
+                               const char *name, int *value_len) {
+    size_t n = strlen(name);
+    for (int i = 0; i < p->header_count; i++) {
+        const HttpHeader *h = &p->headers[i];
+        if ((size_t)h->name.len == n && strncasecmp(buf + h->name.off, name, n) == 0) {
+            *value_len = h->value.len;
+            return buf + h->value.off;
+        }
+    }
+    return NULL;
+}
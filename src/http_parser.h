@@ -0,0 +1,83 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <stddef.h>
+
+// 增量 HTTP 请求解析器
+// 只扫描新到达的字节，所有字段以偏移量记录在调用者的缓冲区中 (不复制)，
+// 因此缓冲区在两次调用之间可以 realloc。
+
+#define HTTP_MAX_HEADERS 32
+#define HTTP_MAX_HEADER_BYTES 4096
+
+typedef enum {
+    HTTP_PARSE_REQUEST_LINE,
+    HTTP_PARSE_HEADERS,
+    HTTP_PARSE_BODY,            // Content-Length body
+    HTTP_PARSE_CHUNK_SIZE,      // chunked: 长度行
+    HTTP_PARSE_CHUNK_DATA,      // chunked: 数据
+    HTTP_PARSE_CHUNK_CRLF,      // chunked: 数据后的 \r\n
+    HTTP_PARSE_TRAILERS,        // chunked: 结尾 trailer
+    HTTP_PARSE_DONE,
+    HTTP_PARSE_ERROR
+} HttpParseState;
+
+typedef enum {
+    HTTP_PARSE_OK = 0,
+    HTTP_PARSE_BAD_REQUEST,
+    HTTP_PARSE_HEADERS_TOO_LARGE,
+    HTTP_PARSE_BODY_TOO_LARGE
+} HttpParseError;
+
+// 缓冲区中的一段 [off, off + len)
+typedef struct {
+    int off;
+    int len;
+} HttpSlice;
+
+typedef struct {
+    HttpSlice name;
+    HttpSlice value;
+} HttpHeader;
+
+typedef struct {
+    HttpParseState state;
+    HttpParseError error;
+    int pos;                    // 下一个未扫描的字节
+    int line_start;             // 当前行起始位置
+
+    HttpSlice method;
+    HttpSlice path;
+    HttpSlice version;
+    HttpHeader headers[HTTP_MAX_HEADERS];
+    int header_count;
+    int header_len;             // 请求头总长度 (含空行)
+
+    long content_length;        // -1 = 未指定
+    int chunked;
+    int transfer_encoding;      // 出现过 Transfer-Encoding 头
+    int keep_alive;
+    int expect_continue;
+
+    HttpSlice body;             // chunked body 在原位解码为连续数据
+    long chunk_remaining;
+    long max_body;              // body 上限
+
+    int frame_len;              // 本请求在缓冲区中占用的总字节数
+} HttpRequestParser;
+
+// 初始化解析器 (max_body = body 最大字节数)
+void http_parser_init(HttpRequestParser *p, long max_body);
+
+// 解析 buf[p->pos, len) 中的新数据
+// 返回 1 = 请求完整, 0 = 需要更多数据, -1 = 错误 (见 p->error)
+int http_parser_execute(HttpRequestParser *p, char *buf, int len);
+
+// 查找请求头 (不区分大小写)，返回值的起始指针
+const char* http_parser_header(const HttpRequestParser *p, const char *buf,
+                               const char *name, int *value_len);
+
+// 比较 slice 与字符串
+int http_slice_eq(const char *buf, HttpSlice slice, const char *str);
+
+#endif
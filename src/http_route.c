@@ -0,0 +1,124 @@
+#include "http_route.h"
+#include <string.h>
+
+#define ROUTE_MAX_KEY 128
+
+// 405 判定时尝试的方法
+static const char *const known_methods[] = { "GET", "POST", "PUT", "DELETE", NULL };
+
+// FNV-1a，带种子
+static uint32_t route_hash(uint32_t seed, const char *method, int method_len,
+                           const char *path, int path_len) {
+    uint32_t h = 2166136261u ^ seed;
+    for (int i = 0; i < method_len; i++) {
+        h = (h ^ (uint8_t)method[i]) * 16777619u;
+    }
+    h = (h ^ ' ') * 16777619u;
+    for (int i = 0; i < path_len; i++) {
+        h = (h ^ (uint8_t)path[i]) * 16777619u;
+    }
+    return h;
+}
+
+static int route_matches(const HttpRoute *r, const char *method, int method_len,
+                         const char *path, int path_len) {
+    return (int)strlen(r->method) == method_len &&
+           memcmp(r->method, method, method_len) == 0 &&
+           (int)strlen(r->path) == path_len &&
+           memcmp(r->path, path, path_len) == 0;
+}
+
+// 构建完美哈希表
+int http_router_init(HttpRouter *router, const HttpRoute *routes, int count) {
+    if (count * 2 > HTTP_ROUTE_SLOTS) return -1;
+
+    for (uint32_t seed = 0; seed < 4096; seed++) {
+        memset(router->slots, 0, sizeof(router->slots));
+        router->seed = seed;
+
+        int ok = 1;
+        for (int i = 0; i < count && ok; i++) {
+            const HttpRoute *r = &routes[i];
+            uint32_t slot = route_hash(seed, r->method, strlen(r->method),
+                                       r->path, strlen(r->path)) & (HTTP_ROUTE_SLOTS - 1);
+            if (router->slots[slot]) {
+                ok = 0;  // 冲突 (或重复路由)，换下一个种子
+            } else {
+                router->slots[slot] = r;
+            }
+        }
+
+        if (ok) return 0;
+    }
+
+    return -1;
+}
+
+static const HttpRoute* find_exact(const HttpRouter *router, const char *method, int method_len,
+                                   const char *path, int path_len) {
+    uint32_t slot = route_hash(router->seed, method, method_len, path, path_len) &
+                    (HTTP_ROUTE_SLOTS - 1);
+    const HttpRoute *r = router->slots[slot];
+    return (r && route_matches(r, method, method_len, path, path_len)) ? r : NULL;
+}
+
+// 精确匹配，失败时把最后一个路径段替换为 "*" 再匹配一次
+static const HttpRoute* find_route(const HttpRouter *router, const char *method, int method_len,
+                                   const char *path, int path_len,
+                                   const char **param, int *param_len) {
+    *param = NULL;
+    *param_len = 0;
+
+    const HttpRoute *r = find_exact(router, method, method_len, path, path_len);
+    if (r) return r;
+
+    const char *slash = NULL;
+    for (int i = path_len - 1; i > 0; i--) {
+        if (path[i] == '/') {
+            slash = path + i;
+            break;
+        }
+    }
+    if (!slash || slash == path + path_len - 1) return NULL;
+
+    int prefix_len = (int)(slash - path) + 1;
+    if (prefix_len + 1 > ROUTE_MAX_KEY) return NULL;
+
+    char key[ROUTE_MAX_KEY];
+    memcpy(key, path, prefix_len);
+    key[prefix_len] = '*';
+
+    r = find_exact(router, method, method_len, key, prefix_len + 1);
+    if (r) {
+        *param = slash + 1;
+        *param_len = path_len - prefix_len;
+    }
+    return r;
+}
+
+// 按方法和路径查找
+HttpRouteResult http_router_lookup(const HttpRouter *router,
+                                   const char *method, int method_len,
+                                   const char *path, int path_len,
+                                   const HttpRoute **route,
+                                   const char **param, int *param_len) {
+    // 忽略查询字符串
+    const char *query = memchr(path, '?', path_len);
+    if (query) path_len = (int)(query - path);
+
+    *route = find_route(router, method, method_len, path, path_len, param, param_len);
+    if (*route) return HTTP_ROUTE_FOUND;
+
+    // 路径存在但方法不匹配 -> 405
+    for (int i = 0; known_methods[i]; i++) {
+        const char *p;
+        int plen;
+        int mlen = (int)strlen(known_methods[i]);
+        if (mlen == method_len && memcmp(known_methods[i], method, mlen) == 0) continue;
+        if (find_route(router, known_methods[i], mlen, path, path_len, &p, &plen)) {
+            return HTTP_ROUTE_METHOD_NOT_ALLOWED;
+        }
+    }
+
+    return HTTP_ROUTE_NOT_FOUND;
+}
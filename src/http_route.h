@@ -0,0 +1,44 @@
+#ifndef HTTP_ROUTE_H
+#define HTTP_ROUTE_H
+
+#include <stdint.h>
+
+// 路由表: "METHOD path" 的完美哈希
+// 初始化时搜索一个使所有路由无冲突的种子，查找为一次哈希 + 一次比较。
+// 路径以 "/*" 结尾的路由匹配一个尾部参数段 (例如 /sensors/temp1)。
+
+#define HTTP_ROUTE_SLOTS 64   // 必须是 2 的幂，且不小于路由数的 2 倍
+
+struct HttpContext;
+
+// 路由处理函数: param 为 "/*" 匹配到的路径段 (无参数时 len = 0)
+typedef void (*HttpRouteHandler)(struct HttpContext *ctx, const char *param, int param_len);
+
+typedef struct {
+    const char *method;
+    const char *path;
+    HttpRouteHandler handler;
+} HttpRoute;
+
+typedef struct {
+    const HttpRoute *slots[HTTP_ROUTE_SLOTS];
+    uint32_t seed;
+} HttpRouter;
+
+typedef enum {
+    HTTP_ROUTE_FOUND,
+    HTTP_ROUTE_NOT_FOUND,           // 404
+    HTTP_ROUTE_METHOD_NOT_ALLOWED   // 405
+} HttpRouteResult;
+
+// 构建完美哈希表，失败返回 -1 (路由过多或重复)
+int http_router_init(HttpRouter *router, const HttpRoute *routes, int count);
+
+// 按方法和路径查找 (不读取 body)
+HttpRouteResult http_router_lookup(const HttpRouter *router,
+                                   const char *method, int method_len,
+                                   const char *path, int path_len,
+                                   const HttpRoute **route,
+                                   const char **param, int *param_len);
+
+#endif
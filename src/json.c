@@ -0,0 +1,470 @@
+#include "json.h"
+#include <stdio.h>
+#include <string.h>
+
+// 解析状态
+enum {
+    JSON_ST_VALUE,              // 期待一个值 (根、':' 或数组中 ',' 之后)
+    JSON_ST_VALUE_OR_END,       // '[' 之后
+    JSON_ST_KEY,                // 对象中 ',' 之后
+    JSON_ST_KEY_OR_END,         // '{' 之后
+    JSON_ST_IN_KEY,
+    JSON_ST_COLON,
+    JSON_ST_IN_STRING,
+    JSON_ST_IN_NUMBER,
+    JSON_ST_IN_LITERAL,
+    JSON_ST_AFTER_VALUE,        // 期待 ',' 或右括号 (根: 下一个值，用于 NDJSON)
+    JSON_ST_ERROR
+};
+
+// 初始化
+void json_parser_init(JsonParser *parser) {
+    memset(parser, 0, sizeof(*parser));
+    parser->state = JSON_ST_VALUE;
+}
+
+// 编码为 UTF-8
+static int utf8_encode(unsigned cp, char *out) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+// \uXXXX 解码完成: 代理对合并，孤立代理替换为 U+FFFD
+static int unescape_codepoint(JsonUnescape *u, unsigned cp, char *out) {
+    int n = 0;
+    if (cp >= 0xD800 && cp <= 0xDBFF) {
+        if (u->high_surrogate) n = utf8_encode(0xFFFD, out);
+        u->high_surrogate = cp;
+        return n;
+    }
+    if (cp >= 0xDC00 && cp <= 0xDFFF) {
+        cp = u->high_surrogate ? 0x10000 + ((u->high_surrogate - 0xD800) << 10) + (cp - 0xDC00) : 0xFFFD;
+    } else if (u->high_surrogate) {
+        n = utf8_encode(0xFFFD, out);
+    }
+    u->high_surrogate = 0;
+    return n + utf8_encode(cp, out + n);
+}
+
+// 反转义一个字节
+int json_unescape_byte(JsonUnescape *u, char c, char *out) {
+    if (u->hex_left > 0) {
+        int digit = (c >= '0' && c <= '9') ? c - '0' :
+                    (c >= 'a' && c <= 'f') ? c - 'a' + 10 :
+                    (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+        u->codepoint = (digit < 0) ? 0xFFFD : (u->codepoint << 4) | (unsigned)digit;
+        if (digit < 0) u->hex_left = 1;
+        if (--u->hex_left > 0) return 0;
+        return unescape_codepoint(u, u->codepoint, out);
+    }
+
+    if (u->escape) {
+        u->escape = 0;
+        switch (c) {
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case 'r': c = '\r'; break;
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'u':
+                u->hex_left = 4;
+                u->codepoint = 0;
+                return 0;
+            default: break;     // \" \\ \/ 原样
+        }
+    } else if (c == '\\') {
+        u->escape = 1;
+        return 0;
+    }
+
+    int n = 0;
+    if (u->high_surrogate) {
+        n = utf8_encode(0xFFFD, out);
+        u->high_surrogate = 0;
+    }
+    out[n++] = c;
+    return n;
+}
+
+// 字符串结束
+int json_unescape_end(JsonUnescape *u, char *out) {
+    int n = u->high_surrogate ? utf8_encode(0xFFFD, out) : 0;
+    memset(u, 0, sizeof(*u));
+    return n;
+}
+
+// 路径回到第 depth 层容器自身 (开始该层的下一个元素)
+static void path_reset(JsonParser *p, int depth) {
+    p->path_len = p->mark[depth];
+    if (p->overflow_depth && depth <= p->overflow_depth) p->overflow_depth = 0;
+}
+
+// 追加路径内容，放不下时标记溢出 (直到开始同层的下一个元素)
+static void path_append(JsonParser *p, const char *s, size_t len) {
+    if (p->overflow_depth) return;
+    if (p->path_len + len > JSON_MAX_PATH) {
+        p->overflow_depth = p->depth;
+        p->path_len = p->mark[p->depth];
+        return;
+    }
+    memcpy(p->path + p->path_len, s, len);
+    p->path_len += len;
+}
+
+// 键的一个解码后字节 ('~' 和 '/' 按 RFC 6901 转义)
+static void path_append_key(JsonParser *p, const char *s, int len) {
+    for (int i = 0; i < len; i++) {
+        if (s[i] == '~') path_append(p, "~0", 2);
+        else if (s[i] == '/') path_append(p, "~1", 2);
+        else path_append(p, &s[i], 1);
+    }
+}
+
+static int emit(JsonParser *p, JsonCallback cb, void *user, JsonType type, int depth,
+                const char *data, size_t len, int partial) {
+    JsonEvent event;
+    p->path[p->path_len] = '\0';
+    event.type = type;
+    event.path = p->overflow_depth ? NULL : p->path;
+    event.depth = depth;
+    event.data = data;
+    event.len = len;
+    event.partial = partial;
+    return cb(&event, user);
+}
+
+// 一个值开始: 数组元素的路径为下标
+static void begin_value(JsonParser *p) {
+    if (p->depth > 0 && !p->object[p->depth]) {
+        char index[16];
+        int len = snprintf(index, sizeof(index), "/%u", p->index[p->depth]++);
+        path_reset(p, p->depth);
+        path_append(p, index, len);
+    }
+}
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static int is_number_char(char c) {
+    return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+}
+
+// 解析一段输入
+int json_feed(JsonParser *p, const char *data, size_t len, JsonCallback cb, void *user) {
+    size_t i = 0;
+
+    while (i < len) {
+        char c = data[i];
+
+        switch (p->state) {
+        case JSON_ST_IN_STRING: {
+            // 快速扫描到结束引号，整段内容作为一个片段
+            size_t start = i;
+            while (i < len) {
+                c = data[i];
+                if (p->escape) p->escape = 0;
+                else if (c == '\\') p->escape = 1;
+                else if (c == '"') break;
+                i++;
+            }
+            if (i == len) {
+                if (i > start && emit(p, cb, user, JSON_STRING, p->depth, data + start, i - start, 1)) return 1;
+                return 0;
+            }
+            if (emit(p, cb, user, JSON_STRING, p->depth, data + start, i - start, 0)) return 1;
+            p->state = JSON_ST_AFTER_VALUE;
+            i++;
+            continue;
+        }
+
+        case JSON_ST_IN_NUMBER: {
+            size_t start = i;
+            while (i < len && is_number_char(data[i])) i++;
+            if (i == len) {
+                if (emit(p, cb, user, JSON_NUMBER, p->depth, data + start, i - start, 1)) return 1;
+                return 0;
+            }
+            if (emit(p, cb, user, JSON_NUMBER, p->depth, data + start, i - start, 0)) return 1;
+            p->state = JSON_ST_AFTER_VALUE;
+            continue;           // 分隔符由下一个状态处理
+        }
+
+        case JSON_ST_IN_LITERAL:
+            if (c != p->literal[p->literal_pos]) goto error;
+            i++;
+            if (p->literal[++p->literal_pos] == '\0') {
+                if (emit(p, cb, user, p->literal_type, p->depth, NULL, 0, 0)) return 1;
+                p->state = JSON_ST_AFTER_VALUE;
+            }
+            continue;
+
+        case JSON_ST_IN_KEY: {
+            char out[JSON_UTF8_MAX];
+            i++;
+            if (c == '"' && !p->key.escape && p->key.hex_left == 0) {
+                path_append_key(p, out, json_unescape_end(&p->key, out));
+                p->state = JSON_ST_COLON;
+            } else {
+                path_append_key(p, out, json_unescape_byte(&p->key, c, out));
+            }
+            continue;
+        }
+
+        default:
+            break;
+        }
+
+        i++;
+        if (is_space(c)) continue;
+
+        switch (p->state) {
+        case JSON_ST_COLON:
+            if (c != ':') goto error;
+            p->state = JSON_ST_VALUE;
+            continue;
+
+        case JSON_ST_KEY_OR_END:
+        case JSON_ST_KEY:
+            if (c == '"') {
+                path_reset(p, p->depth);
+                path_append(p, "/", 1);
+                p->state = JSON_ST_IN_KEY;
+                continue;
+            }
+            if (c == '}' && p->state == JSON_ST_KEY_OR_END) break;
+            goto error;
+
+        case JSON_ST_AFTER_VALUE:
+            if (p->depth == 0) break;   // 根: 下一个值
+            if (c == ',') {
+                p->state = p->object[p->depth] ? JSON_ST_KEY : JSON_ST_VALUE;
+                continue;
+            }
+            if (c == '}' || c == ']') break;
+            goto error;
+
+        case JSON_ST_VALUE_OR_END:
+            if (c == ']') break;
+            p->state = JSON_ST_VALUE;
+            break;
+
+        case JSON_ST_VALUE:
+            if (c == '}' || c == ']') goto error;
+            break;
+
+        default:
+            goto error;
+        }
+
+        // 右括号
+        if (c == '}' || c == ']') {
+            if (p->depth == 0 || p->object[p->depth] != (c == '}')) goto error;
+            path_reset(p, p->depth);
+            p->depth--;
+            if (emit(p, cb, user, c == '}' ? JSON_OBJECT_END : JSON_ARRAY_END, p->depth,
+                     data + i - 1, 1, 0)) return 1;
+            p->state = JSON_ST_AFTER_VALUE;
+            continue;
+        }
+
+        // 值的开始
+        begin_value(p);
+        switch (c) {
+        case '{':
+        case '[':
+            if (p->depth == JSON_MAX_DEPTH) goto error;
+            if (emit(p, cb, user, c == '{' ? JSON_OBJECT : JSON_ARRAY, p->depth, data + i - 1, 1, 0)) return 1;
+            p->depth++;
+            p->object[p->depth] = (c == '{');
+            p->index[p->depth] = 0;
+            p->mark[p->depth] = (unsigned short)p->path_len;
+            p->state = (c == '{') ? JSON_ST_KEY_OR_END : JSON_ST_VALUE_OR_END;
+            break;
+        case '"':
+            p->escape = 0;
+            p->state = JSON_ST_IN_STRING;
+            break;
+        case 't':
+        case 'f':
+        case 'n':
+            p->literal = (c == 't') ? "true" : (c == 'f') ? "false" : "null";
+            p->literal_type = (c == 't') ? JSON_TRUE : (c == 'f') ? JSON_FALSE : JSON_NULL;
+            p->literal_pos = 1;
+            p->state = JSON_ST_IN_LITERAL;
+            break;
+        default:
+            if (c != '-' && (c < '0' || c > '9')) goto error;
+            p->state = JSON_ST_IN_NUMBER;
+            i--;                // 数字从当前字节开始
+            break;
+        }
+    }
+    return 0;
+
+error:
+    p->state = JSON_ST_ERROR;
+    return -1;
+}
+
+// 输入结束
+int json_finish(JsonParser *p, JsonCallback cb, void *user) {
+    if (p->state == JSON_ST_IN_NUMBER) {
+        if (emit(p, cb, user, JSON_NUMBER, p->depth, "", 0, 0)) return 0;
+        p->state = JSON_ST_AFTER_VALUE;
+    }
+    return (p->state == JSON_ST_AFTER_VALUE && p->depth == 0) ? 0 : -1;
+}
+
+typedef struct {
+    JsonField *fields;
+    int count;
+    int found;
+} ScanState;
+
+static int scan_event(const JsonEvent *event, void *user) {
+    ScanState *scan = user;
+    if (!event->path) return 0;
+
+    for (int i = 0; i < scan->count; i++) {
+        JsonValue *value = &scan->fields[i].value;
+        if (strcmp(event->path, scan->fields[i].pointer) != 0) continue;
+
+        if (event->type == JSON_OBJECT_END || event->type == JSON_ARRAY_END) {
+            // 容器结束: 补全原始文本的长度
+            if ((value->type == JSON_OBJECT || value->type == JSON_ARRAY) && value->len == 0) {
+                value->len = (size_t)(event->data + 1 - value->data);
+                scan->found++;
+            }
+            continue;
+        }
+        if (value->type != JSON_NONE) continue;
+
+        value->type = event->type;
+        value->data = event->data;
+        value->len = event->len;
+        if (event->type == JSON_TRUE) value->data = "true", value->len = 4;
+        if (event->type == JSON_FALSE) value->data = "false", value->len = 5;
+        if (event->type == JSON_NULL) value->data = "null", value->len = 4;
+        if (event->type == JSON_OBJECT || event->type == JSON_ARRAY) {
+            value->len = 0;     // 结束时补全
+            continue;
+        }
+        scan->found++;
+    }
+    // 片段未结束 (不完整的输入) 时不提前结束，由 json_finish 判断
+    return !event->partial && scan->found == scan->count;
+}
+
+// 一次遍历提取多个字段
+int json_scan(const char *json, size_t len, JsonField *fields, int count) {
+    ScanState scan = { fields, count, 0 };
+    for (int i = 0; i < count; i++) {
+        memset(&fields[i].value, 0, sizeof(JsonValue));
+    }
+    if (!json) return -1;
+
+    JsonParser parser;
+    json_parser_init(&parser);
+    int result = json_feed(&parser, json, len, scan_event, &scan);
+    if (result == 0) result = json_finish(&parser, scan_event, &scan);
+    return (result < 0) ? -1 : scan.found;
+}
+
+// 提取单个字段
+int json_find(const char *json, size_t len, const char *pointer, JsonValue *value) {
+    JsonField field = { pointer, { JSON_NONE, NULL, 0 } };
+    int found = json_scan(json, len, &field, 1);
+    *value = field.value;
+    return (found == 1) ? 0 : -1;
+}
+
+// 字符串值复制到 arena
+char* json_string(Arena *arena, const JsonValue *value) {
+    if (value->type != JSON_STRING) return NULL;
+    return arena_strndup(arena, value->data, value->len);
+}
+
+// 片段追加到定长缓冲区
+int json_append(char *dst, size_t size, const JsonEvent *event) {
+    size_t used = strlen(dst);
+    size_t room = size - used - 1;
+    size_t len = (event->len < room) ? event->len : room;
+    memcpy(dst + used, event->data, len);
+    dst[used + len] = '\0';
+    return (len < event->len) ? -1 : 0;
+}
+
+typedef struct {
+    JsonCallback cb;
+    void *user;
+    const char *array;          // 记录数组的路径
+    int items;                  // 记录所在层数 (-1 = 不在记录数组中)
+    int depth;                  // 当前记录所在层数 (-1 = 不在记录中)
+    size_t prefix;              // 记录自身路径的长度
+} RecordState;
+
+// 转发记录内的事件 (路径和层数改为相对于记录)
+static int record_event(const JsonEvent *event, void *user) {
+    RecordState *rec = user;
+
+    if (rec->depth < 0) {
+        if (event->type == JSON_ARRAY && rec->items < 0 && event->path &&
+            (event->depth == 0 || strcmp(event->path, rec->array) == 0)) {
+            rec->items = event->depth + 1;
+        } else if (event->type == JSON_ARRAY_END && event->depth + 1 == rec->items) {
+            rec->items = -1;
+        }
+        if (event->type != JSON_OBJECT || event->depth != rec->items || !event->path) return 0;
+        rec->depth = event->depth;
+        rec->prefix = strlen(event->path);
+    }
+
+    JsonEvent relative = *event;
+    relative.depth -= rec->depth;
+    if (relative.path) relative.path += rec->prefix;
+    int result = rec->cb(&relative, rec->user);
+
+    if (event->type == JSON_OBJECT_END && event->depth == rec->depth) rec->depth = -1;
+    return result;
+}
+
+// 读取记录文件
+int json_load_records(const char *filename, const char *array, JsonCallback cb, void *user) {
+    FILE *fp = fopen(filename, "r");
+    if (!fp) return -1;
+
+    RecordState rec = { cb, user, array, -1, -1, 0 };
+    JsonParser parser;
+    json_parser_init(&parser);
+
+    char buf[512];
+    size_t n;
+    int result = 0;
+    while (result == 0 && (n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        result = json_feed(&parser, buf, n, record_event, &rec);
+    }
+    fclose(fp);
+
+    if (result == 0) result = json_finish(&parser, record_event, &rec);
+    return (result < 0) ? -1 : 0;
+}
@@ -0,0 +1,109 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stddef.h>
+#include "arena.h"
+
+// 流式 JSON 解析 (SAX): 输入可以分段 feed，状态跨段保留，每个字节只扫描一次。
+// 每个值产生一个带类型的事件，附带其 JSON pointer 路径 ("/choices/0/text")。
+// 字符串和数字不复制: 事件直接指向输入中的原始内容 (字符串不反转义，可原样嵌入 JSON 输出)，
+// 跨越 feed 边界的值分成多个片段 (partial)。解析器大小固定，不分配内存。
+
+#define JSON_MAX_DEPTH 32       // 最大嵌套层数 (超过视为语法错误)
+#define JSON_MAX_PATH 256       // 路径最大长度 (超过时事件的 path 为 NULL)
+#define JSON_UTF8_MAX 8         // json_unescape_byte 单次最多输出的字节数
+
+typedef enum {
+    JSON_NONE,                  // (JsonValue: 字段不存在)
+    JSON_OBJECT,                // 对象开始
+    JSON_OBJECT_END,
+    JSON_ARRAY,                 // 数组开始
+    JSON_ARRAY_END,
+    JSON_STRING,
+    JSON_NUMBER,
+    JSON_TRUE,
+    JSON_FALSE,
+    JSON_NULL
+} JsonType;
+
+typedef struct {
+    JsonType type;
+    const char *path;           // 值的 JSON pointer ("" = 根)，以 \0 结尾; 过长时为 NULL
+    int depth;                  // 值所在的容器层数 (根 = 0)
+    const char *data;           // 字符串: 引号内的原始内容; 数字: 文本; 对象 / 数组: 指向括号
+    size_t len;
+    int partial;                // 1 = 值在本段输入末尾尚未结束，后续片段在下次 feed 中
+} JsonEvent;
+
+// 事件回调: 返回非 0 停止解析
+typedef int (*JsonCallback)(const JsonEvent *event, void *user);
+
+// 增量反转义 (处理 \n、\uXXXX 和代理对，孤立代理替换为 U+FFFD)
+typedef struct {
+    int escape;
+    int hex_left;
+    unsigned codepoint;
+    unsigned high_surrogate;
+} JsonUnescape;
+
+typedef struct {
+    int state;
+    int depth;
+    unsigned char object[JSON_MAX_DEPTH + 1];   // 每层容器: 1 = 对象, 0 = 数组
+    unsigned index[JSON_MAX_DEPTH + 1];         // 数组下一个元素的下标
+    unsigned short mark[JSON_MAX_DEPTH + 1];    // 每层容器自身路径的长度
+    char path[JSON_MAX_PATH + 1];
+    size_t path_len;
+    int overflow_depth;         // 路径在该层溢出 (0 = 未溢出)
+    int escape;                 // 字符串值中刚读到反斜杠
+    JsonUnescape key;           // 键的解码状态 (键写入路径)
+    const char *literal;        // true / false / null
+    int literal_pos;
+    JsonType literal_type;
+} JsonParser;
+
+void json_parser_init(JsonParser *parser);
+
+// 解析一段输入: 0 = 已全部消费, 1 = 回调要求停止, -1 = 语法错误
+int json_feed(JsonParser *parser, const char *data, size_t len, JsonCallback cb, void *user);
+
+// 输入结束 (结束末尾的数字): 0 = 完整的 JSON, -1 = 不完整或有语法错误
+int json_finish(JsonParser *parser, JsonCallback cb, void *user);
+
+// 反转义一个字节 (字符串内容，不含引号)，输出写入 out (至少 JSON_UTF8_MAX 字节)，返回输出字节数
+int json_unescape_byte(JsonUnescape *u, char c, char *out);
+
+// 字符串结束: 输出未配对的代理并复位状态
+int json_unescape_end(JsonUnescape *u, char *out);
+
+// 完整文档中的一个值 (零拷贝，指向输入)
+typedef struct {
+    JsonType type;              // JSON_NONE = 不存在; 对象 / 数组为 JSON_OBJECT / JSON_ARRAY
+    const char *data;           // 字符串: 引号内的原始内容; 其他: 值的原始文本 (容器含括号)
+    size_t len;
+} JsonValue;
+
+typedef struct {
+    const char *pointer;        // 如 "/message/content"
+    JsonValue value;
+} JsonField;
+
+// 一次遍历提取多个字段 (全部找到后提前结束，重复的键取第一个)
+// 返回找到的字段数，语法错误返回 -1
+int json_scan(const char *json, size_t len, JsonField *fields, int count);
+
+// 提取单个字段: 找到返回 0
+int json_find(const char *json, size_t len, const char *pointer, JsonValue *value);
+
+// 字符串值复制到 arena (保持转义形式)，不是字符串返回 NULL
+char* json_string(Arena *arena, const JsonValue *value);
+
+// 字符串 / 数字片段追加到定长缓冲区 (以 \0 结尾)，截断返回 -1
+int json_append(char *dst, size_t size, const JsonEvent *event);
+
+// 读取记录文件: array 处的对象数组 (如 {"rules":[...]} 中的 "/rules") 或根数组，每个元素是一条记录。
+// 文件按块读取，回调只收到记录内的事件，路径和层数相对于记录 (记录本身为 "" / 0)，
+// 记录结束时收到 path 为 "" 的 JSON_OBJECT_END。文件打不开或语法错误返回 -1
+int json_load_records(const char *filename, const char *array, JsonCallback cb, void *user);
+
+#endif
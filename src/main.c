@@ -2,18 +2,33 @@
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
+#include <unistd.h>
 #include "config.h"
 #include "http.h"
 #include "mem-profile.h"
 #include "backend.h"
+#include "upstream.h"
+#include "buffer.h"
+#include "resolver.h"
+#include "health.h"
+#include "cache.h"
+#include "ratelimit.h"
 #include "platform.h"
+#include "sensor.h"
+#include "actuator.h"
+#include "rule.h"
 
 // 全局上下文
 static volatile int running = 1;
 
-// Task 3: Request Queue (using preset configuration)
-volatile int active_requests = 0;
-static int max_concurrent_requests = 10;  // Will be set by preset
+// Task 3: Request Queue (backend concurrency; preset queue_depth bounds waiting requests)
+static int max_concurrent_requests = 10;
+static int stream_coalesce_bytes = 0;
+static int stream_coalesce_ms = HTTP_STREAM_COALESCE_MS;
+static int batch_max = HTTP_BATCH_MAX;
+static int batch_window_ms = HTTP_BATCH_WINDOW_MS;
+static int class_weights[ADMISSION_CLASSES];   // 0 = 默认
+static int class_caps[ADMISSION_CLASSES];
 
 // 信号处理
 void sigint_handler(int sig __attribute__((unused))) {
@@ -21,6 +36,22 @@ void sigint_handler(int sig __attribute__((unused))) {
     running = 0;
 }
 
+// 解析 "interactive,automation,batch" 三个整数，返回 -1 表示格式错误
+static int parse_class_list(const char *arg, int *out) {
+    int values[ADMISSION_CLASSES];
+    const char *p = arg;
+    for (int i = 0; i < ADMISSION_CLASSES; i++) {
+        char *end;
+        long value = strtol(p, &end, 10);
+        if (end == p || value <= 0 || value > 1000) return -1;
+        if (*end != (i + 1 < ADMISSION_CLASSES ? ',' : '\0')) return -1;
+        values[i] = (int)value;
+        p = end + 1;
+    }
+    memcpy(out, values, sizeof(values));
+    return 0;
+}
+
 void print_usage(const char *prog) {
     printf("Q-Lite v%s - Ultra-lightweight LLM gateway\n", Q_LITE_VERSION);
     printf("Inspired by nanochat (Karpathy), llama2.c, ESP32-LLM, PicoClaw\n\n");
@@ -30,8 +61,38 @@ void print_usage(const char *prog) {
     printf("                      (default: auto) - Auto-configures all settings\n");
     printf("  --port PORT         HTTP server port (default: %d)\n", DEFAULT_PORT);
     printf("  --backend TYPE      Backend type: ollama, openai, auto (default: auto)\n");
-    printf("  --backend-host HOST Backend host (default: localhost)\n");
-    printf("  --backend-port PORT Backend port (default: auto-detect)\n");
+    printf("  --backend-host LIST Backend replicas: host[:port],... (default: localhost)\n");
+    printf("  --backend-port PORT Backend port for replicas without one (default: auto-detect)\n");
+    printf("  --balance POLICY    Replica selection: rr, least, p2c (default: least)\n");
+    printf("  --dns-ttl SEC       Cache resolved backend addresses for SEC seconds (default: %d)\n",
+           RESOLVER_DEFAULT_TTL_MS / 1000);
+    printf("  --health-interval MS Probe backend replicas every MS milliseconds (default: %d)\n",
+           HEALTH_DEFAULT_INTERVAL_MS);
+    printf("  --cache-size KB     Response cache budget, 0 = off (default: preset)\n");
+    printf("  --cache-ttl SEC     Seconds a cached reply stays valid (default: %d)\n",
+           CACHE_DEFAULT_TTL_MS / 1000);
+    printf("  --session-size KB   Conversation history budget, 0 = off (default: preset)\n");
+    printf("  --session-ttl SEC   Drop sessions idle for SEC seconds (default: %d)\n",
+           SESSION_DEFAULT_IDLE_MS / 1000);
+    printf("  --rate-limit RPS    Requests per second per client (API key or address), 0 = off (default: 0)\n");
+    printf("  --rate-burst N      Requests a client may send at once (default: 2 x RPS)\n");
+    printf("  --token-rate TPS    Generated tokens per second per client, 0 = off (default: 0)\n");
+    printf("  --token-burst N     Token bucket size (default: 10 x TPS)\n");
+    printf("  --rate-clients N    Clients tracked by the limiter (default: preset)\n");
+    printf("  --workers N         HTTP worker threads (default: preset, 0 = one per CPU)\n");
+    printf("  --max-inflight N    Concurrent backend requests before queueing (default: 10)\n");
+    printf("  --stream-coalesce N Merge streamed tokens into chunks of up to N bytes (default: 0 = off)\n");
+    printf("  --stream-latency MS Max delay before a merged chunk is flushed (default: %d)\n",
+           HTTP_STREAM_COALESCE_MS);
+    printf("  --batch-size N      Completions sent to an OpenAI backend in one request (default: %d, 1 = off)\n",
+           HTTP_BATCH_MAX);
+    printf("  --batch-window MS   How long a batch collects concurrent requests (default: %d)\n",
+           HTTP_BATCH_WINDOW_MS);
+    printf("  --class-weights I,A,B Scheduling weights of interactive, automation, batch (default: 8,3,1)\n");
+    printf("  --class-caps I,A,B  Per-class share of --max-inflight in percent (default: 100,75,50)\n");
+    printf("  --sensors FILE      Sensor configuration (JSON)\n");
+    printf("  --actuators FILE    Actuator configuration (JSON)\n");
+    printf("  --rules FILE        Rule configuration (JSON)\n");
     printf("  --memory-stats      Enable memory profiling\n");
     printf("  --help              Show this help\n");
     printf("\nPlatform Presets (inspired by nanochat's --depth):\n");
@@ -53,8 +114,18 @@ int main(int argc, char **argv) {
 
     int show_memory_stats = 0;
     char backend_type[32] = "auto";
-    char backend_host[256] = "localhost";
+    char backend_host[1024] = "localhost";
+    BalancePolicy balance_policy = BALANCE_LEAST_OUTSTANDING;
     int backend_port = 0;
+    int worker_threads = -1;
+    int cache_kb = -1;
+    int cache_ttl_ms = CACHE_DEFAULT_TTL_MS;
+    int session_kb = -1;
+    int session_ttl_ms = SESSION_DEFAULT_IDLE_MS;
+    RateLimitConfig rate_limit = { .clients = -1 };
+    const char *sensors_file = NULL;
+    const char *actuators_file = NULL;
+    const char *rules_file = NULL;
     PlatformPreset target_preset = TARGET_AUTO;
 
     // 解析参数
@@ -84,6 +155,62 @@ int main(int argc, char **argv) {
             strncpy(backend_host, argv[++i], sizeof(backend_host) - 1);
         } else if (strcmp(argv[i], "--backend-port") == 0 && i + 1 < argc) {
             backend_port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--balance") == 0 && i + 1 < argc) {
+            int policy = backend_policy_parse(argv[++i]);
+            if (policy < 0) {
+                fprintf(stderr, "Unknown balance policy: %s\n", argv[i]);
+                print_usage(argv[0]);
+                return 1;
+            }
+            balance_policy = (BalancePolicy)policy;
+        } else if (strcmp(argv[i], "--max-inflight") == 0 && i + 1 < argc) {
+            max_concurrent_requests = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--stream-coalesce") == 0 && i + 1 < argc) {
+            stream_coalesce_bytes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--stream-latency") == 0 && i + 1 < argc) {
+            stream_coalesce_ms = atoi(argv[++i]);
+        } else if ((strcmp(argv[i], "--class-weights") == 0 || strcmp(argv[i], "--class-caps") == 0) &&
+                   i + 1 < argc) {
+            int *out = (strcmp(argv[i], "--class-weights") == 0) ? class_weights : class_caps;
+            if (parse_class_list(argv[i + 1], out) < 0) {
+                fprintf(stderr, "Invalid %s: %s (expected three positive integers)\n", argv[i], argv[i + 1]);
+                return 1;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--batch-size") == 0 && i + 1 < argc) {
+            batch_max = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--batch-window") == 0 && i + 1 < argc) {
+            batch_window_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--dns-ttl") == 0 && i + 1 < argc) {
+            resolver_set_ttl(atoi(argv[++i]) * 1000);
+        } else if (strcmp(argv[i], "--health-interval") == 0 && i + 1 < argc) {
+            health_set_interval(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc) {
+            cache_kb = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cache-ttl") == 0 && i + 1 < argc) {
+            cache_ttl_ms = atoi(argv[++i]) * 1000;
+        } else if (strcmp(argv[i], "--session-size") == 0 && i + 1 < argc) {
+            session_kb = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--session-ttl") == 0 && i + 1 < argc) {
+            session_ttl_ms = atoi(argv[++i]) * 1000;
+        } else if (strcmp(argv[i], "--rate-limit") == 0 && i + 1 < argc) {
+            rate_limit.requests_per_sec = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--rate-burst") == 0 && i + 1 < argc) {
+            rate_limit.request_burst = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--token-rate") == 0 && i + 1 < argc) {
+            rate_limit.tokens_per_sec = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--token-burst") == 0 && i + 1 < argc) {
+            rate_limit.token_burst = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--rate-clients") == 0 && i + 1 < argc) {
+            rate_limit.clients = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            worker_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--sensors") == 0 && i + 1 < argc) {
+            sensors_file = argv[++i];
+        } else if (strcmp(argv[i], "--actuators") == 0 && i + 1 < argc) {
+            actuators_file = argv[++i];
+        } else if (strcmp(argv[i], "--rules") == 0 && i + 1 < argc) {
+            rules_file = argv[++i];
         } else if (strcmp(argv[i], "--memory-stats") == 0) {
             show_memory_stats = 1;
         } else if (strcmp(argv[i], "--help") == 0) {
@@ -94,47 +221,119 @@ int main(int argc, char **argv) {
 
     // Apply preset configuration (inspired by nanochat)
     PlatformConfig preset_config = platform_get_preset(target_preset);
-    max_concurrent_requests = preset_config.queue_depth;  // Use preset queue depth
+    if (worker_threads < 0) {
+        worker_threads = preset_config.worker_threads;
+    }
+    if (cache_kb < 0) {
+        cache_kb = preset_config.cache_kb;
+    }
+    if (session_kb < 0) {
+        session_kb = preset_config.session_kb;
+    }
+    if (rate_limit.clients < 0) {
+        rate_limit.clients = preset_config.ratelimit_clients;
+    }
+    if (worker_threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        worker_threads = (cpus > 0) ? (int)cpus : 1;
+    }
 
     printf("[Q-Lite] Target preset: %s\n", target_preset == TARGET_ESP32 ? "ESP32" :
                                           target_preset == TARGET_STM32 ? "STM32" :
                                           target_preset == TARGET_PICO ? "Pico" :
                                           target_preset == TARGET_DESKTOP ? "Desktop" : "Auto");
     printf("[Q-Lite] Max connections: %d\n", preset_config.max_connections);
-    printf("[Q-Lite] Queue depth: %d\n", preset_config.queue_depth);
+    printf("[Q-Lite] Queue depth: %d (timeout %d ms)\n", preset_config.queue_depth,
+           preset_config.timeout_ms);
+    printf("[Q-Lite] Max in-flight: %d\n", max_concurrent_requests);
     printf("[Q-Lite] Buffer size: %d bytes\n", preset_config.buffer_size);
+    printf("[Q-Lite] Worker threads: %d\n", worker_threads);
+    printf("[Q-Lite] Upstream idle connections: %d per backend\n", preset_config.upstream_idle);
+    printf("[Q-Lite] Response cache: %d KB (ttl %d s)\n", cache_kb, cache_ttl_ms / 1000);
+    printf("[Q-Lite] Sessions: %d KB (idle %d s)\n", session_kb, session_ttl_ms / 1000);
+
+    // 上游连接池大小取自预设
+    upstream_set_max_idle(preset_config.upstream_idle);
+
+    // 响应缓存预算取自预设 (可由 --cache-size 覆盖)
+    if (cache_init((size_t)cache_kb * 1024, cache_ttl_ms) < 0) {
+        fprintf(stderr, "[Q-Lite] Warning: response cache disabled (out of memory)\n");
+    }
+    backend_session_configure((size_t)session_kb * 1024, session_ttl_ms);
+
+    // 按客户端限流 (表大小取自预设，可由 --rate-clients 覆盖)
+    if (ratelimit_init(&rate_limit) < 0) {
+        fprintf(stderr, "[Q-Lite] Warning: rate limiting disabled (out of memory)\n");
+    }
+    if (ratelimit_enabled()) {
+        printf("[Q-Lite] Rate limit: %.1f req/s, %.1f tokens/s per client (%d clients)\n",
+               rate_limit.requests_per_sec, rate_limit.tokens_per_sec, rate_limit.clients);
+    }
 
     // 初始化内存统计
     MemStats mem_stats;
     mem_profile_init(&mem_stats);
 
-    // 初始化 backend
-    Backend *backend = NULL;
+    // 后台刷新后端地址 (请求路径上只读缓存)
+    resolver_start();
+
+    // 初始化 backend (一个或多个副本)
+    BackendGroup *backends = backend_group_create(balance_policy);
+    if (!backends) {
+        fprintf(stderr, "Failed to initialize backend\n");
+        return 1;
+    }
+
+    int added = 0;
     if (strcmp(backend_type, "auto") == 0) {
-        backend = backend_autodetect();
+        added = (backend_group_add(backends, backend_autodetect()) == 0) ? 1 : 0;
     } else if (strcmp(backend_type, "ollama") == 0) {
         int port = (backend_port > 0) ? backend_port : 11434;
-        backend = backend_ollama_create(backend_host, port);
+        added = backend_group_add_hosts(backends, BACKEND_OLLAMA, backend_host, port);
     } else if (strcmp(backend_type, "openai") == 0) {
         int port = (backend_port > 0) ? backend_port : 8000;
-        backend = backend_openai_create(backend_host, port);
+        added = backend_group_add_hosts(backends, BACKEND_OPENAI_COMPAT, backend_host, port);
     } else {
         fprintf(stderr, "Unknown backend type: %s\n", backend_type);
         return 1;
     }
 
-    if (!backend) {
+    if (added <= 0) {
         fprintf(stderr, "Failed to initialize backend\n");
         return 1;
     }
 
+    // 预先解析后端地址: 请求路径和健康检查只读缓存，不等待 DNS
+    for (int i = 0; i < backends->count; i++) {
+        Backend *replica = backends->replicas[i];
+        if (resolver_prefetch(replica->host) < 0) {
+            fprintf(stderr, "[Q-Lite] Warning: cannot resolve backend host %s\n", replica->host);
+        }
+    }
+
+    // 后台并行探测副本，结果驱动各副本的熔断器
+    health_start(backends);
+
+    // 初始化设备 API (/sensors, /actuators, /rules)
+    if (sensors_file && sensor_system_init(sensors_file) < 0) {
+        fprintf(stderr, "Failed to load sensors: %s\n", sensors_file);
+    }
+    if (actuators_file && actuator_system_init(actuators_file) < 0) {
+        fprintf(stderr, "Failed to load actuators: %s\n", actuators_file);
+    }
+    if (rules_file && rule_system_init(rules_file) < 0) {
+        fprintf(stderr, "Failed to load rules: %s\n", rules_file);
+    }
+
     printf("╔══════════════════════════════════════════╗\n");
     printf("║     Q-Lite v%s - HTTP Gateway          ║\n", Q_LITE_VERSION);
     printf("╠══════════════════════════════════════════╣\n");
     printf("║  Port:    %-4d                         ║\n", config.port);
-    printf("║  Backend: %-30s ║\n", backend->name);
-    printf("║  Host:    %-30s ║\n", backend->host);
-    printf("║  Port:    %-4d                         ║\n", backend->port);
+    printf("║  Backend: %-30s ║\n", backends->replicas[0]->name);
+    for (int i = 0; i < backends->count; i++) {
+        printf("║  Host:    %-24s %-5d ║\n", backends->replicas[i]->host, backends->replicas[i]->port);
+    }
+    printf("║  Balance: %-30s ║\n", backend_policy_name(backends->policy));
     printf("║  Memory:  %-30s ║\n", show_memory_stats ? "Enabled" : "Disabled");
     printf("╚══════════════════════════════════════════╝\n");
 
@@ -142,20 +341,28 @@ int main(int argc, char **argv) {
     signal(SIGINT, sigint_handler);
     signal(SIGTERM, sigint_handler);
 
-    // 启动 HTTP 服务器
-    int server_fd = http_server_start(config.port);
-    if (server_fd < 0) {
+    // 启动 HTTP worker (每个 worker 独立监听 + 事件循环，连接池大小取自预设)
+    HttpServerConfig server_config = {
+        .port = config.port,
+        .workers = worker_threads,
+        .max_connections = preset_config.max_connections,
+        .max_inflight = max_concurrent_requests,
+        .queue_depth = preset_config.queue_depth,
+        .timeout_ms = preset_config.timeout_ms,
+        .stream_coalesce_bytes = stream_coalesce_bytes,
+        .stream_coalesce_ms = stream_coalesce_ms,
+        .batch_max = batch_max,
+        .batch_window_ms = batch_window_ms,
+        .backends = backends
+    };
+    memcpy(server_config.class_weights, class_weights, sizeof(class_weights));
+    memcpy(server_config.class_caps, class_caps, sizeof(class_caps));
+    HttpWorkers workers;
+    if (http_workers_start(&workers, &server_config) < 0) {
         fprintf(stderr, "Failed to start HTTP server\n");
         return 1;
     }
 
-    // 初始化 HTTP 上下文
-    HttpContext ctx = {
-        .server_fd = server_fd,
-        .client_fd = -1,
-        .state = HTTP_STATE_IDLE
-    };
-
     printf("[Q-Lite] Ready to accept connections\n");
     printf("[Q-Lite] Press Ctrl+C to stop\n\n");
 
@@ -166,7 +373,7 @@ int main(int argc, char **argv) {
 
     // 主事件循环
     while (running) {
-        http_server_run(&ctx);
+        usleep(100000);  // 100ms, 事件循环运行在 worker 线程中
 
         // 每隔一段时间显示内存统计（如果启用）
         if (show_memory_stats) {
@@ -178,8 +385,15 @@ int main(int argc, char **argv) {
     }
 
     // 清理
-    close(server_fd);
-    backend_destroy(backend);
+    http_workers_stop(&workers);
+    upstream_cleanup();
+    buffer_pool_cleanup();
+    cache_cleanup();
+    ratelimit_cleanup();
+    backend_session_cleanup();
+    health_stop();
+    resolver_stop();
+    backend_group_destroy(backends);
 
     // 显示最终内存统计
     if (show_memory_stats) {
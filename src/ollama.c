@@ -1,320 +1,194 @@
 #include "ollama.h"
+#include "upstream.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <unistd.h>
-#include <arpa/inet.h>
 
-// HTTP POST 客户端 (Raw Socket - 零依赖)
-int http_post(const char *host, int port,
-              const char *path, const char *body,
-              char *response, size_t response_size) {
-    int sock;
-    struct sockaddr_in server;
-    char request[OLLAMA_MAX_RESPONSE * 2];
-    char header[512];
-
-    // 创建 socket
-    sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) {
-        perror("socket failed");
-        return -1;
-    }
-
-    // 连接服务器
-    server.sin_family = AF_INET;
-    server.sin_port = htons(port);
-    server.sin_addr.s_addr = inet_addr(host);
-
-    if (connect(sock, (struct sockaddr*)&server, sizeof(server)) < 0) {
-        perror("connect failed");
-        close(sock);
-        return -1;
-    }
-
-    // 构建 HTTP 请求
-    int header_len = snprintf(header, sizeof(header),
-        "POST %s HTTP/1.1\r\n"
-        "Host: %s\r\n"
-        "Content-Type: application/json\r\n"
-        "Content-Length: %zu\r\n"
-        "Connection: close\r\n"
-        "\r\n",
-        path, host, strlen(body)
-    );
-
-    memcpy(request, header, header_len);
-    memcpy(request + header_len, body, strlen(body));
-
-    // 发送请求
-    if (send(sock, request, header_len + strlen(body), 0) < 0) {
-        perror("send failed");
-        close(sock);
-        return -1;
-    }
-
-    // 接收响应
-    int total_received = 0;
-    int bytes_received;
-    while ((bytes_received = recv(sock, response + total_received,
-                                   response_size - total_received - 1, 0)) > 0) {
-        total_received += bytes_received;
-    }
-
-    response[total_received] = '\0';
-    close(sock);
-
-    // 跳过 HTTP header (查找 \r\n\r\n)
-    char *body_start = strstr(response, "\r\n\r\n");
-    if (body_start != NULL) {
-        body_start += 4;  // 跳过 \r\n\r\n
-        memmove(response, body_start, strlen(body_start) + 1);
-    }
-
-    return total_received;
-}
-
-// 生成 JSON body
-static char* create_generate_json(const char *model, const char *prompt) {
-    char *json = malloc(OLLAMA_MAX_RESPONSE);
-    if (!json) return NULL;
-
-    snprintf(json, OLLAMA_MAX_RESPONSE,
-        "{\"model\":\"%s\",\"prompt\":\"%s\",\"stream\":false}",
-        model, prompt
+// 生成 JSON body (context: 上一轮返回的 token 数组，可为 NULL; options: 已带 "options": 前缀和 ',')
+static char* create_generate_json(Arena *arena, const char *model, const char *prompt,
+                                  const char *context, const char *options, int stream) {
+    return arena_sprintf(arena,
+        "{\"model\":\"%s\",\"prompt\":\"%s\",%s%s%s%s\"stream\":%s}",
+        model, prompt, context ? "\"context\":" : "", context ? context : "", context ? "," : "",
+        options, stream ? "true" : "false"
     );
-
-    return json;
 }
 
-// 生成对话 JSON body
-static char* create_chat_json(const char *model, const char *message) {
-    char *json = malloc(OLLAMA_MAX_RESPONSE);
-    if (!json) return NULL;
-
-    snprintf(json, OLLAMA_MAX_RESPONSE,
-        "{\"model\":\"%s\",\"messages\":[{\"role\":\"user\",\"content\":\"%s\"}],\"stream\":false}",
-        model, message
+// 生成对话 JSON body (history: 之前的消息对象，每个后跟 ','，可为 NULL)
+static char* create_chat_json(Arena *arena, const char *model, const char *message, const char *history,
+                              const char *options) {
+    return arena_sprintf(arena,
+        "{\"model\":\"%s\",\"messages\":[%s{\"role\":\"user\",\"content\":\"%s\"}],%s\"stream\":false}",
+        model, history ? history : "", message, options
     );
-
-    return json;
 }
 
-// 提取 JSON 字段 (简单解析)
-static char* extract_json_field(const char *json, const char *field) {
-    char search[128];
-    snprintf(search, sizeof(search), "\"%s\":\"", field);
-
-    char *start = strstr(json, search);
-    if (!start) return NULL;
-
-    start += strlen(search);
-    char *end = strchr(start, '"');
-    if (!end) return NULL;
+// 构建上游请求 (options 原样转发)
+char* ollama_build_request(Arena *arena, int chat, const char *model, const char *input,
+                           const char *history, const char *options, int stream, const char **path) {
+    const char *field = options ? arena_sprintf(arena, "\"options\":%s,", options) : "";
+    if (!field) return NULL;
 
-    *end = '\0';
-    char *result = strdup(start);
-    *end = '"';
-
-    return result;
+    *path = chat ? OLLAMA_API_CHAT : OLLAMA_API_GENERATE;
+    return chat ? create_chat_json(arena, model, input, history, field)
+                : create_generate_json(arena, model, input, history, field, stream);
 }
 
-// Ollama Generate API
-char* ollama_generate(const char *model, const char *prompt) {
-    char *json_body = create_generate_json(model, prompt);
-    if (!json_body) return NULL;
-
-    char response[OLLAMA_MAX_RESPONSE];
-    int result = http_post(OLLAMA_DEFAULT_HOST, OLLAMA_DEFAULT_PORT,
-                          OLLAMA_API_GENERATE, json_body,
-                          response, sizeof(response));
-
-    free(json_body);
-
-    if (result < 0) {
-        return strdup("{\"error\":\"Failed to connect to Ollama\"}");
+// 解析 context 数组的内容 (list 指向 '[' 之后，到第一个非数字、非逗号的字符为止)
+uint32_t* ollama_parse_context(Arena *arena, const char *list, size_t *count) {
+    size_t commas = 0;
+    const char *end = list;
+    while ((*end >= '0' && *end <= '9') || *end == ',' || *end == ' ') {
+        if (*end == ',') commas++;
+        end++;
     }
 
-    // 提取 response 字段
-    char *reply = extract_json_field(response, "response");
-    if (!reply) {
-        return strdup("{\"error\":\"Invalid Ollama response\"}");
+    *count = 0;
+    uint32_t *tokens = arena_alloc(arena, (commas + 1) * sizeof(uint32_t));
+    if (!tokens) return NULL;
+
+    const char *p = list;
+    while (p < end) {
+        while (p < end && (*p == ',' || *p == ' ')) p++;
+        if (p == end) break;
+        uint32_t value = 0;
+        while (p < end && *p >= '0' && *p <= '9') value = value * 10 + (uint32_t)(*p++ - '0');
+        tokens[(*count)++] = value;
     }
-
-    return reply;
+    return tokens;
 }
 
-// Ollama Chat API
-char* ollama_chat(const char *model, const char *message) {
-    char *json_body = create_chat_json(model, message);
-    if (!json_body) return NULL;
-
-    char response[OLLAMA_MAX_RESPONSE];
-    int result = http_post(OLLAMA_DEFAULT_HOST, OLLAMA_DEFAULT_PORT,
-                          OLLAMA_API_CHAT, json_body,
-                          response, sizeof(response));
-
-    free(json_body);
-
-    if (result < 0) {
-        return strdup("{\"error\":\"Failed to connect to Ollama\"}");
-    }
-
-    // 提取 message.content 字段 (简化处理)
-    char *content_start = strstr(response, "\"content\":\"");
-    if (!content_start) {
-        return strdup("{\"error\":\"Invalid Ollama response\"}");
+// 在完整的 generate 响应中查找顶层 context 数组
+uint32_t* ollama_reply_context(Arena *arena, const char *response, size_t *count) {
+    JsonValue context;
+    if (json_find(response, strlen(response), "/context", &context) < 0 || context.type != JSON_ARRAY) {
+        *count = 0;
+        return NULL;
     }
+    return ollama_parse_context(arena, context.data + 1, count);
+}
 
-    content_start += strlen("\"content\":\"");
-    char *content_end = strchr(content_start, '"');
-    if (!content_end) {
-        return strdup("{\"error\":\"Invalid Ollama response\"}");
+// 从上游响应中提取回复
+char* ollama_parse_reply(Arena *arena, int chat, const char *response) {
+    // generate: response 字段; chat: message.content 字段
+    JsonValue value;
+    json_find(response, strlen(response), chat ? "/message/content" : "/response", &value);
+    char *reply = json_string(arena, &value);
+    if (!reply) {
+        return arena_strdup(arena, "{\"error\":\"Invalid Ollama response\"}");
     }
-
-    *content_end = '\0';
-    char *reply = strdup(content_start);
-    *content_end = '"';
-
     return reply;
 }
 
-// 解析完整响应 (保留)
-int ollama_parse_response(const char *json, OllamaResponse *resp) {
-    // TODO: 实现完整解析
-    strncpy(resp->model, "unknown", sizeof(resp->model) - 1);
-    strncpy(resp->response, json, sizeof(resp->response) - 1);
-    resp->done = 1;
-    return 0;
+// 初始化流式解码
+void ollama_stream_init(OllamaStream *stream) {
+    memset(stream, 0, sizeof(*stream));
+    json_parser_init(&stream->parser);
 }
 
-// 流式生成 - 发送 chunked 响应
-int ollama_generate_stream(const char *model, const char *prompt, int client_fd) {
-    char *json_body = create_generate_json(model, prompt);
-    if (!json_body) return -1;
-
-    // 修改为流式请求
-    char *stream_pos = strstr(json_body, "\"stream\":false");
-    if (stream_pos) {
-        memcpy(stream_pos, "\"stream\":true", 14);
-    }
-
-    char response_buffer[OLLAMA_MAX_RESPONSE * 2];
-    int sock;
-    struct sockaddr_in server;
-
-    // 创建 socket
-    sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) {
-        free(json_body);
-        return -1;
-    }
-
-    // 连接服务器
-    server.sin_family = AF_INET;
-    server.sin_port = htons(OLLAMA_DEFAULT_PORT);
-    server.sin_addr.s_addr = inet_addr(OLLAMA_DEFAULT_HOST);
+// 写出已解码的 token
+static int stream_flush_token(OllamaStream *stream) {
+    if (stream->token_len == 0) return 0;
+    int result = stream->sink(stream->sink_user, stream->token, stream->token_len);
+    stream->token_len = 0;
+    return result;
+}
 
-    if (connect(sock, (struct sockaddr*)&server, sizeof(server)) < 0) {
-        close(sock);
-        free(json_body);
-        return -1;
+// 追加解码后的字节 (缓冲区满时先写出)
+static int stream_put(OllamaStream *stream, const char *data, int len) {
+    for (int i = 0; i < len; i++) {
+        if (stream->token_len == sizeof(stream->token) &&
+            stream_flush_token(stream) < 0) {
+            return -1;
+        }
+        stream->token[stream->token_len++] = data[i];
     }
+    return 0;
+}
 
-    // 发送请求
-    char request[OLLAMA_MAX_RESPONSE * 2];
-    char header[512];
-    int header_len = snprintf(header, sizeof(header),
-        "POST %s HTTP/1.1\r\n"
-        "Host: %s\r\n"
-        "Content-Type: application/json\r\n"
-        "Content-Length: %zu\r\n"
-        "Connection: close\r\n"
-        "\r\n",
-        OLLAMA_API_GENERATE, OLLAMA_DEFAULT_HOST, strlen(json_body)
-    );
-
-    memcpy(request, header, header_len);
-    memcpy(request + header_len, json_body, strlen(json_body));
-
-    if (send(sock, request, header_len + strlen(json_body), 0) < 0) {
-        close(sock);
-        free(json_body);
-        return -1;
+// response 字符串的一个片段: 反转义后写入 token 缓冲区，字符串结束时写出
+static int stream_response(OllamaStream *stream, const JsonEvent *event) {
+    char out[JSON_UTF8_MAX];
+    for (size_t i = 0; i < event->len; i++) {
+        int n = json_unescape_byte(&stream->unescape, event->data[i], out);
+        if (stream_put(stream, out, n) < 0) return -1;
     }
+    if (event->partial) return 0;
 
-    free(json_body);
-
-    // 跳过 HTTP header
-    int total_received = 0;
-    int bytes_received;
-    int header_skipped = 0;
+    int n = json_unescape_end(&stream->unescape, out);
+    if (stream_put(stream, out, n) < 0) return -1;
+    return stream_flush_token(stream);
+}
 
-    while ((bytes_received = recv(sock, response_buffer + total_received,
-                                   sizeof(response_buffer) - total_received - 1, 0)) > 0) {
-        total_received += bytes_received;
-        response_buffer[total_received] = '\0';
+// 解析事件 (每行一个顶层对象)
+static int stream_event(const JsonEvent *event, void *user) {
+    OllamaStream *stream = user;
+    if (!event->path) return 0;
 
-        // 查找 header 结束标记
-        if (!header_skipped) {
-            char *body_start = strstr(response_buffer, "\r\n\r\n");
-            if (body_start != NULL) {
-                body_start += 4;
-                int body_len = total_received - (body_start - response_buffer);
-                memmove(response_buffer, body_start, body_len);
-                total_received = body_len;
-                header_skipped = 1;
-            } else {
-                continue;  // Header 未完整
+    switch (event->type) {
+        case JSON_OBJECT:
+            if (event->depth == 0) {
+                stream->done_seen = 0;
+                stream->error_seen = 0;
             }
-        }
-
-        // 解析多行 JSON 响应
-        char *line_start = response_buffer;
-        char *line_end;
-
-        while ((line_end = strstr(line_start, "}\n")) != NULL) {
-            line_end++;  // 包含 }
-
-            // 提取 response 字段
-            char *resp_start = strstr(line_start, "\"response\":\"");
-            if (resp_start) {
-                resp_start += strlen("\"response\":\"");
-                char *resp_end = strchr(resp_start, '"');
-                if (resp_end) {
-                    *resp_end = '\0';
-
-                    // 发送 chunk
-                    extern int http_send_chunk(int, const char*, size_t);
-                    http_send_chunk(client_fd, resp_start, strlen(resp_start));
-
-                    *resp_end = '"';
+            break;
+        case JSON_ARRAY:
+            // 只保留最后一个 context 数组
+            if (stream->context && strcmp(event->path, "/context") == 0) {
+                buffer_chain_release(stream->context);
+            }
+            break;
+        case JSON_STRING:
+            if (strcmp(event->path, "/response") == 0 && stream_response(stream, event) < 0) {
+                stream->result = -1;
+                return 1;
+            }
+            if (strcmp(event->path, "/error") == 0) stream->error_seen = 1;
+            break;
+        case JSON_NUMBER:
+            if (stream->context && strncmp(event->path, "/context/", 9) == 0) {
+                if (buffer_chain_append(stream->context, event->data, event->len) < 0 ||
+                    (!event->partial && buffer_chain_append(stream->context, ",", 1) < 0)) {
+                    stream->context = NULL;     // 超出上限: 放弃
                 }
             }
-
-            // 检查 done
-            if (strstr(line_start, "\"done\":true")) {
-                // 结束
-                close(sock);
-                extern int http_send_chunk_end(int);
-                return http_send_chunk_end(client_fd);
+            break;
+        case JSON_TRUE:
+            if (strcmp(event->path, "/done") == 0) stream->done_seen = 1;
+            break;
+        case JSON_OBJECT_END:
+            if (event->depth == 0 && (stream->error_seen || stream->done_seen)) {
+                stream->done = !stream->error_seen;
+                stream->result = stream->error_seen ? -1 : 1;
+                return 1;
             }
+            break;
+        default:
+            break;
+    }
+    return 0;
+}
 
-            line_start = line_end + 1;
-        }
+// 解码一段 body
+int ollama_stream_feed(OllamaStream *stream, const char *data, size_t len,
+                       OllamaTokenSink sink, void *user) {
+    stream->sink = sink;
+    stream->sink_user = user;
+    int result = json_feed(&stream->parser, data, len, stream_event, stream);
+    if (result < 0) return -1;
+    if (result > 0) return stream->result;
+
+    // 本段结束时字符串可能尚未结束: 先写出已解码的部分
+    return (stream_flush_token(stream) < 0) ? -1 : 0;
+}
 
-        // 移动剩余数据到开头
-        if (line_start < response_buffer + total_received) {
-            int remaining = total_received - (line_start - response_buffer);
-            memmove(response_buffer, line_start, remaining);
-            total_received = remaining;
-        } else {
-            total_received = 0;
-        }
-    }
+// 读取一段 body 并解码 (直接解码上游缓冲区，不复制)
+int ollama_stream_read(OllamaStream *stream, UpstreamResponse *resp,
+                       OllamaTokenSink sink, void *user) {
+    const char *data;
+    ssize_t bytes_received = upstream_body_next(resp, &data, sizeof(resp->buf));
+    if (bytes_received == -2) return -2;
+    if (bytes_received <= 0) return -1;  // 在 done 之前结束或出错
 
-    close(sock);
-    return 0;
+    return ollama_stream_feed(stream, data, bytes_received, sink, user);
 }
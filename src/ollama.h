@@ -2,36 +2,61 @@
 #define OLLAMA_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+#include "upstream.h"
+#include "buffer.h"
+#include "json.h"
 
 // Ollama API 配置
 #define OLLAMA_DEFAULT_HOST "localhost"
 #define OLLAMA_DEFAULT_PORT 11434
-#define OLLAMA_MAX_RESPONSE 8192
+#define OLLAMA_MAX_BODY (1024 * 1024)   // 上游响应 body 上限 (按实际大小分块增长)
 
 // API 端点
 #define OLLAMA_API_GENERATE "/api/generate"
 #define OLLAMA_API_CHAT     "/api/chat"
 
-// 生成响应
+// 请求构建 / 回复解析 (供事件循环中的异步调用使用)
+// history: chat 为会话中之前的对话消息，generate 为上一轮返回的 context 数组 ("[1,2,3]")
+// options: 客户端的 "options" 对象 (原始 JSON，可为 NULL)
+char* ollama_build_request(Arena *arena, int chat, const char *model, const char *input,
+                           const char *history, const char *options, int stream, const char **path);
+char* ollama_parse_reply(Arena *arena, int chat, const char *response);
+
+// generate 返回的 context (token 数组，分配在 arena 中): 从完整响应 / 从数组内容 ("1,2,3") 解析
+uint32_t* ollama_reply_context(Arena *arena, const char *response, size_t *count);
+uint32_t* ollama_parse_context(Arena *arena, const char *list, size_t *count);
+
+// 解码出的 token 交给调用者 (如客户端的流式响应)，返回 < 0 表示写入失败
+typedef int (*OllamaTokenSink)(void *user, const char *data, size_t len);
+
+// 流式响应解码 (NDJSON): 基于流式 JSON 解析器，状态跨 read 保留，每个字节只扫描一次。
+// 不缓存整行，只解码顶层的 "response" 字符串 (处理转义和 \uXXXX) 并交给 sink，
+// 顶层 "done": true 的对象结束时生成结束，"error" 对象视为失败。
+// 设置 context 时，顶层 "context" 数组的内容 (数字，逗号分隔) 追加到其中。
 typedef struct {
-    char model[64];
-    char response[OLLAMA_MAX_RESPONSE];
+    JsonParser parser;
+    JsonUnescape unescape;  // response 字符串的解码状态 (跨片段)
+    int done_seen;          // 当前对象中 done = true
+    int error_seen;
+    int result;             // 停止解析的原因: 1 = 生成结束, -1 = 上游报错或写入失败
+    char token[256];        // 已解码、尚未写出的 token
+    size_t token_len;
     int done;
-} OllamaResponse;
-
-// HTTP 客户端 (内部)
-int http_post(const char *host, int port,
-              const char *path, const char *body,
-              char *response, size_t response_size);
+    BufferChain *context;   // 记录 context 数组 (NULL = 不记录，超出上限后置 NULL)
+    OllamaTokenSink sink;   // 当前 feed 的 sink
+    void *sink_user;
+} OllamaStream;
 
-// Ollama API 函数
-char* ollama_generate(const char *model, const char *prompt);
-char* ollama_chat(const char *model, const char *message);
+void ollama_stream_init(OllamaStream *stream);
 
-// 流式生成 (Task 2: Streaming)
-int ollama_generate_stream(const char *model, const char *prompt, int client_fd);
+// 解码一段 body: 1 = 生成结束, 0 = 继续, -1 = 上游报错或写入失败
+int ollama_stream_feed(OllamaStream *stream, const char *data, size_t len,
+                       OllamaTokenSink sink, void *user);
 
-// 辅助函数
-int ollama_parse_response(const char *json, OllamaResponse *resp);
+// 读取一段 body 并解码 (不等待): 返回值同上，-2 = 暂无数据
+int ollama_stream_read(OllamaStream *stream, UpstreamResponse *resp,
+                       OllamaTokenSink sink, void *user);
 
 #endif
@@ -30,6 +30,11 @@ typedef struct {
     int buffer_size;         // HTTP buffer size
     int queue_depth;         // Request queue depth
     int timeout_ms;         // Request timeout
+    int worker_threads;     // HTTP worker threads (0 = one per online CPU)
+    int upstream_idle;      // Idle keep-alive connections kept per backend
+    int cache_kb;           // Response cache budget in KB (0 = disabled)
+    int session_kb;         // Conversation history budget in KB (0 = sessions disabled)
+    int ratelimit_clients;  // Clients tracked by the rate limiter (fixed table)
 } PlatformConfig;
 
 // Platform operations
@@ -77,6 +82,16 @@ void platform_init(void);
 // Get preset configuration (inspired by nanochat's single-dial philosophy)
 PlatformConfig platform_get_preset(PlatformPreset preset);
 
+// Hardware hooks used by the sensor/actuator/rule APIs
+// (desktop builds provide simulated implementations in platform_init.c)
+uint32_t platform_get_time_ms(void);
+void platform_delay_ms(uint32_t ms);
+float platform_read_sensor(int driver, const char *params);
+void platform_actuator_write(int driver, const char *params, uint32_t value);
+void platform_rgb_led_write(const char *params, uint8_t r, uint8_t g, uint8_t b);
+void platform_servo_write(const char *params, uint16_t angle);
+void platform_buzzer_beep(const char *params, uint32_t duration_ms);
+
 // Convenience macros
 #define PLATFORM_INIT()          platform_init()
 #define PLATFORM_DEBUG(msg)     if(platform_ops) platform_ops->debug_print(msg)
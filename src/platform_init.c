@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
+#include <unistd.h>
 
 // Global platform operations (set at runtime or compile-time)
 PlatformOps *platform_ops = NULL;
@@ -61,3 +63,49 @@ void platform_print_info(void) {
     printf("  Network: %s\n", config.network_type);
     printf("  Max Connections: %d\n", config.max_connections);
 }
+
+// Time in milliseconds (platform ops, or monotonic clock on desktop)
+uint32_t platform_get_time_ms(void) {
+    if (platform_ops && platform_ops->get_time_ms) {
+        return platform_ops->get_time_ms();
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL);
+}
+
+// Delay (platform ops, or usleep on desktop)
+void platform_delay_ms(uint32_t ms) {
+    if (platform_ops && platform_ops->delay_ms) {
+        platform_ops->delay_ms(ms);
+        return;
+    }
+    usleep(ms * 1000);
+}
+
+#if !defined(ESP32_PLATFORM) && !defined(STM32_PLATFORM) && !defined(PICO_PLATFORM)
+// Desktop: no GPIO/I2C, hardware hooks are simulated
+
+float platform_read_sensor(int driver, const char *params) {
+    (void)driver;
+    (void)params;
+    return 0.0f;
+}
+
+void platform_actuator_write(int driver, const char *params, uint32_t value) {
+    printf("[Platform] actuator driver=%d params=%s value=%u (simulated)\n", driver, params, value);
+}
+
+void platform_rgb_led_write(const char *params, uint8_t r, uint8_t g, uint8_t b) {
+    printf("[Platform] rgb params=%s color=%u,%u,%u (simulated)\n", params, r, g, b);
+}
+
+void platform_servo_write(const char *params, uint16_t angle) {
+    printf("[Platform] servo params=%s angle=%u (simulated)\n", params, angle);
+}
+
+void platform_buzzer_beep(const char *params, uint32_t duration_ms) {
+    printf("[Platform] buzzer params=%s duration=%ums (simulated)\n", params, duration_ms);
+}
+#endif
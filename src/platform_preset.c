@@ -12,7 +12,12 @@ static const PlatformConfig presets[] = {
         .max_connections = 10,
         .buffer_size = 2048,
         .queue_depth = 10,
-        .timeout_ms = 30000
+        .timeout_ms = 30000,
+        .worker_threads = 1,
+        .upstream_idle = 4,
+        .cache_kb = 1024,
+        .session_kb = 256,
+        .ratelimit_clients = 1024
     },
     [TARGET_ESP32] = {
         .flash_size = 4 * 1024 * 1024,     // 4MB
@@ -21,7 +26,12 @@ static const PlatformConfig presets[] = {
         .max_connections = 5,                // Limited by ESP32
         .buffer_size = 1024,               // Smaller for ESP32
         .queue_depth = 3,                   // Very limited RAM
-        .timeout_ms = 60000                 // Longer timeout for WiFi
+        .timeout_ms = 60000,                // Longer timeout for WiFi
+        .worker_threads = 1,                // Single event loop
+        .upstream_idle = 2,                 // Each socket costs lwIP buffers
+        .cache_kb = 32,                     // Kept in PSRAM
+        .session_kb = 64,
+        .ratelimit_clients = 128
     },
     [TARGET_STM32] = {
         .flash_size = 512 * 1024,           // 512KB
@@ -30,7 +40,12 @@ static const PlatformConfig presets[] = {
         .max_connections = 8,
         .buffer_size = 512,                  // Very limited RAM
         .queue_depth = 2,                   // Extremely limited
-        .timeout_ms = 30000
+        .timeout_ms = 30000,
+        .worker_threads = 1,
+        .upstream_idle = 1,
+        .cache_kb = 0,                      // No room for cached replies
+        .session_kb = 8,
+        .ratelimit_clients = 32              // 1KB table
     },
     [TARGET_PICO] = {
         .flash_size = 2 * 1024 * 1024,     // 2MB
@@ -39,7 +54,12 @@ static const PlatformConfig presets[] = {
         .max_connections = 4,
         .buffer_size = 768,                  // Medium
         .queue_depth = 2,                   // Limited RAM
-        .timeout_ms = 45000
+        .timeout_ms = 45000,
+        .worker_threads = 1,
+        .upstream_idle = 1,
+        .cache_kb = 16,
+        .session_kb = 16,
+        .ratelimit_clients = 64
     },
     [TARGET_DESKTOP] = {
         .flash_size = 0,                   // N/A
@@ -48,7 +68,12 @@ static const PlatformConfig presets[] = {
         .max_connections = 100,              // Much higher
         .buffer_size = 8192,               // Large buffers
         .queue_depth = 20,                  // Deep queue
-        .timeout_ms = 10000                 // Shorter timeout
+        .timeout_ms = 10000,                // Shorter timeout
+        .worker_threads = 0,                // One worker per CPU core
+        .upstream_idle = 16,                // Reuse backend connections across workers
+        .cache_kb = 16 * 1024,              // 16MB of cached replies
+        .session_kb = 32 * 1024,            // 32MB of conversation history
+        .ratelimit_clients = 64 * 1024      // 2MB table
     }
 };
 
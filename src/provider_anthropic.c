@@ -2,6 +2,7 @@
 
 #include "provider_anthropic.h"
 #include "http.h"
+#include "json.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -91,20 +92,13 @@ int provider_anthropic_get_response(backend_session_t *session, char *buffer, si
     int bytes_read = http_client_read(session->http, buffer, buffer_size);
 
     // Parse streaming response (Anthropic format: "data: {...}")
-    if (bytes_read > 0 && strncmp(buffer, "data: ", 6) == 0) {
-        char *delta_start = strstr(buffer + 6, "\"delta\":{\"text\":\"");
-        if (delta_start) {
-            delta_start += 17; // Skip "\"delta\":{\"text\":\""
-            char *delta_end = strstr(delta_start, "\"");
-            if (delta_end) {
-                size_t delta_len = delta_end - delta_start;
-                if (delta_len < buffer_size) {
-                    memcpy(buffer, delta_start, delta_len);
-                    buffer[delta_len] = '\0';
-                    return (int)delta_len;
-                }
-            }
-        }
+    JsonValue text;
+    if (bytes_read > 6 && strncmp(buffer, "data: ", 6) == 0 &&
+        json_find(buffer + 6, bytes_read - 6, "/delta/text", &text) == 0 && text.type == JSON_STRING &&
+        text.len < buffer_size) {
+        memmove(buffer, text.data, text.len);
+        buffer[text.len] = '\0';
+        return (int)text.len;
     }
 
     return bytes_read;
@@ -2,6 +2,7 @@
 
 #include "provider_openai.h"
 #include "http.h"
+#include "json.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -90,20 +91,13 @@ int provider_openai_get_response(backend_session_t *session, char *buffer, size_
     int bytes_read = http_client_read(session->http, buffer, buffer_size);
 
     // Parse streaming response (OpenAI format: "data: {...}")
-    if (bytes_read > 0 && strncmp(buffer, "data: ", 6) == 0) {
-        char *content_start = strstr(buffer + 6, "\"content\":\"");
-        if (content_start) {
-            content_start += 11; // Skip "\"content\":\""
-            char *content_end = strstr(content_start, "\"");
-            if (content_end) {
-                size_t content_len = content_end - content_start;
-                if (content_len < buffer_size) {
-                    memcpy(buffer, content_start, content_len);
-                    buffer[content_len] = '\0';
-                    return (int)content_len;
-                }
-            }
-        }
+    JsonValue text;
+    if (bytes_read > 6 && strncmp(buffer, "data: ", 6) == 0 &&
+        json_find(buffer + 6, bytes_read - 6, "/choices/0/delta/content", &text) == 0 && text.type == JSON_STRING &&
+        text.len < buffer_size) {
+        memmove(buffer, text.data, text.len);
+        buffer[text.len] = '\0';
+        return (int)text.len;
     }
 
     return bytes_read;
@@ -0,0 +1,149 @@
+#include "ratelimit.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+typedef struct {
+    unsigned long long client;  // 0 = 空
+    double requests;            // 请求桶余额
+    double tokens;              // token 桶余额 (可为负)
+    long long updated_ms;       // 上次补充 / 访问时间
+} RateLimitEntry;
+
+typedef struct {
+    pthread_mutex_t lock;
+    RateLimitEntry ways[RATELIMIT_WAYS];
+} RateLimitSet;
+
+static RateLimitSet *sets = NULL;
+static size_t set_count = 0;
+static RateLimitConfig limits;
+
+// 单调时钟 (毫秒)
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 初始化: 一次分配整张表
+int ratelimit_init(const RateLimitConfig *config) {
+    ratelimit_cleanup();
+    limits = *config;
+    if (config->clients <= 0 || (config->requests_per_sec <= 0 && config->tokens_per_sec <= 0)) {
+        return 0;
+    }
+
+    if (limits.request_burst <= 0) limits.request_burst = limits.requests_per_sec * 2;
+    if (limits.request_burst < 1) limits.request_burst = 1;
+    if (limits.token_burst <= 0) limits.token_burst = limits.tokens_per_sec * 10;
+
+    size_t count = ((size_t)config->clients + RATELIMIT_WAYS - 1) / RATELIMIT_WAYS;
+    sets = calloc(count, sizeof(RateLimitSet));
+    if (!sets) return -1;
+    for (size_t i = 0; i < count; i++) {
+        pthread_mutex_init(&sets[i].lock, NULL);
+    }
+    set_count = count;
+    return 0;
+}
+
+// 释放表
+void ratelimit_cleanup(void) {
+    for (size_t i = 0; i < set_count; i++) {
+        pthread_mutex_destroy(&sets[i].lock);
+    }
+    free(sets);
+    sets = NULL;
+    set_count = 0;
+}
+
+int ratelimit_enabled(void) {
+    return sets != NULL;
+}
+
+// 客户端键
+unsigned long long ratelimit_key(const char *data, size_t len) {
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 1099511628211ULL;
+    }
+    return hash ? hash : 1;
+}
+
+// 补充令牌 (不超过桶容量)
+static void refill(RateLimitEntry *e, long long now) {
+    double elapsed = (now - e->updated_ms) / 1000.0;
+    if (elapsed <= 0) return;
+
+    e->requests += elapsed * limits.requests_per_sec;
+    if (e->requests > limits.request_burst) e->requests = limits.request_burst;
+    e->tokens += elapsed * limits.tokens_per_sec;
+    if (e->tokens > limits.token_burst) e->tokens = limits.token_burst;
+    e->updated_ms = now;
+}
+
+// 在组内查找客户端 (调用者持有组锁)，create = 1 时不存在则占用空槽位或替换最久未访问的
+static RateLimitEntry* set_lookup(RateLimitSet *set, unsigned long long client, long long now,
+                                  int create) {
+    RateLimitEntry *victim = &set->ways[0];
+    for (int i = 0; i < RATELIMIT_WAYS; i++) {
+        RateLimitEntry *e = &set->ways[i];
+        if (e->client == client) return e;
+        if (victim->client != 0 && (e->client == 0 || e->updated_ms < victim->updated_ms)) victim = e;
+    }
+    if (!create) return NULL;
+
+    // 新客户端的桶是满的
+    victim->client = client;
+    victim->requests = limits.request_burst;
+    victim->tokens = limits.token_burst;
+    victim->updated_ms = now;
+    return victim;
+}
+
+// 请求开始
+long ratelimit_acquire(unsigned long long client) {
+    if (!sets) return 0;
+
+    long long now = now_ms();
+    RateLimitSet *set = &sets[client % set_count];
+    long retry_ms = 0;
+
+    pthread_mutex_lock(&set->lock);
+    RateLimitEntry *e = set_lookup(set, client, now, 1);
+    refill(e, now);
+
+    if (limits.requests_per_sec > 0 && e->requests < 1) {
+        retry_ms = (long)((1 - e->requests) * 1000 / limits.requests_per_sec) + 1;
+    }
+    if (limits.tokens_per_sec > 0 && e->tokens <= 0) {
+        // 透支的 token 还清后才放行
+        long wait = (long)((1 - e->tokens) * 1000 / limits.tokens_per_sec) + 1;
+        if (wait > retry_ms) retry_ms = wait;
+    }
+    if (retry_ms == 0 && limits.requests_per_sec > 0) {
+        e->requests -= 1;
+    }
+    pthread_mutex_unlock(&set->lock);
+
+    return retry_ms;
+}
+
+// 记录生成的 token (透支下限为一个桶容量，避免长回复锁死客户端)
+void ratelimit_charge(unsigned long long client, long tokens) {
+    if (!sets || limits.tokens_per_sec <= 0 || tokens <= 0) return;
+
+    long long now = now_ms();
+    RateLimitSet *set = &sets[client % set_count];
+
+    pthread_mutex_lock(&set->lock);
+    RateLimitEntry *e = set_lookup(set, client, now, 0);
+    if (e) {
+        refill(e, now);
+        e->tokens -= tokens;
+        if (e->tokens < -limits.token_burst) e->tokens = -limits.token_burst;
+    }
+    pthread_mutex_unlock(&set->lock);
+}
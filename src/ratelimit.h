@@ -0,0 +1,37 @@
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include <stddef.h>
+
+// 按客户端限流: 每个客户端 (API key 或 IP 地址) 两个令牌桶，
+// 请求数/秒 和 生成的 token 数/秒 (按回复长度估算)，访问时按经过的时间补充 (惰性)。
+// 固定大小的组相联表: 每组 RATELIMIT_WAYS 个槽位和一把锁，组满时替换最久未访问的客户端。
+// 表在启动时一次分配，大小来自平台预设，所有 worker 共享。
+
+#define RATELIMIT_WAYS 8
+#define RATELIMIT_BYTES_PER_TOKEN 4     // 估算: 每 4 字节回复约一个 token
+
+typedef struct {
+    double requests_per_sec;    // 0 = 不限制请求数
+    double request_burst;       // 桶容量 (<= 0 = 2 秒的量)
+    double tokens_per_sec;      // 0 = 不限制生成 token
+    double token_burst;         // 桶容量 (<= 0 = 10 秒的量)
+    int clients;                // 表容量 (按组向上取整)
+} RateLimitConfig;
+
+// 初始化，两种速率都为 0 或 clients = 0 时关闭限流
+int ratelimit_init(const RateLimitConfig *config);
+void ratelimit_cleanup(void);
+
+int ratelimit_enabled(void);
+
+// 客户端键 (FNV-1a，0 保留为空槽位)
+unsigned long long ratelimit_key(const char *data, size_t len);
+
+// 请求开始: 允许时扣除一个请求令牌并返回 0，否则返回建议的重试等待毫秒数 (> 0)
+long ratelimit_acquire(unsigned long long client);
+
+// 记录生成的 token (可透支，余额恢复为正之前新请求被拒绝)
+void ratelimit_charge(unsigned long long client, long tokens);
+
+#endif
@@ -0,0 +1,264 @@
+#include "resolver.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+typedef struct {
+    char host[256];
+    ResolverAddr addrs[RESOLVER_MAX_ADDRS];
+    int count;              // 0 = 解析失败 (负缓存)
+    long long expires_ms;
+    int lifetime_ms;        // 本条目的 TTL (成功为 ttl_ms，失败为负缓存 TTL)，决定提前刷新的余量
+    long long last_used_ms; // 缓存满时淘汰最久未使用的条目
+} ResolverEntry;
+
+static ResolverEntry entries[RESOLVER_MAX_ENTRIES];
+static int entry_count = 0;
+static int ttl_ms = RESOLVER_DEFAULT_TTL_MS;
+static pthread_mutex_t resolver_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// 后台刷新线程
+static pthread_t refresh_thread;
+static int refresh_running = 0;
+static int refresh_requested = 0;   // 有新主机名等待解析 (线程忙时的唤醒不丢失)
+static pthread_mutex_t refresh_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t refresh_cond = PTHREAD_COND_INITIALIZER;
+
+// 单调时钟 (毫秒)
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 设置缓存时间
+void resolver_set_ttl(int ttl) {
+    if (ttl > 0) ttl_ms = ttl;
+}
+
+// 写入端口 (缓存中的地址端口为 0)
+static void set_port(ResolverAddr *addr, int port) {
+    if (addr->addr.ss_family == AF_INET6) {
+        ((struct sockaddr_in6*)&addr->addr)->sin6_port = htons(port);
+    } else {
+        ((struct sockaddr_in*)&addr->addr)->sin_port = htons(port);
+    }
+}
+
+// 调用 getaddrinfo (可能阻塞)，返回地址个数
+static int resolve(const char *host, int numeric_only, ResolverAddr *addrs, int max) {
+    struct addrinfo hints, *result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = numeric_only ? AI_NUMERICHOST : 0;
+
+    int error = getaddrinfo(host, NULL, &hints, &result);
+    if (error != 0) {
+        if (!numeric_only) {
+            fprintf(stderr, "[Resolver] %s: %s\n", host, gai_strerror(error));
+        }
+        return 0;
+    }
+
+    int count = 0;
+    for (struct addrinfo *ai = result; ai && count < max; ai = ai->ai_next) {
+        if (ai->ai_addrlen > sizeof(addrs[count].addr)) continue;
+        memcpy(&addrs[count].addr, ai->ai_addr, ai->ai_addrlen);
+        addrs[count].len = ai->ai_addrlen;
+        count++;
+    }
+    freeaddrinfo(result);
+    return count;
+}
+
+// 查找条目 (调用者持有 resolver_lock)
+static ResolverEntry* find_entry(const char *host) {
+    for (int i = 0; i < entry_count; i++) {
+        if (strcmp(entries[i].host, host) == 0) return &entries[i];
+    }
+    return NULL;
+}
+
+// 新建条目，缓存满时淘汰最久未使用的 (调用者持有 resolver_lock)
+static ResolverEntry* add_entry(const char *host, long long now) {
+    ResolverEntry *entry;
+    if (entry_count < RESOLVER_MAX_ENTRIES) {
+        entry = &entries[entry_count++];
+    } else {
+        entry = &entries[0];
+        for (int i = 1; i < entry_count; i++) {
+            if (entries[i].last_used_ms < entry->last_used_ms) entry = &entries[i];
+        }
+    }
+    memset(entry, 0, sizeof(*entry));
+    strncpy(entry->host, host, sizeof(entry->host) - 1);
+    entry->last_used_ms = now;
+    return entry;
+}
+
+// 唤醒后台线程 (立即解析新加入的主机名)
+static void wake_refresh(void) {
+    pthread_mutex_lock(&refresh_lock);
+    refresh_requested = 1;
+    pthread_cond_signal(&refresh_cond);
+    pthread_mutex_unlock(&refresh_lock);
+}
+
+// 写入解析结果 (失败时保留旧地址，稍后重试)
+static void store_entry(const char *host, const ResolverAddr *addrs, int count, long long now) {
+    pthread_mutex_lock(&resolver_lock);
+    ResolverEntry *entry = find_entry(host);
+    if (!entry) entry = add_entry(host, now);
+
+    if (count > 0) {
+        memcpy(entry->addrs, addrs, count * sizeof(ResolverAddr));
+        entry->count = count;
+        entry->lifetime_ms = ttl_ms;
+    } else {
+        entry->lifetime_ms = RESOLVER_NEGATIVE_TTL_MS;
+    }
+    entry->expires_ms = now + entry->lifetime_ms;
+    pthread_mutex_unlock(&resolver_lock);
+}
+
+// 解析
+int resolver_lookup(const char *host, int port, ResolverAddr *addrs, int max) {
+    if (max > RESOLVER_MAX_ADDRS) max = RESOLVER_MAX_ADDRS;
+
+    // IP 字面量
+    int count = resolve(host, 1, addrs, max);
+
+    if (count == 0) {
+        long long now = now_ms();
+        pthread_mutex_lock(&resolver_lock);
+        ResolverEntry *entry = find_entry(host);
+        if (!entry) {
+            // 未解析过: 登记为已到期的空条目，交给后台线程 (调用者可能是 worker 事件循环)
+            entry = add_entry(host, now);
+            entry->expires_ms = now;
+        }
+        entry->last_used_ms = now;
+
+        // 过期的地址照常返回，由后台线程刷新; 没有地址 (等待解析或负缓存) 时立即失败
+        count = (entry->count < max) ? entry->count : max;
+        memcpy(addrs, entry->addrs, count * sizeof(ResolverAddr));
+        int pending = (entry->count == 0 && now >= entry->expires_ms);
+        pthread_mutex_unlock(&resolver_lock);
+
+        if (pending) wake_refresh();
+    }
+
+    for (int i = 0; i < count; i++) {
+        set_port(&addrs[i], port);
+    }
+    return (count > 0) ? count : -1;
+}
+
+// 在调用线程上解析 (启动时，事件循环之外)
+int resolver_prefetch(const char *host) {
+    ResolverAddr fresh[RESOLVER_MAX_ADDRS];
+    if (resolve(host, 1, fresh, RESOLVER_MAX_ADDRS) > 0) return 0;
+
+    int found = resolve(host, 0, fresh, RESOLVER_MAX_ADDRS);
+    store_entry(host, fresh, found, now_ms());
+    return (found > 0) ? 0 : -1;
+}
+
+// 首选地址移到末尾
+void resolver_report_failure(const char *host) {
+    pthread_mutex_lock(&resolver_lock);
+    ResolverEntry *entry = find_entry(host);
+    if (entry && entry->count > 1) {
+        ResolverAddr first = entry->addrs[0];
+        memmove(&entry->addrs[0], &entry->addrs[1], (entry->count - 1) * sizeof(ResolverAddr));
+        entry->addrs[entry->count - 1] = first;
+    }
+    pthread_mutex_unlock(&resolver_lock);
+}
+
+// 刷新即将到期的条目 (在条目自身 TTL 的最后 10% 内，或已过期; 负缓存按自己的 TTL 重试)
+static void refresh_entries(void) {
+    char host[256];
+    long long now = now_ms();
+
+    for (int i = 0; ; i++) {
+        pthread_mutex_lock(&resolver_lock);
+        if (i >= entry_count) {
+            pthread_mutex_unlock(&resolver_lock);
+            return;
+        }
+        int due = entries[i].expires_ms - now <= entries[i].lifetime_ms / 10;
+        strcpy(host, entries[i].host);
+        pthread_mutex_unlock(&resolver_lock);
+
+        if (!due) continue;
+
+        // getaddrinfo 不持锁: 请求线程继续使用旧地址
+        ResolverAddr fresh[RESOLVER_MAX_ADDRS];
+        int found = resolve(host, 0, fresh, RESOLVER_MAX_ADDRS);
+        store_entry(host, fresh, found, now_ms());
+    }
+}
+
+// 后台线程
+static void* refresh_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&refresh_lock);
+    while (refresh_running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += RESOLVER_REFRESH_INTERVAL_MS / 1000;
+        deadline.tv_nsec += (RESOLVER_REFRESH_INTERVAL_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (!refresh_requested) pthread_cond_timedwait(&refresh_cond, &refresh_lock, &deadline);
+        if (!refresh_running) break;
+        refresh_requested = 0;
+
+        pthread_mutex_unlock(&refresh_lock);
+        refresh_entries();
+        pthread_mutex_lock(&refresh_lock);
+    }
+    pthread_mutex_unlock(&refresh_lock);
+    return NULL;
+}
+
+// 启动后台刷新
+int resolver_start(void) {
+    pthread_mutex_lock(&refresh_lock);
+    if (refresh_running) {
+        pthread_mutex_unlock(&refresh_lock);
+        return 0;
+    }
+    refresh_running = 1;
+    pthread_mutex_unlock(&refresh_lock);
+
+    if (pthread_create(&refresh_thread, NULL, refresh_main, NULL) != 0) {
+        perror("pthread_create failed");
+        refresh_running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+// 停止后台刷新
+void resolver_stop(void) {
+    pthread_mutex_lock(&refresh_lock);
+    if (!refresh_running) {
+        pthread_mutex_unlock(&refresh_lock);
+        return;
+    }
+    refresh_running = 0;
+    pthread_cond_signal(&refresh_cond);
+    pthread_mutex_unlock(&refresh_lock);
+
+    pthread_join(refresh_thread, NULL);
+}
@@ -0,0 +1,39 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <sys/socket.h>
+
+// 后端主机名解析缓存: getaddrinfo (IPv4 / IPv6) 的结果按 TTL 缓存。
+// 条目到期前由后台线程刷新，到期后仍返回旧地址直到刷新成功。
+// 查询从不在调用线程上阻塞: 未缓存的主机名交给后台线程解析，本次查询立即失败。
+// 启动时用 resolver_prefetch 预先解析已知的后端。IP 字面量直接解析，不进入缓存。
+
+#define RESOLVER_MAX_ENTRIES 16
+#define RESOLVER_MAX_ADDRS 4
+#define RESOLVER_DEFAULT_TTL_MS 60000
+#define RESOLVER_NEGATIVE_TTL_MS 5000       // 解析失败的缓存时间
+#define RESOLVER_REFRESH_INTERVAL_MS 1000   // 后台线程检查间隔
+
+typedef struct {
+    struct sockaddr_storage addr;
+    socklen_t len;
+} ResolverAddr;
+
+// 设置缓存时间 (毫秒)
+void resolver_set_ttl(int ttl_ms);
+
+// 解析 host:port，按优先顺序写入 addrs，返回地址个数
+// 未缓存 (已交给后台线程) 或解析失败 (负缓存) 时返回 -1
+int resolver_lookup(const char *host, int port, ResolverAddr *addrs, int max);
+
+// 在调用线程上解析并写入缓存 (可能阻塞，只在启动时调用)，失败返回 -1
+int resolver_prefetch(const char *host);
+
+// 首选地址连接失败: 移到列表末尾，后续连接先尝试其他地址
+void resolver_report_failure(const char *host);
+
+// 启动 / 停止后台刷新线程
+int resolver_start(void);
+void resolver_stop(void);
+
+#endif
@@ -4,64 +4,85 @@
 #include "sensor.h"
 #include "actuator.h"
 #include "platform.h"
+#include "json.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 
 #define MAX_RULES 16
-#define MAX_LINE 2048
 
 static rule_t g_rules[MAX_RULES];
 static int g_rule_count = 0;
 
+// Rule being parsed (values may arrive in fragments when read from a file)
+typedef struct {
+    rule_t rule;
+    char op[8];
+    char value[32];
+    int added;
+    int limit;                  // Stop after this many rules (0 = until the table is full)
+} rule_parse_t;
+
+static rule_operator_t parse_operator(const char *op) {
+    if (strcmp(op, ">") == 0) return RULE_OP_GT;
+    if (strcmp(op, "<") == 0) return RULE_OP_LT;
+    if (strcmp(op, "==") == 0) return RULE_OP_EQ;
+    if (strcmp(op, "!=") == 0) return RULE_OP_NE;
+    if (strcmp(op, ">=") == 0) return RULE_OP_GTE;
+    if (strcmp(op, "<=") == 0) return RULE_OP_LTE;
+    return RULE_OP_UNKNOWN;
+}
+
+// Parse events of one rule object (paths relative to the rule); the rule is added at its closing brace
+static int rule_parse_event(const JsonEvent *event, void *user) {
+    rule_parse_t *parse = user;
+    rule_t *rule = &parse->rule;
+    if (!event->path) return 0;
+
+    if (event->type == JSON_OBJECT && event->depth == 0) {
+        memset(rule, 0, sizeof(rule_t));
+        parse->op[0] = '\0';
+        parse->value[0] = '\0';
+    } else if (event->type == JSON_STRING) {
+        if (strcmp(event->path, "/id") == 0) {
+            json_append(rule->id, sizeof(rule->id), event);
+        } else if (strcmp(event->path, "/name") == 0) {
+            json_append(rule->name, sizeof(rule->name), event);
+        } else if (strcmp(event->path, "/condition/sensor") == 0) {
+            json_append(rule->condition.sensor_id, sizeof(rule->condition.sensor_id), event);
+        } else if (strcmp(event->path, "/condition/operator") == 0) {
+            json_append(parse->op, sizeof(parse->op), event);
+        }
+    } else if (event->type == JSON_NUMBER && strcmp(event->path, "/condition/value") == 0) {
+        json_append(parse->value, sizeof(parse->value), event);
+    } else if (event->type == JSON_OBJECT_END && event->depth == 0) {
+        if (g_rule_count >= MAX_RULES) return 1;
+
+        if (parse->op[0]) rule->condition.operator = parse_operator(parse->op);
+        if (parse->value[0]) rule->condition.value = atof(parse->value);
+        rule->enabled = 1;
+        rule->triggered_count = 0;
+        rule->last_triggered_ms = 0;
+        rule->created_at = platform_get_time_ms();
+
+        g_rules[g_rule_count++] = *rule;
+        parse->added++;
+        if (parse->limit && parse->added >= parse->limit) return 1;
+    }
+    return 0;
+}
+
 // Initialize rule system
 int rule_system_init(const char *config_file) {
     memset(g_rules, 0, sizeof(g_rules));
     g_rule_count = 0;
 
-    // Load configuration from file (JSON format)
-    FILE *fp = fopen(config_file, "r");
-    if (!fp) {
+    // Load configuration from file: {"rules":[{...}, ...]}
+    static rule_parse_t parse;
+    memset(&parse, 0, sizeof(parse));
+    if (json_load_records(config_file, "/rules", rule_parse_event, &parse) < 0) {
         return -1;
     }
-
-    char line[MAX_LINE];
-    while (fgets(line, sizeof(line), fp) && g_rule_count < MAX_RULES) {
-        // Parse JSON line (simplified parsing)
-        // In production, use a proper JSON parser
-        if (strstr(line, "\"id\":")) {
-            char *id_start = strstr(line, "\"id\":\"");
-            if (id_start) {
-                id_start += 6;
-                char *id_end = strstr(id_start, "\"");
-                if (id_end) {
-                    size_t id_len = id_end - id_start;
-                    memcpy(g_rules[g_rule_count].id, id_start, id_len);
-                    g_rules[g_rule_count].id[id_len] = '\0';
-                }
-            }
-        }
-        if (strstr(line, "\"name\":")) {
-            char *name_start = strstr(line, "\"name\":\"");
-            if (name_start) {
-                name_start += 8;
-                char *name_end = strstr(name_start, "\"");
-                if (name_end) {
-                    size_t name_len = name_end - name_start;
-                    memcpy(g_rules[g_rule_count].name, name_start, name_len);
-                    g_rules[g_rule_count].name[name_len] = '\0';
-                }
-            }
-        }
-        // ... (parse other fields: condition, actions)
-        g_rules[g_rule_count].enabled = 1;
-        g_rules[g_rule_count].triggered_count = 0;
-        g_rules[g_rule_count].last_triggered_ms = 0;
-        g_rules[g_rule_count].created_at = platform_get_time_ms();
-        g_rule_count++;
-    }
-
-    fclose(fp);
     return g_rule_count;
 }
 
@@ -112,70 +133,15 @@ int rule_add(const char *rule_json) {
         return -1;
     }
 
-    // Parse JSON (simplified parsing)
-    // In production, use a proper JSON parser
-    rule_t *rule = &g_rules[g_rule_count];
-    memset(rule, 0, sizeof(rule_t));
-
-    // Parse ID
-    char *id_start = strstr(rule_json, "\"id\":");
-    if (id_start) {
-        id_start = strstr(id_start + 5, "\"") + 1;
-        char *id_end = strstr(id_start, "\"");
-        if (id_end) {
-            size_t id_len = id_end - id_start;
-            memcpy(rule->id, id_start, id_len);
-            rule->id[id_len] = '\0';
-        }
-    }
+    static rule_parse_t parse;
+    memset(&parse, 0, sizeof(parse));
+    parse.limit = 1;
 
-    // Parse name
-    char *name_start = strstr(rule_json, "\"name\":");
-    if (name_start) {
-        name_start = strstr(name_start + 7, "\"") + 1;
-        char *name_end = strstr(name_start, "\"");
-        if (name_end) {
-            size_t name_len = name_end - name_start;
-            memcpy(rule->name, name_start, name_len);
-            rule->name[name_len] = '\0';
-        }
+    JsonParser parser;
+    json_parser_init(&parser);
+    if (json_feed(&parser, rule_json, strlen(rule_json), rule_parse_event, &parse) < 0 || parse.added == 0) {
+        return -2;
     }
-
-    // Parse condition
-    char *condition_start = strstr(rule_json, "\"condition\":");
-    if (condition_start) {
-        char *sensor_start = strstr(condition_start, "\"sensor\":\"");
-        if (sensor_start) {
-            sensor_start += 10;
-            char *sensor_end = strstr(sensor_start, "\"");
-            if (sensor_end) {
-                size_t sensor_len = sensor_end - sensor_start;
-                memcpy(rule->condition.sensor_id, sensor_start, sensor_len);
-                rule->condition.sensor_id[sensor_len] = '\0';
-            }
-        }
-
-        char *op_start = strstr(condition_start, "\"operator\":");
-        if (op_start) {
-            // Parse operator (simplified)
-            if (strstr(op_start, ">")) rule->condition.operator = RULE_OP_GT;
-            else if (strstr(op_start, "<")) rule->condition.operator = RULE_OP_LT;
-            else if (strstr(op_start, "==")) rule->condition.operator = RULE_OP_EQ;
-            else rule->condition.operator = RULE_OP_UNKNOWN;
-        }
-
-        char *value_start = strstr(condition_start, "\"value\":");
-        if (value_start) {
-            rule->condition.value = atof(value_start + 8);
-        }
-    }
-
-    rule->enabled = 1;
-    rule->triggered_count = 0;
-    rule->last_triggered_ms = 0;
-    rule->created_at = platform_get_time_ms();
-
-    g_rule_count++;
     return 0;
 }
 
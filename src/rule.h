@@ -4,6 +4,7 @@
 #ifndef RULE_H
 #define RULE_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 // Condition operators
@@ -83,7 +84,7 @@ void rule_system_cleanup(void);
 // List all rules
 int rule_list(char *buffer, size_t buffer_size);
 
-// Add rule (from JSON or LLM-generated)
+// Add rule (from JSON or LLM-generated): -1 = table full, -2 = invalid rule JSON
 int rule_add(const char *rule_json);
 
 // Remove rule
@@ -2,18 +2,18 @@
 
 #include "sensor.h"
 #include "platform.h"
+#include "json.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 
 #define MAX_SENSORS 16
-#define MAX_LINE 256
 
 static sensor_config_t g_sensors[MAX_SENSORS];
 static int g_sensor_count = 0;
 
 // Parse sensor type from string
-static sensor_type_t parse_sensor_type(const char *type_str) {
+static inline sensor_type_t parse_sensor_type(const char *type_str) {
     if (strcmp(type_str, "temperature") == 0) return SENSOR_TYPE_TEMPERATURE;
     if (strcmp(type_str, "humidity") == 0) return SENSOR_TYPE_HUMIDITY;
     if (strcmp(type_str, "light") == 0) return SENSOR_TYPE_LIGHT;
@@ -26,7 +26,7 @@ static sensor_type_t parse_sensor_type(const char *type_str) {
 }
 
 // Parse sensor driver from string
-static sensor_driver_t parse_sensor_driver(const char *driver_str) {
+static inline sensor_driver_t parse_sensor_driver(const char *driver_str) {
     if (strcmp(driver_str, "dht22") == 0) return SENSOR_DRIVER_DHT22;
     if (strcmp(driver_str, "bh1750") == 0) return SENSOR_DRIVER_BH1750;
     if (strcmp(driver_str, "hc-sr04") == 0) return SENSOR_DRIVER_HC_SR04;
@@ -37,41 +37,63 @@ static sensor_driver_t parse_sensor_driver(const char *driver_str) {
     return SENSOR_DRIVER_UNKNOWN;
 }
 
+// Sensor being parsed (values may arrive in fragments)
+typedef struct {
+    sensor_config_t sensor;
+    char type[32];
+    char driver[32];
+    char interval[16];
+} sensor_parse_t;
+
+// Parse events of one sensor object (paths relative to the sensor)
+static int sensor_parse_event(const JsonEvent *event, void *user) {
+    sensor_parse_t *parse = user;
+    sensor_config_t *sensor = &parse->sensor;
+    if (!event->path) return 0;
+
+    if (event->type == JSON_OBJECT && event->depth == 0) {
+        memset(parse, 0, sizeof(*parse));
+    } else if (event->type == JSON_STRING || event->type == JSON_NUMBER) {
+        const char *key = event->path;
+        if (strcmp(key, "/id") == 0) {
+            json_append(sensor->id, sizeof(sensor->id), event);
+        } else if (strcmp(key, "/name") == 0) {
+            json_append(sensor->name, sizeof(sensor->name), event);
+        } else if (strcmp(key, "/type") == 0) {
+            json_append(parse->type, sizeof(parse->type), event);
+        } else if (strcmp(key, "/driver") == 0) {
+            json_append(parse->driver, sizeof(parse->driver), event);
+        } else if (strcmp(key, "/driver_params") == 0) {
+            json_append(sensor->driver_params, sizeof(sensor->driver_params), event);
+        } else if (strcmp(key, "/interval_ms") == 0) {
+            json_append(parse->interval, sizeof(parse->interval), event);
+        } else if (strcmp(key, "/unit") == 0) {
+            json_append(sensor->unit, sizeof(sensor->unit), event);
+        }
+    } else if (event->type == JSON_OBJECT_END && event->depth == 0) {
+        if (g_sensor_count >= MAX_SENSORS) return 1;
+
+        sensor->type = parse_sensor_type(parse->type);
+        sensor->driver = parse_sensor_driver(parse->driver);
+        sensor->interval_ms = (uint32_t)strtoul(parse->interval, NULL, 10);
+        sensor->enabled = 1;
+        sensor->value = 0.0f;
+        sensor->last_update_ms = 0;
+        g_sensors[g_sensor_count++] = *sensor;
+    }
+    return 0;
+}
+
 // Initialize sensor system
 int sensor_system_init(const char *config_file) {
     memset(g_sensors, 0, sizeof(g_sensors));
     g_sensor_count = 0;
 
-    // Load configuration from file (JSON format)
-    FILE *fp = fopen(config_file, "r");
-    if (!fp) {
+    // Load configuration from file: {"sensors":[{...}, ...]}
+    sensor_parse_t parse;
+    if (json_load_records(config_file, "/sensors", sensor_parse_event, &parse) < 0) {
         return -1;
     }
-
-    char line[MAX_LINE];
-    while (fgets(line, sizeof(line), fp) && g_sensor_count < MAX_SENSORS) {
-        // Parse JSON line (simplified parsing)
-        // In production, use a proper JSON parser
-        if (strstr(line, "\"id\":")) {
-            char *id_start = strstr(line, "\"id\":\"");
-            if (id_start) {
-                id_start += 6;
-                char *id_end = strstr(id_start, "\"");
-                if (id_end) {
-                    size_t id_len = id_end - id_start;
-                    memcpy(g_sensors[g_sensor_count].id, id_start, id_len);
-                    g_sensors[g_sensor_count].id[id_len] = '\0';
-                }
-            }
-        }
-        // ... (parse other fields)
-        g_sensors[g_sensor_count].enabled = 1;
-        g_sensors[g_sensor_count].value = 0.0f;
-        g_sensors[g_sensor_count].last_update_ms = 0;
-        g_sensor_count++;
-    }
-
-    fclose(fp);
     return g_sensor_count;
 }
 
@@ -4,6 +4,7 @@
 #ifndef SENSOR_H
 #define SENSOR_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 // Sensor types
@@ -0,0 +1,107 @@
+#include "timer_wheel.h"
+#include <stddef.h>
+
+static void list_init(TimerNode *head) {
+    head->prev = head;
+    head->next = head;
+}
+
+static void list_insert(TimerNode *head, TimerNode *node) {
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+static void list_unlink(TimerNode *node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = NULL;
+}
+
+// 初始化
+void timer_wheel_init(TimerWheel *wheel, int tick_ms, long long now_ms) {
+    wheel->tick_ms = (tick_ms > 0) ? tick_ms : TIMER_WHEEL_TICK_MS;
+    wheel->current_tick = now_ms / wheel->tick_ms;
+    wheel->count = 0;
+    for (int i = 0; i < TIMER_WHEEL_SLOTS; i++) {
+        list_init(&wheel->slots[i]);
+    }
+}
+
+// 启动定时器
+void timer_arm(TimerWheel *wheel, TimerNode *node, long long expires_ms) {
+    timer_cancel(wheel, node);
+
+    long long tick = expires_ms / wheel->tick_ms;
+    if (tick <= wheel->current_tick) {
+        tick = wheel->current_tick + 1;  // 已过期: 下一次推进时触发
+    }
+
+    node->expires_ms = expires_ms;
+    node->armed = 1;
+    list_insert(&wheel->slots[tick & (TIMER_WHEEL_SLOTS - 1)], node);
+    wheel->count++;
+}
+
+// 取消定时器
+void timer_cancel(TimerWheel *wheel, TimerNode *node) {
+    if (!node->armed) return;
+    list_unlink(node);
+    node->armed = 0;
+    wheel->count--;
+}
+
+// 推进时间轮
+void timer_wheel_advance(TimerWheel *wheel, long long now_ms, TimerCallback callback, void *arg) {
+    long long target = now_ms / wheel->tick_ms;
+    long long ticks = target - wheel->current_tick;
+    if (ticks <= 0) return;
+    if (ticks > TIMER_WHEEL_SLOTS) ticks = TIMER_WHEEL_SLOTS;  // 间隔超过一圈: 每个槽位扫描一次
+
+    // 间隔超过一圈时扫描以 target 结尾的一圈，推进后不会留下已扫描过的未来槽位
+    long long first = target - ticks + 1;
+
+    for (long long tick = first; tick <= target; tick++) {
+        // 先推进当前 tick: 回调中重新启动的定时器落在尚未处理的槽位
+        wheel->current_tick = tick;
+        TimerNode *slot = &wheel->slots[tick & (TIMER_WHEEL_SLOTS - 1)];
+        if (slot->next == slot) continue;
+
+        // 先把槽位整体移到临时链表，回调中新启动的定时器不会在本轮被处理
+        TimerNode pending;
+        pending.next = slot->next;
+        pending.prev = slot->prev;
+        pending.next->prev = &pending;
+        pending.prev->next = &pending;
+        list_init(slot);
+
+        while (pending.next != &pending) {
+            TimerNode *node = pending.next;
+            list_unlink(node);
+
+            if (node->expires_ms / wheel->tick_ms > tick && node->expires_ms > now_ms) {
+                list_insert(slot, node);   // 属于以后的某一圈
+                continue;
+            }
+
+            node->armed = 0;
+            wheel->count--;
+            callback(node, arg);
+        }
+    }
+}
+
+// 距离下一个非空槽位的时间 (最多扫描一圈，避免空闲时按 tick 空转)
+int timer_wheel_timeout(const TimerWheel *wheel, long long now_ms) {
+    if (wheel->count == 0) return -1;
+
+    for (long long t = 1; t <= TIMER_WHEEL_SLOTS; t++) {
+        const TimerNode *slot = &wheel->slots[(wheel->current_tick + t) & (TIMER_WHEEL_SLOTS - 1)];
+        if (slot->next != slot) {
+            long long due = (wheel->current_tick + t) * wheel->tick_ms;
+            return (due > now_ms) ? (int)(due - now_ms) : 0;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+// 哈希时间轮: 按到期 tick 散列到槽位，定时器节点嵌入在调用者的结构体中。
+// 启动/取消为 O(1)，推进时每个 tick 只访问一个槽位；超过一圈的定时器
+// 在槽位中比较到期时间后保留到下一圈。
+
+#define TIMER_WHEEL_SLOTS 512       // 必须是 2 的幂
+#define TIMER_WHEEL_TICK_MS 10      // 默认精度
+
+typedef struct TimerNode {
+    struct TimerNode *prev;
+    struct TimerNode *next;
+    long long expires_ms;
+    int armed;
+    int tag;                // 调用者自定义 (区分同一结构体中的多个定时器)
+} TimerNode;
+
+typedef struct {
+    TimerNode slots[TIMER_WHEEL_SLOTS];     // 每个槽位一个哨兵
+    int tick_ms;
+    long long current_tick;                 // 已处理到的 tick
+    int count;                              // 已启动的定时器数
+} TimerWheel;
+
+// 到期回调
+typedef void (*TimerCallback)(TimerNode *node, void *arg);
+
+// 初始化
+void timer_wheel_init(TimerWheel *wheel, int tick_ms, long long now_ms);
+
+// 启动 (已启动的定时器会先取消)
+void timer_arm(TimerWheel *wheel, TimerNode *node, long long expires_ms);
+
+// 取消 (未启动时为空操作)
+void timer_cancel(TimerWheel *wheel, TimerNode *node);
+
+// 推进到 now_ms，对到期的定时器调用 callback (回调中可以启动/取消任意定时器)
+void timer_wheel_advance(TimerWheel *wheel, long long now_ms, TimerCallback callback, void *arg);
+
+// 距离下一个可能到期的槽位的等待时间，用作 epoll 超时 (没有定时器时返回 -1)
+int timer_wheel_timeout(const TimerWheel *wheel, long long now_ms);
+
+#endif
@@ -0,0 +1,503 @@
+#include "upstream.h"
+#include "resolver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+static UpstreamPool pools[UPSTREAM_MAX_POOLS];
+static int pool_count = 0;
+static int default_max_idle = UPSTREAM_DEFAULT_IDLE;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// 单调时钟 (毫秒)
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 设置空闲连接上限
+void upstream_set_max_idle(int max_idle) {
+    if (max_idle < 0) max_idle = 0;
+    if (max_idle > UPSTREAM_MAX_IDLE) max_idle = UPSTREAM_MAX_IDLE;
+    default_max_idle = max_idle;
+}
+
+// 获取 (或创建) host:port 的连接池
+UpstreamPool* upstream_pool_get(const char *host, int port) {
+    UpstreamPool *pool = NULL;
+
+    pthread_mutex_lock(&registry_lock);
+    for (int i = 0; i < pool_count; i++) {
+        if (pools[i].port == port && strcmp(pools[i].host, host) == 0) {
+            pool = &pools[i];
+            break;
+        }
+    }
+
+    if (!pool && pool_count < UPSTREAM_MAX_POOLS) {
+        pool = &pools[pool_count++];
+        memset(pool, 0, sizeof(*pool));
+        strncpy(pool->host, host, sizeof(pool->host) - 1);
+        pool->port = port;
+        pool->max_idle = default_max_idle;
+        pthread_mutex_init(&pool->lock, NULL);
+    }
+    pthread_mutex_unlock(&registry_lock);
+
+    if (!pool) {
+        fprintf(stderr, "[Upstream] Too many backends (max %d)\n", UPSTREAM_MAX_POOLS);
+    }
+    return pool;
+}
+
+// 空闲连接健康检查: 没有可读数据且未被对端关闭
+static int connection_alive(int fd) {
+    char c;
+    ssize_t n = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n == 0) return 0;       // 对端已关闭
+    if (n > 0) return 0;        // 残留数据，分帧已不可信
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+// 新建非阻塞连接: 依次尝试解析出的地址，不等待 connect 完成 (由事件循环在可写时确认)
+static int connect_upstream(UpstreamPool *pool) {
+    ResolverAddr addrs[RESOLVER_MAX_ADDRS];
+    int count = resolver_lookup(pool->host, pool->port, addrs, RESOLVER_MAX_ADDRS);
+    if (count < 0) {
+        fprintf(stderr, "[Upstream] Cannot resolve %s\n", pool->host);
+        return -1;
+    }
+
+    int fd = -1;
+    for (int i = 0; i < count && fd < 0; i++) {
+        fd = socket(addrs[i].addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            perror("socket failed");
+            continue;
+        }
+
+        // 请求一次性写出，不等待 Nagle 合并
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        if (connect(fd, (struct sockaddr*)&addrs[i].addr, addrs[i].len) < 0 && errno != EINPROGRESS) {
+            // 立即失败 (如本机未监听该地址族): 换下一个地址
+            perror("connect failed");
+            resolver_report_failure(pool->host);
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd < 0) return -1;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->connects++;
+    pthread_mutex_unlock(&pool->lock);
+    return fd;
+}
+
+// 取出连接
+int upstream_checkout(UpstreamPool *pool, int *reused) {
+    long long now = now_ms();
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->idle_count > 0) {
+        pool->idle_count--;
+        int fd = pool->idle_fds[pool->idle_count];
+        long long since = pool->idle_since[pool->idle_count];
+
+        if (now - since < UPSTREAM_IDLE_TIMEOUT_MS && connection_alive(fd)) {
+            pool->reuses++;
+            pthread_mutex_unlock(&pool->lock);
+            *reused = 1;
+            return fd;
+        }
+        close(fd);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    *reused = 0;
+    return connect_upstream(pool);
+}
+
+// 归还连接
+void upstream_release(UpstreamPool *pool, int fd, int reusable) {
+    if (fd < 0) return;
+
+    if (reusable) {
+        pthread_mutex_lock(&pool->lock);
+        if (pool->idle_count < pool->max_idle) {
+            pool->idle_fds[pool->idle_count] = fd;
+            pool->idle_since[pool->idle_count] = now_ms();
+            pool->idle_count++;
+            fd = -1;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    if (fd >= 0) close(fd);
+}
+
+// 读入更多原始数据 (不等待): >0 字节数, 0 = 对端关闭, -1 = 错误, -2 = 暂无数据
+static int fill_buffer(UpstreamResponse *resp) {
+    if (resp->start == resp->end) {
+        resp->start = resp->end = 0;
+    } else if (resp->end == (int)sizeof(resp->buf) && resp->start > 0) {
+        memmove(resp->buf, resp->buf + resp->start, resp->end - resp->start);
+        resp->end -= resp->start;
+        resp->start = 0;
+    }
+    if (resp->end == (int)sizeof(resp->buf)) return -1;  // 单行超过缓冲区
+
+    ssize_t n;
+    do {
+        n = recv(resp->fd, resp->buf + resp->end, sizeof(resp->buf) - resp->end, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? -2 : -1;
+
+    resp->end += (int)n;
+    return (int)n;
+}
+
+// 值中是否包含 token (不区分大小写)
+static int value_has_token(const char *value, int len, const char *token) {
+    size_t n = strlen(token);
+    for (int i = 0; i + (int)n <= len; i++) {
+        if (strncasecmp(value + i, token, n) == 0) return 1;
+    }
+    return 0;
+}
+
+// 解析状态行和响应头，确定 body 分帧方式
+static int parse_headers(UpstreamResponse *resp, char *header_end) {
+    // 状态行: HTTP/1.x NNN
+    if (strncmp(resp->buf, "HTTP/1.", 7) != 0) return -1;
+    resp->keep_alive = resp->buf[7] != '0';
+    resp->status = atoi(resp->buf + 9);
+
+    long content_length = -1;
+    int chunked = 0;
+    char *line = strstr(resp->buf, "\r\n") + 2;
+    while (line < header_end) {
+        char *eol = strstr(line, "\r\n");
+        char *colon = memchr(line, ':', eol - line);
+        if (colon) {
+            char *value = colon + 1;
+            while (*value == ' ' || *value == '\t') value++;
+            int name_len = (int)(colon - line);
+            int value_len = (int)(eol - value);
+
+            if (name_len == 14 && strncasecmp(line, "Content-Length", 14) == 0) {
+                content_length = strtol(value, NULL, 10);
+            } else if (name_len == 17 && strncasecmp(line, "Transfer-Encoding", 17) == 0) {
+                chunked = value_has_token(value, value_len, "chunked");
+            } else if (name_len == 10 && strncasecmp(line, "Connection", 10) == 0) {
+                if (value_has_token(value, value_len, "close")) {
+                    resp->keep_alive = 0;
+                } else if (value_has_token(value, value_len, "keep-alive")) {
+                    resp->keep_alive = 1;
+                }
+            }
+        }
+        line = eol + 2;
+    }
+
+    resp->start = (int)(header_end + 4 - resp->buf);
+
+    if (resp->status == 204 || resp->status == 304) {
+        resp->state = UPSTREAM_BODY_DONE;
+    } else if (chunked) {
+        resp->state = UPSTREAM_BODY_CHUNK_SIZE;
+    } else if (content_length >= 0) {
+        resp->remaining = content_length;
+        resp->state = (content_length > 0) ? UPSTREAM_BODY_LENGTH : UPSTREAM_BODY_DONE;
+    } else {
+        // 只能读到 EOF，连接无法复用
+        resp->keep_alive = 0;
+        resp->state = UPSTREAM_BODY_EOF;
+    }
+    return 0;
+}
+
+// 继续读取响应头 (可重入): 1 = 完成, 0 = 暂无数据, -1 = 错误
+static int read_headers(UpstreamResponse *resp) {
+    while (1) {
+        if (resp->end > 0) {
+            resp->buf[resp->end] = '\0';
+            char *header_end = strstr(resp->buf, "\r\n\r\n");
+            if (header_end) return (parse_headers(resp, header_end) < 0) ? -1 : 1;
+        }
+
+        // 响应头必须能放进缓冲区 (保留一个字节给 \0)
+        if (resp->end >= (int)sizeof(resp->buf) - 1) return -1;
+
+        ssize_t n = recv(resp->fd, resp->buf + resp->end, sizeof(resp->buf) - 1 - resp->end, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        if (n == 0) return -1;
+        resp->end += (int)n;
+    }
+}
+
+// 从缓冲区取出一行 (不含 \r\n)，没有完整行时返回 NULL
+static char* take_line(UpstreamResponse *resp) {
+    char *begin = resp->buf + resp->start;
+    char *nl = memchr(begin, '\n', resp->end - resp->start);
+    if (!nl) return NULL;
+
+    resp->start = (int)(nl + 1 - resp->buf);
+    if (nl > begin && nl[-1] == '\r') nl--;
+    *nl = '\0';
+    return begin;
+}
+
+// 取出下一段解码后的 body (指向内部缓冲区，不复制)
+ssize_t upstream_body_next(UpstreamResponse *resp, const char **data, size_t size) {
+    if (size == 0) return -1;
+
+    while (1) {
+        int avail = resp->end - resp->start;
+
+        switch (resp->state) {
+            case UPSTREAM_BODY_DONE:
+                return 0;
+
+            case UPSTREAM_BODY_LENGTH:
+            case UPSTREAM_BODY_CHUNK_DATA:
+            case UPSTREAM_BODY_EOF:
+                if (avail > 0) {
+                    size_t n = (size_t)avail;
+                    if (n > size) n = size;
+                    if (resp->state != UPSTREAM_BODY_EOF && n > (size_t)resp->remaining) {
+                        n = (size_t)resp->remaining;
+                    }
+                    *data = resp->buf + resp->start;
+                    resp->start += (int)n;
+
+                    if (resp->state != UPSTREAM_BODY_EOF) {
+                        resp->remaining -= (long)n;
+                        if (resp->remaining == 0) {
+                            resp->state = (resp->state == UPSTREAM_BODY_LENGTH) ? UPSTREAM_BODY_DONE
+                                                                                : UPSTREAM_BODY_CHUNK_CRLF;
+                        }
+                    }
+                    return (ssize_t)n;
+                }
+                break;
+
+            case UPSTREAM_BODY_CHUNK_SIZE:
+            case UPSTREAM_BODY_CHUNK_CRLF:
+            case UPSTREAM_BODY_TRAILERS: {
+                char *line = take_line(resp);
+                if (!line) break;
+
+                if (resp->state == UPSTREAM_BODY_CHUNK_SIZE) {
+                    char *size_end;
+                    long chunk = strtol(line, &size_end, 16);
+                    if (size_end == line || chunk < 0) return -1;
+                    resp->remaining = chunk;
+                    resp->state = (chunk > 0) ? UPSTREAM_BODY_CHUNK_DATA : UPSTREAM_BODY_TRAILERS;
+                } else if (resp->state == UPSTREAM_BODY_CHUNK_CRLF) {
+                    if (*line != '\0') return -1;
+                    resp->state = UPSTREAM_BODY_CHUNK_SIZE;
+                } else if (*line == '\0') {
+                    resp->state = UPSTREAM_BODY_DONE;
+                }
+                continue;
+            }
+        }
+
+        // 需要更多数据
+        int n = fill_buffer(resp);
+        if (n == -2) return -2;
+        if (n < 0) return -1;
+        if (n == 0) {
+            if (resp->state == UPSTREAM_BODY_EOF) {
+                resp->state = UPSTREAM_BODY_DONE;
+                return 0;
+            }
+            return -1;  // body 未完整时连接被关闭
+        }
+    }
+}
+
+// 读取解码后的 body (复制到调用者的缓冲区)
+ssize_t upstream_read_body(UpstreamResponse *resp, char *out, size_t size) {
+    const char *data;
+    ssize_t n = upstream_body_next(resp, &data, size);
+    if (n > 0) memcpy(out, data, n);
+    return n;
+}
+
+// 丢弃剩余 body
+int upstream_drain_body(UpstreamResponse *resp) {
+    const char *data;
+    ssize_t n;
+    while ((n = upstream_body_next(resp, &data, sizeof(resp->buf))) > 0) {
+    }
+    if (n == 0) return 1;
+    return (n == -2) ? 0 : -1;
+}
+
+// 响应读完且上游允许保持连接
+int upstream_reusable(const UpstreamResponse *resp) {
+    return resp->state == UPSTREAM_BODY_DONE && resp->keep_alive && resp->start == resp->end;
+}
+
+// 准备请求并进入发送 (或等待连接) 状态
+static int call_connect(UpstreamCall *call) {
+    call->fd = upstream_checkout(call->pool, &call->reused);
+    if (call->fd < 0) return -1;
+
+    size_t body_len = strlen(call->body);
+    int header_len = snprintf(call->header, sizeof(call->header),
+        "POST %s HTTP/1.1\r\n"
+        "Host: %s:%d\r\n"
+        "Content-Type: application/json\r\n"
+        "Content-Length: %zu\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n",
+        call->path, call->pool->host, call->pool->port, body_len
+    );
+
+    call->iov[0].iov_base = call->header;
+    call->iov[0].iov_len = header_len;
+    call->iov[1].iov_base = (void*)call->body;
+    call->iov[1].iov_len = body_len;
+    call->iov_index = 0;
+
+    memset(&call->resp, 0, offsetof(UpstreamResponse, buf));
+    call->resp.start = call->resp.end = 0;
+    call->resp.fd = call->fd;
+    // 新连接在第一次可写事件时检查 connect 结果 (已连上的 socket 立即可写)
+    call->state = call->reused ? UPSTREAM_CALL_SENDING : UPSTREAM_CALL_CONNECTING;
+    return 0;
+}
+
+// 开始异步调用
+int upstream_call_start(UpstreamCall *call, UpstreamPool *pool, const char *path, const char *body) {
+    call->pool = pool;
+    call->path = path;
+    call->body = body;
+    call->retried = 0;
+    return call_connect(call);
+}
+
+// 发送请求: header 与 body 一次 sendmsg，处理短写 (1 = 完成, 0 = 暂不可写, -1 = 错误)
+static int call_send(UpstreamCall *call) {
+    while (call->iov_index < 2) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = call->iov + call->iov_index;
+        msg.msg_iovlen = 2 - call->iov_index;
+
+        ssize_t sent = sendmsg(call->fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+
+        while (call->iov_index < 2 && (size_t)sent >= call->iov[call->iov_index].iov_len) {
+            sent -= call->iov[call->iov_index].iov_len;
+            call->iov_index++;
+        }
+        if (call->iov_index < 2) {
+            struct iovec *cur = &call->iov[call->iov_index];
+            cur->iov_base = (char*)cur->iov_base + sent;
+            cur->iov_len -= sent;
+        }
+    }
+    return 1;
+}
+
+// 推进调用
+int upstream_call_resume(UpstreamCall *call) {
+    int result = 0;
+
+    switch (call->state) {
+        case UPSTREAM_CALL_CONNECTING: {
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if (getsockopt(call->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
+                fprintf(stderr, "[Upstream] connect %s:%d failed: %s\n", call->pool->host,
+                        call->pool->port, strerror(error ? error : errno));
+                resolver_report_failure(call->pool->host);
+                result = -1;
+                break;
+            }
+            call->state = UPSTREAM_CALL_SENDING;
+        }
+        /* fall through */
+        case UPSTREAM_CALL_SENDING:
+            result = call_send(call);
+            if (result <= 0) break;
+            call->state = UPSTREAM_CALL_HEADERS;
+        /* fall through */
+        case UPSTREAM_CALL_HEADERS:
+            result = read_headers(&call->resp);
+            if (result <= 0) break;
+            call->state = UPSTREAM_CALL_BODY;
+            return 1;
+        case UPSTREAM_CALL_BODY:
+            return 1;
+    }
+
+    if (result < 0) {
+        // 复用的连接可能刚被上游关闭，新连接的首选地址可能不可达:
+        // 尚未收到任何响应时换新连接 (下一个地址) 重试一次
+        int retry = (call->reused || call->state == UPSTREAM_CALL_CONNECTING) &&
+                    !call->retried && call->resp.end == 0;
+        upstream_release(call->pool, call->fd, 0);
+        call->fd = -1;
+        if (!retry) return -1;
+
+        call->retried = 1;
+        if (call_connect(call) < 0) return -1;
+        return upstream_call_resume(call);
+    }
+    return 0;
+}
+
+// 转移调用: 复制状态并修正指向 header / body 的发送位置
+void upstream_call_move(UpstreamCall *dst, const UpstreamCall *src, const char *body) {
+    *dst = *src;
+    dst->body = body;
+    if (src->iov_index == 0) {
+        dst->iov[0].iov_base = dst->header + ((const char*)src->iov[0].iov_base - src->header);
+    }
+    if (body && src->iov_index < 2) {
+        dst->iov[1].iov_base = (char*)body + ((const char*)src->iov[1].iov_base - src->body);
+    }
+}
+
+// 结束调用
+void upstream_call_finish(UpstreamCall *call, int reusable) {
+    upstream_release(call->pool, call->fd, reusable && upstream_reusable(&call->resp));
+    call->fd = -1;
+}
+
+// 关闭所有空闲连接
+void upstream_cleanup(void) {
+    pthread_mutex_lock(&registry_lock);
+    for (int i = 0; i < pool_count; i++) {
+        UpstreamPool *pool = &pools[i];
+        pthread_mutex_lock(&pool->lock);
+        while (pool->idle_count > 0) {
+            close(pool->idle_fds[--pool->idle_count]);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    pthread_mutex_unlock(&registry_lock);
+}
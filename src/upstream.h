@@ -0,0 +1,120 @@
+#ifndef UPSTREAM_H
+#define UPSTREAM_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+// 上游 (Ollama / OpenAI 兼容后端) keep-alive 连接池
+// 每个 host:port 一个池，空闲连接在取出时做健康检查 (MSG_PEEK)，
+// 响应按 Content-Length 或 chunked 分帧，读完后连接归还复用。
+// 所有上游 socket 都是非阻塞的: UpstreamCall 挂在事件循环中逐步推进，读取 body 时不等待。
+
+#define UPSTREAM_MAX_POOLS 16             // 每个后端副本一个池 (BACKEND_MAX_REPLICAS)
+#define UPSTREAM_MAX_IDLE 16            // 每个池空闲连接数的硬上限
+#define UPSTREAM_DEFAULT_IDLE 4
+#define UPSTREAM_IDLE_TIMEOUT_MS 30000  // 空闲超过此时间的连接不再复用
+#define UPSTREAM_READ_BUFFER 4096
+
+typedef struct {
+    char host[256];
+    int port;
+    int idle_fds[UPSTREAM_MAX_IDLE];        // LIFO: 最近使用的连接最可能仍然有效
+    long long idle_since[UPSTREAM_MAX_IDLE];
+    int idle_count;
+    int max_idle;
+    pthread_mutex_t lock;
+    // 统计
+    unsigned long connects;
+    unsigned long reuses;
+} UpstreamPool;
+
+// 响应读取状态
+typedef enum {
+    UPSTREAM_BODY_LENGTH,       // 按 Content-Length
+    UPSTREAM_BODY_EOF,          // 无分帧信息: 读到连接关闭 (不可复用)
+    UPSTREAM_BODY_CHUNK_SIZE,
+    UPSTREAM_BODY_CHUNK_DATA,
+    UPSTREAM_BODY_CHUNK_CRLF,
+    UPSTREAM_BODY_TRAILERS,
+    UPSTREAM_BODY_DONE
+} UpstreamBodyState;
+
+typedef struct {
+    int fd;
+    int status;                 // HTTP 状态码
+    int keep_alive;             // 上游允许复用连接
+    UpstreamBodyState state;
+    long remaining;             // 当前 body / chunk 剩余字节
+    char buf[UPSTREAM_READ_BUFFER];
+    int start;                  // buf 中未消费数据 [start, end)
+    int end;
+} UpstreamResponse;
+
+// 一次上游请求的进度
+typedef enum {
+    UPSTREAM_CALL_CONNECTING,   // 非阻塞 connect 进行中
+    UPSTREAM_CALL_SENDING,
+    UPSTREAM_CALL_HEADERS,      // 等待响应头
+    UPSTREAM_CALL_BODY          // 响应头就绪，由调用者读取 body
+} UpstreamCallState;
+
+typedef struct {
+    UpstreamPool *pool;
+    int fd;
+    int reused;                 // 来自空闲连接
+    int retried;
+    UpstreamCallState state;
+    const char *path;
+    const char *body;           // 由调用者持有直到请求发送完毕
+    char header[512];
+    struct iovec iov[2];
+    int iov_index;
+    UpstreamResponse resp;
+} UpstreamCall;
+
+// 设置新建池的空闲连接上限 (取自平台预设)
+void upstream_set_max_idle(int max_idle);
+
+// 获取 host:port 对应的池 (不存在则创建)，失败返回 NULL
+// 持有注册表锁并线性查找: 只在创建后端副本时调用，结果保存在 Backend.priv 中
+UpstreamPool* upstream_pool_get(const char *host, int port);
+
+// 取出一个可用连接 (复用空闲连接或新建)，reused 返回是否为复用连接
+// 新建连接不等待 connect 完成: 调用者在 socket 可写后检查 SO_ERROR
+int upstream_checkout(UpstreamPool *pool, int *reused);
+
+// 归还连接: reusable = 0 或池已满时关闭
+void upstream_release(UpstreamPool *pool, int fd, int reusable);
+
+// 异步调用: 取连接并开始发送 POST 请求，失败返回 -1
+int upstream_call_start(UpstreamCall *call, UpstreamPool *pool, const char *path, const char *body);
+
+// 在 socket 就绪时推进: 1 = 响应头就绪, 0 = 等待 I/O, -1 = 失败
+// 复用连接在收到响应前失败时会换新连接重试一次 (call->fd 随之改变)
+int upstream_call_resume(UpstreamCall *call);
+
+// 把进行中的调用转移到 dst (原所有者的请求即将释放): body 为新所有者持有的请求 body 副本，
+// 响应头已到达 (UPSTREAM_CALL_BODY) 后不再发送或重试，可为 NULL
+void upstream_call_move(UpstreamCall *dst, const UpstreamCall *src, const char *body);
+
+// 结束调用: 归还或关闭连接
+void upstream_call_finish(UpstreamCall *call, int reusable);
+
+// 读取解码后的 body: 返回字节数，0 = body 结束，-1 = 错误，-2 = 暂无数据
+ssize_t upstream_read_body(UpstreamResponse *resp, char *out, size_t size);
+
+// 同 upstream_read_body，但不复制: data 指向内部缓冲区，下一次读取前有效
+ssize_t upstream_body_next(UpstreamResponse *resp, const char **data, size_t size);
+
+// 读完并丢弃剩余 body: 1 = 完成, 0 = 暂无数据, -1 = 错误
+int upstream_drain_body(UpstreamResponse *resp);
+
+// body 已完整读取且连接可复用
+int upstream_reusable(const UpstreamResponse *resp);
+
+// 关闭所有池中的空闲连接
+void upstream_cleanup(void);
+
+#endif